@@ -6,10 +6,11 @@
 #include <vector>
 
 constexpr uint32_t kInfinity = std::numeric_limits<uint32_t>::max() / 4;
+constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
 
 struct GraphDefinition {
-    uint16_t vertexCount = 0;
-    uint16_t edgeCount = 0;
+    uint32_t vertexCount = 0;
+    uint32_t edgeCount = 0;
     std::vector<std::vector<int>> incidence;
     std::vector<uint32_t> weights;
 };
@@ -17,13 +18,13 @@ struct GraphDefinition {
 struct PathComputation {
     bool reachable = false;
     uint32_t distance = 0;
-    std::vector<uint16_t> path;
+    std::vector<uint32_t> path;
     std::string error;
 };
 
 struct EdgeData {
-    uint16_t u;
-    uint16_t v;
+    uint32_t u;
+    uint32_t v;
     uint32_t weight;
 };
 
@@ -31,10 +32,10 @@ std::vector<EdgeData> collectEdges(const GraphDefinition& definition, std::strin
     std::vector<EdgeData> edges;
     edges.reserve(definition.edgeCount);
 
-    for (uint16_t e = 0; e < definition.edgeCount; ++e) {
-        std::vector<uint16_t> endpoints;
+    for (uint32_t e = 0; e < definition.edgeCount; ++e) {
+        std::vector<uint32_t> endpoints;
         endpoints.reserve(2);
-        for (uint16_t v = 0; v < definition.vertexCount; ++v) {
+        for (uint32_t v = 0; v < definition.vertexCount; ++v) {
             if (definition.incidence[v][e] == 1) {
                 endpoints.push_back(v);
             }
@@ -56,7 +57,7 @@ std::vector<EdgeData> collectEdges(const GraphDefinition& definition, std::strin
     return edges;
 }
 
-PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint16_t target) {
+PathComputation bellmanFord(const GraphDefinition& graph, uint32_t source, uint32_t target) {
     PathComputation result;
 
     if (graph.vertexCount == 0) {
@@ -75,29 +76,28 @@ PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint1
         return result;
     }
 
-    const uint16_t n = graph.vertexCount;
+    const uint32_t n = graph.vertexCount;
     std::vector<uint32_t> dist(n, kInfinity);
-    std::vector<int16_t> parent(n, -1);
+    std::vector<uint32_t> parent(n, kNoParent);
 
     dist[source] = 0;
-    parent[source] = -1;
 
-    for (uint16_t iter = 0; iter < n - 1; ++iter) {
+    for (uint32_t iter = 0; iter < n - 1; ++iter) {
         bool updated = false;
         for (const auto& edge : edges) {
-            const uint16_t u = edge.u;
-            const uint16_t v = edge.v;
+            const uint32_t u = edge.u;
+            const uint32_t v = edge.v;
             const uint32_t w = edge.weight;
 
             if (dist[u] != kInfinity && dist[u] + w < dist[v]) {
                 dist[v] = dist[u] + w;
-                parent[v] = static_cast<int16_t>(u);
+                parent[v] = u;
                 updated = true;
             }
             if (dist[v] != kInfinity && dist[v] + w < dist[u]) {
                 dist[u] = dist[v] + w;
                 if (u != source) {
-                    parent[u] = static_cast<int16_t>(v);
+                    parent[u] = v;
                 }
                 updated = true;
             }
@@ -115,10 +115,10 @@ PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint1
         return result;
     }
 
-    std::vector<uint16_t> path;
-    for (int16_t v = static_cast<int16_t>(target); v != -1; v = parent[v]) {
-        path.push_back(static_cast<uint16_t>(v));
-        if (v == static_cast<int16_t>(source)) {
+    std::vector<uint32_t> path;
+    for (uint32_t v = target; v != kNoParent; v = parent[v]) {
+        path.push_back(v);
+        if (v == source) {
             break;
         }
     }
@@ -135,7 +135,7 @@ PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint1
     return result;
 }
 
-GraphDefinition generateCompleteGraph(uint16_t n) {
+GraphDefinition generateCompleteGraph(uint32_t n) {
     GraphDefinition graph;
     graph.vertexCount = n;
     graph.edgeCount = n * (n - 1) / 2;
@@ -143,9 +143,9 @@ GraphDefinition generateCompleteGraph(uint16_t n) {
     graph.incidence.assign(n, std::vector<int>(graph.edgeCount, 0));
     graph.weights.resize(graph.edgeCount);
     
-    uint16_t edgeIdx = 0;
-    for (uint16_t i = 0; i < n; ++i) {
-        for (uint16_t j = i + 1; j < n; ++j) {
+    uint32_t edgeIdx = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint32_t j = i + 1; j < n; ++j) {
             graph.incidence[i][edgeIdx] = 1;
             graph.incidence[j][edgeIdx] = 1;
             graph.weights[edgeIdx] = 1;
@@ -157,10 +157,10 @@ GraphDefinition generateCompleteGraph(uint16_t n) {
 }
 
 int main() {
-    uint16_t maxVertices = 0;
+    uint32_t maxVertices = 0;
     uint32_t maxEdges = 0;
     
-    for (uint16_t n = 6; n <= 1000; ++n) {
+    for (uint32_t n = 6; n <= 1000; ++n) {
         GraphDefinition graph = generateCompleteGraph(n);
         uint32_t edges = n * (n - 1) / 2;
         
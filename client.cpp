@@ -1,19 +1,23 @@
 // Клиентская часть приложения: ввод графа, формирование запросов и обмен с сервером по TCP/UDP.
 
 #include <arpa/inet.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <optional>
 #include <sstream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -22,11 +26,29 @@
 
 namespace {
 
-constexpr uint16_t kMaxVertices = 65535;
-constexpr uint16_t kMaxEdges = 65535;
-constexpr int kAckTimeoutSeconds = 3;
-constexpr int kAckRetries = 3;
-constexpr int maxGraphSize = 497025;
+constexpr uint32_t kMaxVertices = 1 << 24;
+constexpr uint32_t kMaxEdges = 1 << 24;
+
+// Наибольшее количество ячеек матрицы инцидентности (вершины x рёбра) читаемого графа: матрица
+// хранится битами, поэтому граф занимает не более 512 МБ.
+constexpr uint64_t kMaxIncidenceCells = uint64_t{1} << 32;
+
+// Параметры таймаута повторной передачи UDP (RTO): начальное значение до первого измерения RTT,
+// нижняя и верхняя границы. Нижняя граница больше задержки отложенного ACK на сервере (2 мс).
+constexpr std::chrono::microseconds kInitialRto{200000};
+constexpr std::chrono::microseconds kMinRto{10000};
+constexpr std::chrono::microseconds kMaxRto{2000000};
+
+// Время без единой датаграммы от сервера, после которого связь считается потерянной. Повторы идут
+// чаще (через RTO), но сервер без пула потоков может долго не отвечать, обрабатывая большой запрос.
+constexpr std::chrono::seconds kLossTimeout{6};
+
+// Количество TCP-запросов, отправляемых без ожидания ответов (конвейер). Окно меньше ограничения
+// сервера на одновременно обрабатываемые запросы соединения, поэтому сервер не перестаёт читать сокет.
+constexpr std::size_t kTcpPipelineWindow = 32;
+
+// Количество фрагментов большого UDP-сообщения, отправляемых без ожидания подтверждений.
+constexpr std::size_t kChunkWindow = 16;
 
 enum class Transport { Tcp, Udp };
 
@@ -36,20 +58,53 @@ struct ClientConfig {
     uint16_t port;
 };
 
+// Обработчик сообщений ответа на запрос (TCP и UDP): получает очередное сообщение с requestId
+// запроса (кроме подтверждений) и возвращает true, когда ответ получен полностью. Ответ на
+// BatchPathQuery может состоять из нескольких сообщений.
+using ResponseHandler = std::function<bool(const netproto::MessageHeader&, std::vector<uint8_t>&)>;
+
 struct TcpConnection {
     int socket = -1;
     sockaddr_in address{};
+    uint16_t requestCounter = 1;
+    std::vector<uint16_t> pending;  // requestId отправленных запросов, ответ на которые ещё не забран
+    std::unordered_map<uint16_t, std::deque<std::pair<netproto::MessageHeader, std::vector<uint8_t>>>>
+        received;  // Принятые, но ещё не забранные сообщения ответов по requestId
+};
+
+// Оценка времени приёма-передачи (RTT) по алгоритму TCP (RFC 6298): сглаженное RTT (srtt) и его
+// отклонение (rttvar) задают таймаут повторной передачи rto = srtt + 4 * rttvar.
+struct RttEstimator {
+    std::chrono::microseconds srtt{0};
+    std::chrono::microseconds rttvar{0};
+    std::chrono::microseconds rto = kInitialRto;
+    bool hasSample = false;
+
+    void addSample(std::chrono::microseconds rtt) {
+        if (!hasSample) {
+            srtt = rtt;
+            rttvar = rtt / 2;
+            hasSample = true;
+        } else {
+            const auto deviation = srtt > rtt ? srtt - rtt : rtt - srtt;
+            rttvar = (3 * rttvar + deviation) / 4;
+            srtt = (7 * srtt + rtt) / 8;
+        }
+        rto = std::clamp(srtt + 4 * rttvar, kMinRto, kMaxRto);
+    }
 };
 
 struct UdpConnection {
     int socket = -1;
     sockaddr_in address{};
     uint16_t requestCounter = 1;
+    RttEstimator rtt;  // Оценка RTT до сервера для выбора таймаута повторной передачи
 };
 
 struct ClientState {
     graph::GraphDefinition graph;
     bool graphLoaded = false;
+    netproto::ProtocolVersion version = netproto::ProtocolVersion::V1;  // Версия формата запросов к графу
 };
 
 // Вывод краткой справки по командам клиента: показывает список доступных команд и их описание.
@@ -58,7 +113,12 @@ void printLocalHelp() {
                  "  help                - запросить список команд у сервера\n"
                  "  input               - ввести граф вручную\n"
                  "  load <путь>         - считать граф из файла\n"
-                 "  query <u> <v>       - найти путь между вершинами u и v (нумерация с 0)\n"
+                 "  query <u> <v> ...   - найти путь между вершинами u и v (нумерация с 0);\n"
+                 "                        несколько пар по TCP отправляются без ожидания ответов\n"
+                 "  batch <u> <v> ...   - найти пути для нескольких пар одним пакетным запросом\n"
+                 "  dist <u> [parents]  - найти расстояния от вершины u до всех вершин графа\n"
+                 "                        (parents - также получить предшественников на путях)\n"
+                 "  table <u> ... to <v> ... - таблица расстояний от вершин u до вершин v\n"
                  "  exit                - завершить работу клиента\n";
 }
 
@@ -82,9 +142,9 @@ bool readGraphFromStream(std::istream& in, graph::GraphDefinition& graphDef, std
                 ". Требуется от 6 до " + std::to_string(kMaxEdges) + ".";
         return false;
     }
-    if (edges * vertices > maxGraphSize) {
-        error = "Неверный размер матрицы инцидентности: " + std::to_string(edges * vertices) + 
-                ". Требуется от 36 до " + std::to_string(maxGraphSize) + ".";
+    if (uint64_t{vertices} * edges > kMaxIncidenceCells) {
+        error = "Слишком большая матрица инцидентности: " + std::to_string(vertices) + " x " +
+                std::to_string(edges) + ".";
         return false;
     }
 
@@ -93,10 +153,10 @@ bool readGraphFromStream(std::istream& in, graph::GraphDefinition& graphDef, std
 
     graphDef.vertexCount = vertices;
     graphDef.edgeCount = edges;
-    graphDef.incidence.assign(vertices, std::vector<int>(edges, 0));
+    graphDef.incidence.reset(vertices, edges);
 
     // Читаем матрицу инцидентности построчно с проверкой количества чисел в каждой строке
-    for (uint16_t v = 0; v < vertices; ++v) {
+    for (uint32_t v = 0; v < vertices; ++v) {
         // Сохраняем позицию перед чтением строки для проверки лишних чисел
         std::string line;
         std::getline(in, line);
@@ -127,9 +187,11 @@ bool readGraphFromStream(std::istream& in, graph::GraphDefinition& graphDef, std
             return false;
         }
         
-        // Копируем значения в матрицу
-        for (uint16_t e = 0; e < edges; ++e) {
-            graphDef.incidence[v][e] = rowValues[e];
+        // Копируем единицы в матрицу
+        for (uint32_t e = 0; e < edges; ++e) {
+            if (rowValues[e] == 1) {
+                graphDef.incidence.set(v, e);
+            }
         }
     }
 
@@ -277,120 +339,406 @@ bool readTcpMessage(int socket,
     return true;
 }
 
-// Отправка TCP-сообщения: отправляет заголовок и полезную нагрузку через TCP-сокет.
-// Сначала отправляет заголовок, затем полезную нагрузку. Возвращает false при ошибке отправки.
+// Заголовок запроса в версии формата version. Биты версии записываются только для версий новее
+// первой, поэтому запросы к графам до 65535 вершин понимает и сервер без поддержки версий.
+netproto::MessageHeader makeRequestHeader(netproto::Command command,
+                                          uint16_t requestId,
+                                          std::size_t payloadSize,
+                                          netproto::ProtocolVersion version) {
+    netproto::MessageHeader header{command,
+                                   netproto::Status::Ok,
+                                   requestId,
+                                   static_cast<uint32_t>(payloadSize),
+                                   0};
+    if (version != netproto::ProtocolVersion::V1) {
+        netproto::setProtocolVersion(header, version);
+    }
+    return header;
+}
+
+// Версия формата полезной нагрузки ответа: сервер отвечает в версии запроса.
+netproto::ProtocolVersion responseVersion(const netproto::MessageHeader& header) {
+    return static_cast<netproto::ProtocolVersion>(
+        std::min(netproto::protocolVersionNumber(header), static_cast<uint8_t>(netproto::kLatestProtocolVersion)));
+}
+
+// Версия формата, в которой передаются номера вершин и количества графа graphDef: версия 1
+// для графов до 65535 вершин и рёбер, иначе версия 2.
+netproto::ProtocolVersion requiredVersion(const graph::GraphDefinition& graphDef) {
+    const uint32_t limit = netproto::maxVertexCount(netproto::ProtocolVersion::V1);
+    return graphDef.vertexCount > limit || graphDef.edgeCount > limit ? netproto::ProtocolVersion::V2
+                                                                      : netproto::ProtocolVersion::V1;
+}
+
+// Проверка по ответу на запрос Help, переданный в версии version, что сервер поддерживает эту
+// версию: сервер отвечает наибольшей общей версией, сервер без поддержки версий - без битов версии.
+bool supportsVersion(const netproto::MessageHeader& helpResponse, netproto::ProtocolVersion version) {
+    return netproto::protocolVersionNumber(helpResponse) >= static_cast<uint8_t>(version);
+}
+
+// Отправка TCP-сообщения: отправляет заголовок и полезную нагрузку через TCP-сокет одним буфером,
+// чтобы запросы конвейера не задерживались алгоритмом Нейгла. Возвращает false при ошибке отправки.
 bool sendTcpMessage(int socket,
                     const netproto::MessageHeader& header,
                     const std::vector<uint8_t>& payload) {
-    std::vector<uint8_t> headerBuf = netproto::serializeHeader(header);
-    if (!sendAll(socket, headerBuf.data(), headerBuf.size())) {
+    std::vector<uint8_t> message = netproto::serializeHeader(header);
+    message.insert(message.end(), payload.begin(), payload.end());
+    return sendAll(socket, message.data(), message.size());
+}
+
+// Приём одного сообщения TCP-ответа и сохранение его в received. Сообщения с неизвестным requestId
+// (на запросы, которые не ожидаются) отбрасываются. Возвращает false при разрыве соединения.
+bool receiveTcpResponse(TcpConnection& connection) {
+    netproto::MessageHeader header;
+    std::vector<uint8_t> payload;
+    if (!readTcpMessage(connection.socket, header, payload)) {
         return false;
     }
-    if (!payload.empty()) {
-        return sendAll(socket, payload.data(), payload.size());
+    if (std::find(connection.pending.begin(), connection.pending.end(), header.requestId) !=
+        connection.pending.end()) {
+        connection.received[header.requestId].emplace_back(header, std::move(payload));
+    }
+    return true;
+}
+
+// Асинхронная отправка TCP-запроса: присваивает запросу requestId и отправляет его, не дожидаясь
+// ответа. Ответ забирается функцией awaitTcpResponse по возвращённому requestId; сервер выполняет
+// запросы соединения параллельно, поэтому ответы приходят в порядке завершения, а не отправки.
+// Если ни одного сообщения ответа не пришло уже на kTcpPipelineWindow запросов, сначала принимает
+// ответы (они сохраняются до вызова awaitTcpResponse). Возвращает nullopt при ошибке отправки или разрыве соединения.
+std::optional<uint16_t> submitTcpRequest(TcpConnection& connection,
+                                         netproto::Command command,
+                                         const std::vector<uint8_t>& payload,
+                                         netproto::ProtocolVersion version) {
+    auto unanswered = [&connection]() {
+        return std::count_if(connection.pending.begin(), connection.pending.end(), [&connection](uint16_t id) {
+            return connection.received.count(id) == 0;
+        });
+    };
+    while (unanswered() >= static_cast<std::ptrdiff_t>(kTcpPipelineWindow)) {
+        if (!receiveTcpResponse(connection)) {
+            return std::nullopt;
+        }
+    }
+    const uint16_t requestId = connection.requestCounter++;
+    const netproto::MessageHeader header = makeRequestHeader(command, requestId, payload.size(), version);
+    if (!sendTcpMessage(connection.socket, header, payload)) {
+        return std::nullopt;
+    }
+    connection.pending.push_back(requestId);
+    return requestId;
+}
+
+// Ожидание ответа на запрос requestId: принимает сообщения из сокета, сохраняя ответы на другие
+// запросы, и передаёт сообщения ответа обработчику onResponse, пока он не вернёт true.
+// Возвращает false при разрыве соединения.
+bool awaitTcpResponseParts(TcpConnection& connection, uint16_t requestId, const ResponseHandler& onResponse) {
+    bool complete = false;
+    while (!complete) {
+        auto it = connection.received.find(requestId);
+        if (it == connection.received.end() || it->second.empty()) {
+            if (!receiveTcpResponse(connection)) {
+                return false;
+            }
+            continue;
+        }
+        auto message = std::move(it->second.front());
+        it->second.pop_front();
+        complete = onResponse(message.first, message.second);
     }
+    connection.received.erase(requestId);
+    connection.pending.erase(std::find(connection.pending.begin(), connection.pending.end(), requestId));
     return true;
 }
 
-// Отправка UDP-сообщения с подтверждением: реализует надёжную доставку для UDP.
-// Отправляет сообщение и ждёт подтверждения (ACK) от сервера. Выполняет до 3 попыток с таймаутом 3 секунды.
-// После получения ACK ожидает ответное сообщение с данными. Возвращает nullopt при потере связи.
+// Ожидание ответа из одного сообщения на запрос requestId. Возвращает nullopt при разрыве соединения.
 std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>>
-sendUdpWithAck(UdpConnection& connection,
-               const netproto::MessageHeader& header,
-               const std::vector<uint8_t>& payload) {
-    std::vector<uint8_t> headerBuf = netproto::serializeHeader(header);
-    std::vector<uint8_t> packet;
-    packet.reserve(headerBuf.size() + payload.size());
-    packet.insert(packet.end(), headerBuf.begin(), headerBuf.end());
-    packet.insert(packet.end(), payload.begin(), payload.end());
+awaitTcpResponse(TcpConnection& connection, uint16_t requestId) {
+    std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>> response;
+    auto keep = [&response](const netproto::MessageHeader& header, std::vector<uint8_t>& payload) {
+        response.emplace(header, std::move(payload));
+        return true;
+    };
+    if (!awaitTcpResponseParts(connection, requestId, keep)) {
+        return std::nullopt;
+    }
+    return response;
+}
 
-    for (int attempt = 1; attempt <= kAckRetries; ++attempt) {
-        ssize_t sent = sendto(connection.socket,
-                              packet.data(),
-                              static_cast<int>(packet.size()),
-                              0,
-                              reinterpret_cast<sockaddr*>(&connection.address),
-                              sizeof(connection.address));
-        if (sent < 0) {
-            perror("sendto");
-            return std::nullopt;
+// Проверка перед загрузкой графа по TCP, что сервер поддерживает версию формата version (для версии 1
+// запрос не отправляется). Возвращает false, если версия не поддерживается или соединение разорвано.
+bool tcpServerSupports(TcpConnection& connection, netproto::ProtocolVersion version) {
+    if (version == netproto::ProtocolVersion::V1) {
+        return true;
+    }
+    auto requestId = submitTcpRequest(connection, netproto::Command::Help, {}, version);
+    if (!requestId) {
+        return false;
+    }
+    auto response = awaitTcpResponse(connection, *requestId);
+    return response && supportsVersion(response->first, version);
+}
+
+// Приём одной UDP-датаграммы с ожиданием до момента deadline (ppoll с точностью до наносекунд).
+// Возвращает nullopt по истечении времени ожидания или при получении повреждённого пакета.
+std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>>
+receiveUdpMessage(int socket, std::chrono::steady_clock::time_point deadline) {
+    const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (wait.count() <= 0) {
+        return std::nullopt;
+    }
+    timespec timeout{};
+    timeout.tv_sec = static_cast<time_t>(wait.count() / 1000000000);
+    timeout.tv_nsec = static_cast<long>(wait.count() % 1000000000);
+    pollfd readable{socket, POLLIN, 0};
+    if (ppoll(&readable, 1, &timeout, nullptr) <= 0) {
+        return std::nullopt;
+    }
+    std::vector<uint8_t> buffer(65536);
+    ssize_t bytes = recvfrom(socket, buffer.data(), buffer.size(), 0, nullptr, nullptr);
+    if (bytes < static_cast<ssize_t>(netproto::kHeaderSize)) {
+        return std::nullopt;
+    }
+    buffer.resize(static_cast<size_t>(bytes));
+    netproto::MessageHeader header;
+    if (!netproto::deserializeHeader(buffer.data(), buffer.size(), header)) {
+        return std::nullopt;
+    }
+    std::vector<uint8_t> payload(buffer.begin() + netproto::kHeaderSize, buffer.end());
+    return std::make_optional(std::make_pair(header, std::move(payload)));
+}
+
+// Отправка готовой датаграммы серверу.
+bool sendUdpPacket(const UdpConnection& connection, const std::vector<uint8_t>& packet) {
+    ssize_t sent = sendto(connection.socket,
+                          packet.data(),
+                          packet.size(),
+                          0,
+                          reinterpret_cast<const sockaddr*>(&connection.address),
+                          sizeof(connection.address));
+    if (sent < 0) {
+        perror("sendto");
+        return false;
+    }
+    return true;
+}
+
+// Удвоение таймаута повторной передачи (экспоненциальная отсрочка) с ограничением kMaxRto.
+std::chrono::microseconds backoff(std::chrono::microseconds timeout) {
+    return std::min(timeout * 2, kMaxRto);
+}
+
+// Отправка большого UDP-сообщения фрагментами: полезная нагрузка делится на фрагменты размером
+// не более MTU (команда Chunk), которые отправляются окнами по kChunkWindow штук. Сервер подтверждает
+// каждый фрагмент отдельно (ChunkAck), поэтому при потере пакета повторно отправляются только
+// неподтверждённые фрагменты. Окно ожидает подтверждений в течение RTO соединения, который удваивается,
+// пока окно не продвигается; RTT измеряется по фрагментам, переданным один раз. Если в течение
+// kLossTimeout от сервера не приходит ни одной датаграммы, связь считается потерянной.
+// Ответ на собранное сообщение или сообщение об ошибке (NACK) от сервера передаётся обработчику
+// onResponse. Возвращает false при потере связи.
+bool sendUdpChunked(UdpConnection& connection,
+                    const netproto::MessageHeader& header,
+                    const std::vector<uint8_t>& payload,
+                    const ResponseHandler& onResponse) {
+    std::vector<std::vector<uint8_t>> packets;
+    for (const netproto::ChunkPayload& chunk : netproto::splitIntoChunks(header.command, payload)) {
+        std::vector<uint8_t> chunkPayload = netproto::serializeChunk(chunk);
+        netproto::MessageHeader chunkHeader = header;
+        chunkHeader.command = netproto::Command::Chunk;
+        chunkHeader.payloadSize = static_cast<uint32_t>(chunkPayload.size());
+        std::vector<uint8_t> packet = netproto::serializeHeader(chunkHeader);
+        packet.insert(packet.end(), chunkPayload.begin(), chunkPayload.end());
+        packets.push_back(std::move(packet));
+    }
+
+    std::vector<bool> acked(packets.size(), false);
+    std::vector<int> transmissions(packets.size(), 0);
+    std::vector<std::chrono::steady_clock::time_point> sentAt(packets.size());
+    std::size_t firstUnacked = 0;
+    std::chrono::microseconds timeout = connection.rtt.rto;
+    int silentRounds = 0;
+    auto lastHeard = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - lastHeard < kLossTimeout) {
+        std::vector<std::size_t> window;
+        for (std::size_t i = firstUnacked; i < packets.size() && window.size() < kChunkWindow; ++i) {
+            if (acked[i]) {
+                continue;
+            }
+            if (!sendUdpPacket(connection, packets[i])) {
+                return false;
+            }
+            sentAt[i] = std::chrono::steady_clock::now();
+            ++transmissions[i];
+            window.push_back(i);
+        }
+        if (window.empty() && (silentRounds > 0 || timeout > connection.rtt.rto)) {
+            // Все фрагменты подтверждены, но ответ не получен: повторяем последний фрагмент,
+            // и сервер отправит сохранённый ответ на собранное сообщение (или снова подтвердит
+            // фрагмент, если сообщение ещё обрабатывается).
+            if (!sendUdpPacket(connection, packets.back())) {
+                return false;
+            }
         }
 
-        fd_set readSet;
-        FD_ZERO(&readSet);
-        FD_SET(connection.socket, &readSet);
-        timeval timeout{};
-        timeout.tv_sec = kAckTimeoutSeconds;
-
-        int ready = select(connection.socket + 1, &readSet, nullptr, nullptr, &timeout);
-        if (ready > 0 && FD_ISSET(connection.socket, &readSet)) {
-            std::vector<uint8_t> recvBuf(2048);
-            sockaddr_in from{};
-            socklen_t fromLen = sizeof(from);
-            ssize_t bytes = recvfrom(connection.socket,
-                                     recvBuf.data(),
-                                     static_cast<int>(recvBuf.size()),
-                                     0,
-                                     reinterpret_cast<sockaddr*>(&from),
-                                     &fromLen);
-            if (bytes < static_cast<ssize_t>(netproto::kHeaderSize)) {
+        // Ждём подтверждения окна (или ответа, если все фрагменты уже подтверждены).
+        bool progress = false;
+        bool heard = false;
+        std::size_t windowAcked = 0;
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (window.empty() || windowAcked < window.size()) {
+            auto message = receiveUdpMessage(connection.socket, deadline);
+            if (!message) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    break;
+                }
                 continue;
             }
-            recvBuf.resize(static_cast<size_t>(bytes));
-            std::vector<uint8_t> headerPart(recvBuf.begin(),
-                                            recvBuf.begin() + netproto::kHeaderSize);
-            netproto::MessageHeader ackHeader;
-            if (!netproto::deserializeHeader(headerPart, ackHeader)) {
+            if (message->first.requestId != header.requestId) {
                 continue;
             }
-            std::vector<uint8_t> payloadPart(recvBuf.begin() + netproto::kHeaderSize, recvBuf.end());
-
-            if (ackHeader.command == netproto::Command::Ack &&
-                ackHeader.requestId == header.requestId) {
-                if (payloadPart.empty()) {
-                    // Ждём ответ с данными.
-                    FD_ZERO(&readSet);
-                    FD_SET(connection.socket, &readSet);
-                    timeout.tv_sec = kAckTimeoutSeconds;
-                    int readyResp = select(connection.socket + 1, &readSet, nullptr, nullptr, &timeout);
-                    if (readyResp > 0 && FD_ISSET(connection.socket, &readSet)) {
-                        std::vector<uint8_t> respBuf(65536);
-                        sockaddr_in respFrom{};
-                        socklen_t respLen = sizeof(respFrom);
-                        ssize_t respBytes = recvfrom(connection.socket,
-                                                     respBuf.data(),
-                                                     static_cast<int>(respBuf.size()),
-                                                     0,
-                                                     reinterpret_cast<sockaddr*>(&respFrom),
-                                                     &respLen);
-                        if (respBytes < static_cast<ssize_t>(netproto::kHeaderSize)) {
-                            continue;
-                        }
-                        respBuf.resize(static_cast<size_t>(respBytes));
-                        std::vector<uint8_t> respHeaderPart(respBuf.begin(),
-                                                            respBuf.begin() + netproto::kHeaderSize);
-                        netproto::MessageHeader responseHeader;
-                        if (!netproto::deserializeHeader(respHeaderPart, responseHeader)) {
-                            continue;
-                        }
-                        std::vector<uint8_t> respPayload(respBuf.begin() + netproto::kHeaderSize,
-                                                         respBuf.end());
-                        return std::make_optional(std::make_pair(responseHeader, respPayload));
+            heard = true;
+            lastHeard = std::chrono::steady_clock::now();
+            if (message->first.command == netproto::Command::ChunkAck) {
+                netproto::ChunkAckPayload ack{};
+                if (netproto::deserializeChunkAck(message->second, ack) &&
+                    ack.index < acked.size() && !acked[ack.index]) {
+                    acked[ack.index] = true;
+                    progress = true;
+                    if (transmissions[ack.index] == 1) {
+                        connection.rtt.addSample(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - sentAt[ack.index]));
+                    }
+                    if (std::find(window.begin(), window.end(), ack.index) != window.end()) {
+                        ++windowAcked;
                     }
                 }
-            } else {
-                // Возможно, пришёл ответ без ACK (например, help).
-                if (ackHeader.requestId == header.requestId) {
-                    return std::make_optional(std::make_pair(ackHeader, payloadPart));
+                continue;
+            }
+            if (message->first.command == netproto::Command::Ack) {
+                continue;
+            }
+            if (onResponse(message->first, message->second)) {
+                return true;
+            }
+            // Получена часть ответа из нескольких сообщений: ждём остальные части.
+            progress = true;
+        }
+        while (firstUnacked < packets.size() && acked[firstUnacked]) {
+            ++firstUnacked;
+        }
+
+        if (heard) {
+            silentRounds = 0;
+        }
+        if (progress) {
+            timeout = connection.rtt.rto;
+        } else {
+            // Окно не продвинулось: удваиваем таймаут. Раунд без единой датаграммы от сервера
+            // считается неудачной попыткой.
+            timeout = backoff(timeout);
+            if (!heard) {
+                ++silentRounds;
+                std::cout << "(Нет ответа, попытка " << silentRounds << ")\n";
+            }
+        }
+    }
+    std::cout << "Потеряна связь с сервером.\n";
+    return false;
+}
+
+// Обмен с UDP-сервером с подтверждением: реализует надёжную доставку для UDP.
+// Отправляет сообщение и ждёт ACK или ответ сервера в течение RTO соединения; при отсутствии ответа
+// повторяет запрос с тем же requestId, удваивая таймаут (сервер не выполняет повторный запрос заново,
+// а подтверждает его или отправляет сохранённый ответ). Датаграммы с чужим requestId (запоздавшие
+// ответы на предыдущие запросы) пропускаются. RTT измеряется только по запросам, отправленным один раз
+// (алгоритм Карна). Если в течение kLossTimeout от сервера не приходит ни одной датаграммы,
+// возвращает false (потеря связи). Если сервер подтвердил запрос, но ещё вычисляет ответ, повторы
+// продолжаются с растущим таймаутом и служат проверкой, что сервер доступен.
+// Сообщения ответа передаются обработчику onResponse, пока он не вернёт true (ответ из нескольких
+// частей); после каждой новой части ожидание продлевается на RTO, а по истечении таймаута повтор
+// запроса заставляет сервер отправить сохранённый ответ целиком.
+// Сообщения, не помещающиеся в одну датаграмму размера MTU, передаются фрагментами (sendUdpChunked).
+// Запрос передаётся с флагом kFlagPiggybackAck: сервер с поддержкой режима отвечает на быстрые запросы
+// сразу, без отдельного ACK, поэтому первым может прийти как ACK, так и сам ответ.
+bool exchangeUdp(UdpConnection& connection,
+                 const netproto::MessageHeader& header,
+                 const std::vector<uint8_t>& payload,
+                 const ResponseHandler& onResponse) {
+    if (netproto::kHeaderSize + payload.size() > netproto::kChunkDatagramSize) {
+        return sendUdpChunked(connection, header, payload, onResponse);
+    }
+    netproto::MessageHeader requestHeader = header;
+    requestHeader.reserved |= netproto::kFlagPiggybackAck;
+    std::vector<uint8_t> packet = netproto::serializeHeader(requestHeader);
+    packet.insert(packet.end(), payload.begin(), payload.end());
+
+    std::chrono::microseconds timeout = connection.rtt.rto;
+    int transmissions = 0;
+    int silentRounds = 0;
+    bool sampled = false;
+    auto lastHeard = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - lastHeard < kLossTimeout) {
+        if (!sendUdpPacket(connection, packet)) {
+            return false;
+        }
+        ++transmissions;
+        const auto sentAt = std::chrono::steady_clock::now();
+        auto deadline = sentAt + timeout;
+        bool heard = false;
+        while (true) {
+            auto message = receiveUdpMessage(connection.socket, deadline);
+            if (!message) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    break;
                 }
+                continue;
+            }
+            if (message->first.requestId != header.requestId) {
+                continue;
+            }
+            heard = true;
+            lastHeard = std::chrono::steady_clock::now();
+            if (transmissions == 1 && !sampled) {
+                connection.rtt.addSample(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - sentAt));
+                sampled = true;
             }
+            if (message->first.command == netproto::Command::Ack) {
+                continue;
+            }
+            if (onResponse(message->first, message->second)) {
+                return true;
+            }
+            deadline = lastHeard + connection.rtt.rto;
+        }
+        timeout = backoff(timeout);
+        if (heard) {
+            silentRounds = 0;
         } else {
-            std::cout << "(Нет ответа, попытка " << attempt << ")\n";
+            ++silentRounds;
+            std::cout << "(Нет ответа, попытка " << silentRounds << ")\n";
         }
     }
     std::cout << "Потеряна связь с сервером.\n";
-    return std::nullopt;
+    return false;
+}
+
+// Отправка UDP-сообщения с подтверждением и ожидание ответа из одного сообщения (exchangeUdp).
+// Возвращает nullopt при потере связи.
+std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>>
+sendUdpWithAck(UdpConnection& connection,
+               const netproto::MessageHeader& header,
+               const std::vector<uint8_t>& payload) {
+    std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>> response;
+    auto keep = [&response](const netproto::MessageHeader& responseHeader, std::vector<uint8_t>& responsePayload) {
+        response.emplace(responseHeader, std::move(responsePayload));
+        return true;
+    };
+    if (!exchangeUdp(connection, header, payload, keep)) {
+        return std::nullopt;
+    }
+    return response;
 }
 
 // Обработка ошибки от сервера: десериализует и выводит сообщение об ошибке.
@@ -404,36 +752,51 @@ void handleServerError(const netproto::MessageHeader& header,
     }
 }
 
+// Вывод найденного пути: длина пути и последовательность вершин.
+void printPath(const netproto::PathResultPayload& result) {
+    std::cout << "Длина пути: " << result.distance << "\nПуть: ";
+    for (size_t i = 0; i < result.path.size(); ++i) {
+        std::cout << result.path[i];
+        if (i + 1 < result.path.size()) {
+            std::cout << " -> ";
+        }
+    }
+    std::cout << "\n";
+}
+
 // Обработка результата поиска пути: десериализует и выводит длину пути и последовательность вершин.
-void handlePathResult(const std::vector<uint8_t>& payload) {
+void handlePathResult(const netproto::MessageHeader& header, const std::vector<uint8_t>& payload) {
     netproto::PathResultPayload resultPayload;
     std::string error;
-    if (!netproto::deserializePathResult(payload, resultPayload, error)) {
+    if (!netproto::deserializePathResult(payload, responseVersion(header), resultPayload, error)) {
         std::cerr << "Не удалось разобрать ответ пути: " << error << "\n";
         return;
     }
-    std::cout << "Длина пути: " << resultPayload.distance << "\nПуть: ";
-    for (size_t i = 0; i < resultPayload.path.size(); ++i) {
-        std::cout << resultPayload.path[i];
-        if (i + 1 < resultPayload.path.size()) {
-            std::cout << " -> ";
-        }
-    }
-    std::cout << "\n";
+    printPath(resultPayload);
 }
 
-// Построение полезной нагрузки для загрузки графа: упаковывает граф в бинарный формат протокола.
-std::vector<uint8_t> buildUploadPayload(const graph::GraphDefinition& graphDef) {
-    netproto::UploadGraphPayload payload;
+// Построение полезной нагрузки для загрузки графа: проверяет граф и упаковывает его в виде
+// списка рёбер (команда UploadEdgeList) в версии формата version. Размер такой нагрузки растёт
+// как O(E), а не O(V * E). Возвращает nullopt, если граф не прошёл валидацию.
+std::optional<std::vector<uint8_t>> buildUploadPayload(const graph::GraphDefinition& graphDef,
+                                                       netproto::ProtocolVersion version) {
+    graph::ValidationResult status;
+    std::vector<graph::Edge> edges = graph::buildEdgeList(graphDef, status);
+    if (!status.ok) {
+        std::cerr << "Ошибка валидации графа: " << status.message << "\n";
+        return std::nullopt;
+    }
+    netproto::UploadEdgeListPayload payload;
     payload.vertexCount = graphDef.vertexCount;
-    payload.edgeCount = graphDef.edgeCount;
-    payload.incidenceBits = netproto::packIncidenceMatrix(graphDef.incidence);
-    payload.weights = graphDef.weights;
-    return netproto::serializeUploadGraph(payload);
+    payload.edges.reserve(edges.size());
+    for (const auto& [u, v, weight] : edges) {
+        payload.edges.push_back({u, v, weight});
+    }
+    return netproto::serializeUploadEdgeList(payload, version);
 }
 
 // Обработка ответа от сервера: определяет тип команды и вызывает соответствующую функцию обработки.
-// Поддерживает команды: Error, Help, PathResult, Ack, UploadGraph.
+// Поддерживает команды: Error, Help, PathResult, Ack, UploadGraph, UploadEdgeList.
 void processResponse(const netproto::MessageHeader& header,
                      const std::vector<uint8_t>& payload) {
     if (header.command == netproto::Command::Error) {
@@ -450,14 +813,15 @@ void processResponse(const netproto::MessageHeader& header,
         return;
     }
     if (header.command == netproto::Command::PathResult) {
-        handlePathResult(payload);
+        handlePathResult(header, payload);
         return;
     }
     if (header.command == netproto::Command::Ack) {
         std::cout << "Получено подтверждение.\n";
         return;
     }
-    if (header.command == netproto::Command::UploadGraph) {
+    if (header.command == netproto::Command::UploadGraph ||
+        header.command == netproto::Command::UploadEdgeList) {
         // Сервер подтвердил загрузку графа
         std::string text;
         if (netproto::deserializeString(payload, text)) {
@@ -468,8 +832,350 @@ void processResponse(const netproto::MessageHeader& header,
     std::cout << "Сервер вернул неизвестную команду.\n";
 }
 
+// Разбор аргументов команд query и batch: одна или несколько пар вершин <u> <v>. Проверяет, что граф
+// загружен и вершины входят в диапазон; при ошибке выводит сообщение и возвращает nullopt.
+std::optional<std::vector<netproto::PathQueryPayload>> parseQueryPairs(std::istringstream& cmd,
+                                                                       const ClientState& state,
+                                                                       const std::string& command) {
+    std::vector<netproto::PathQueryPayload> queries;
+    int source = -1;
+    int target = -1;
+    while (cmd >> source) {
+        target = -1;
+        cmd >> target;
+        if (source < 0 || target < 0) {
+            break;
+        }
+        queries.push_back({static_cast<uint32_t>(source), static_cast<uint32_t>(target)});
+        source = -1;
+    }
+    if (queries.empty() || source >= 0 || target < 0) {
+        std::cerr << "Укажите вершины в формате: " << command << " <u> <v>.\n";
+        return std::nullopt;
+    }
+    if (queries.size() > netproto::kMaxBatchQueries) {
+        std::cerr << "Слишком много пар вершин (не более " << netproto::kMaxBatchQueries << ").\n";
+        return std::nullopt;
+    }
+    if (!state.graphLoaded) {
+        std::cerr << "Сначала загрузите граф (команды input/load).\n";
+        return std::nullopt;
+    }
+    for (const netproto::PathQueryPayload& query : queries) {
+        if (query.source >= state.graph.vertexCount || query.target >= state.graph.vertexCount) {
+            std::cerr << "Вершины вне диапазона [0, "
+                      << state.graph.vertexCount - 1 << "].\n";
+            return std::nullopt;
+        }
+    }
+    return queries;
+}
+
+// Вывод пары вершин перед ответом, если в команде query указано несколько пар.
+void printQueryLabel(const std::vector<netproto::PathQueryPayload>& queries, std::size_t index) {
+    if (queries.size() > 1) {
+        std::cout << "Запрос " << queries[index].source << " -> " << queries[index].target << ":\n";
+    }
+}
+
+// Ответ на пакетный запрос путей, собираемый из частей BatchPathResult. Если сервер ответил
+// другим сообщением (например, Error), оно сохраняется в message; malformed - получена
+// некорректная часть ответа.
+struct BatchResponse {
+    std::vector<std::optional<netproto::BatchPathEntry>> entries;
+    std::size_t receivedCount = 0;
+    bool malformed = false;
+    std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>> message;
+};
+
+// Обработчик частей ответа на пакетный запрос: раскладывает результаты по номерам пар и сообщает
+// о завершении, когда получены все пары. Повторно полученные части (после повторной передачи
+// запроса по UDP) не меняют уже принятых результатов.
+ResponseHandler collectBatchResponse(BatchResponse& response) {
+    return [&response](const netproto::MessageHeader& header, std::vector<uint8_t>& payload) {
+        if (header.command != netproto::Command::BatchPathResult) {
+            response.message.emplace(header, std::move(payload));
+            return true;
+        }
+        netproto::BatchPathResultPayload part;
+        std::string error;
+        if (!netproto::deserializeBatchPathResult(payload, responseVersion(header), part, error)) {
+            std::cerr << "Не удалось разобрать ответ пакетного запроса: " << error << "\n";
+            response.malformed = true;
+            return true;
+        }
+        if (response.entries.empty()) {
+            response.entries.resize(part.totalCount);
+        }
+        if (part.totalCount != response.entries.size() ||
+            part.firstIndex + part.entries.size() > response.entries.size()) {
+            std::cerr << "Часть ответа пакетного запроса не соответствует запросу.\n";
+            response.malformed = true;
+            return true;
+        }
+        for (std::size_t i = 0; i < part.entries.size(); ++i) {
+            std::optional<netproto::BatchPathEntry>& slot = response.entries[part.firstIndex + i];
+            if (!slot) {
+                slot = std::move(part.entries[i]);
+                ++response.receivedCount;
+            }
+        }
+        return response.receivedCount == response.entries.size();
+    };
+}
+
+// Вывод ответа на пакетный запрос путей в порядке пар запроса.
+void printBatchResponse(const std::vector<netproto::PathQueryPayload>& queries, const BatchResponse& response) {
+    if (response.message) {
+        processResponse(response.message->first, response.message->second);
+        return;
+    }
+    if (response.malformed) {
+        return;
+    }
+    if (response.entries.size() != queries.size()) {
+        std::cerr << "Количество результатов не совпадает с количеством пар запроса.\n";
+        return;
+    }
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        printQueryLabel(queries, i);
+        const netproto::BatchPathEntry& entry = *response.entries[i];
+        if (entry.status == netproto::Status::Ok) {
+            printPath(entry.result);
+        } else if (entry.status == netproto::Status::NotReady) {
+            std::cerr << "Путь не найден.\n";
+        } else {
+            std::cerr << "Вершины вне графа на сервере.\n";
+        }
+    }
+}
+
+// Разбор аргументов команды dist: вершина <u> и необязательное слово parents. Проверяет, что граф
+// загружен и вершина входит в диапазон; при ошибке выводит сообщение и возвращает nullopt.
+std::optional<netproto::DistanceVectorQueryPayload> parseDistanceQuery(std::istringstream& cmd,
+                                                                       const ClientState& state) {
+    int source = -1;
+    std::string option;
+    if (!(cmd >> source) || source < 0 || (cmd >> option && option != "parents")) {
+        std::cerr << "Укажите вершину в формате: dist <u> [parents].\n";
+        return std::nullopt;
+    }
+    if (!state.graphLoaded) {
+        std::cerr << "Сначала загрузите граф (команды input/load).\n";
+        return std::nullopt;
+    }
+    if (static_cast<uint32_t>(source) >= state.graph.vertexCount) {
+        std::cerr << "Вершина вне диапазона [0, " << state.graph.vertexCount - 1 << "].\n";
+        return std::nullopt;
+    }
+    return netproto::DistanceVectorQueryPayload{static_cast<uint32_t>(source), option == "parents"};
+}
+
+// Вектор расстояний, собираемый из частей DistanceVectorResult. Поля message и malformed имеют
+// тот же смысл, что в BatchResponse.
+struct DistanceResponse {
+    std::vector<uint32_t> dist;
+    std::vector<uint32_t> parent;
+    std::vector<bool> received;
+    std::size_t receivedCount = 0;
+    bool malformed = false;
+    std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>> message;
+};
+
+// Обработчик частей ответа на запрос вектора расстояний: раскладывает расстояния по номерам вершин
+// и сообщает о завершении, когда получены все вершины графа.
+ResponseHandler collectDistanceResponse(DistanceResponse& response) {
+    return [&response](const netproto::MessageHeader& header, std::vector<uint8_t>& payload) {
+        if (header.command != netproto::Command::DistanceVectorResult) {
+            response.message.emplace(header, std::move(payload));
+            return true;
+        }
+        netproto::DistanceVectorPayload part;
+        std::string error;
+        if (!netproto::deserializeDistanceVectorPart(payload, responseVersion(header), part, error)) {
+            std::cerr << "Не удалось разобрать вектор расстояний: " << error << "\n";
+            response.malformed = true;
+            return true;
+        }
+        if (response.received.empty()) {
+            response.dist.assign(part.vertexCount, netproto::kUnreachableDistance);
+            response.parent.assign(part.vertexCount, netproto::kNoParent);
+            response.received.assign(part.vertexCount, false);
+        }
+        if (part.vertexCount != response.received.size()) {
+            std::cerr << "Часть вектора расстояний не соответствует графу.\n";
+            response.malformed = true;
+            return true;
+        }
+        for (std::size_t i = 0; i < part.dist.size(); ++i) {
+            const std::size_t vertex = part.firstVertex + i;
+            if (response.received[vertex]) {
+                continue;
+            }
+            response.received[vertex] = true;
+            response.dist[vertex] = part.dist[i];
+            if (part.includeParents) {
+                response.parent[vertex] = part.parent[i];
+            }
+            ++response.receivedCount;
+        }
+        return response.receivedCount == response.received.size();
+    };
+}
+
+// Вывод вектора расстояний: расстояние до каждой вершины и, если запрошено, её предшественник
+// на кратчайшем пути (путь до любой вершины восстанавливается проходом по предшественникам).
+void printDistanceResponse(const netproto::DistanceVectorQueryPayload& query, const DistanceResponse& response) {
+    if (response.message) {
+        processResponse(response.message->first, response.message->second);
+        return;
+    }
+    if (response.malformed) {
+        return;
+    }
+    std::cout << "Расстояния от вершины " << query.source << ":\n";
+    for (std::size_t v = 0; v < response.dist.size(); ++v) {
+        std::cout << v << ": ";
+        if (response.dist[v] == netproto::kUnreachableDistance) {
+            std::cout << "недостижима\n";
+            continue;
+        }
+        std::cout << response.dist[v];
+        if (query.includeParents && response.parent[v] != netproto::kNoParent) {
+            std::cout << " (через " << response.parent[v] << ")";
+        }
+        std::cout << "\n";
+    }
+}
+
+// Разбор аргументов команды table: список начальных вершин, слово to и список конечных вершин.
+// Проверяет, что граф загружен, вершины входят в диапазон, размеры списков представимы в запросе
+// и таблица не слишком велика; при ошибке выводит сообщение и возвращает nullopt.
+std::optional<netproto::DistanceTableQueryPayload> parseTableQuery(std::istringstream& cmd,
+                                                                   const ClientState& state) {
+    netproto::DistanceTableQueryPayload query;
+    std::vector<uint32_t>* list = &query.sources;
+    std::string token;
+    while (list != nullptr && cmd >> token) {
+        if (token == "to" && list == &query.sources) {
+            list = &query.targets;
+            continue;
+        }
+        std::istringstream number(token);
+        int vertex = -1;
+        if (!(number >> vertex) || !number.eof() || vertex < 0) {
+            list = nullptr;
+            break;
+        }
+        list->push_back(static_cast<uint32_t>(vertex));
+    }
+    if (list != &query.targets || query.sources.empty() || query.targets.empty()) {
+        std::cerr << "Укажите вершины в формате: table <u> ... to <v> ....\n";
+        return std::nullopt;
+    }
+    if (query.sources.size() > netproto::kMaxDistanceTableVertices ||
+        query.targets.size() > netproto::kMaxDistanceTableVertices) {
+        std::cerr << "Слишком много вершин в списке (не более " << netproto::kMaxDistanceTableVertices << ").\n";
+        return std::nullopt;
+    }
+    if (query.sources.size() * query.targets.size() > netproto::kMaxDistanceTableCells) {
+        std::cerr << "Слишком большая таблица (не более " << netproto::kMaxDistanceTableCells << " ячеек).\n";
+        return std::nullopt;
+    }
+    if (!state.graphLoaded) {
+        std::cerr << "Сначала загрузите граф (команды input/load).\n";
+        return std::nullopt;
+    }
+    for (const std::vector<uint32_t>* vertices : {&query.sources, &query.targets}) {
+        for (uint32_t vertex : *vertices) {
+            if (vertex >= state.graph.vertexCount) {
+                std::cerr << "Вершины вне диапазона [0, " << state.graph.vertexCount - 1 << "].\n";
+                return std::nullopt;
+            }
+        }
+    }
+    return query;
+}
+
+// Таблица расстояний, собираемая из частей DistanceTableResult. Поля message и malformed имеют
+// тот же смысл, что в BatchResponse.
+struct TableResponse {
+    std::vector<uint32_t> dist;
+    std::vector<bool> received;
+    std::size_t receivedCount = 0;
+    bool malformed = false;
+    std::optional<std::pair<netproto::MessageHeader, std::vector<uint8_t>>> message;
+};
+
+// Обработчик частей ответа на запрос таблицы расстояний: раскладывает расстояния по номерам ячеек
+// и сообщает о завершении, когда получены все ячейки таблицы query.
+ResponseHandler collectTableResponse(const netproto::DistanceTableQueryPayload& query, TableResponse& response) {
+    const std::size_t cellCount = query.sources.size() * query.targets.size();
+    return [&response, &query, cellCount](const netproto::MessageHeader& header, std::vector<uint8_t>& payload) {
+        if (header.command != netproto::Command::DistanceTableResult) {
+            response.message.emplace(header, std::move(payload));
+            return true;
+        }
+        netproto::DistanceTablePayload part;
+        std::string error;
+        if (!netproto::deserializeDistanceTablePart(payload, part, error)) {
+            std::cerr << "Не удалось разобрать таблицу расстояний: " << error << "\n";
+            response.malformed = true;
+            return true;
+        }
+        if (part.sourceCount != query.sources.size() || part.targetCount != query.targets.size()) {
+            std::cerr << "Часть таблицы расстояний не соответствует запросу.\n";
+            response.malformed = true;
+            return true;
+        }
+        if (response.received.empty()) {
+            response.dist.assign(cellCount, netproto::kUnreachableDistance);
+            response.received.assign(cellCount, false);
+        }
+        for (std::size_t i = 0; i < part.dist.size(); ++i) {
+            const std::size_t cell = part.firstCell + i;
+            if (!response.received[cell]) {
+                response.received[cell] = true;
+                response.dist[cell] = part.dist[i];
+                ++response.receivedCount;
+            }
+        }
+        return response.receivedCount == cellCount;
+    };
+}
+
+// Вывод таблицы расстояний: строка на каждую начальную вершину, столбец на каждую конечную
+// ("-" для недостижимых).
+void printTableResponse(const netproto::DistanceTableQueryPayload& query, const TableResponse& response) {
+    if (response.message) {
+        processResponse(response.message->first, response.message->second);
+        return;
+    }
+    if (response.malformed) {
+        return;
+    }
+    std::cout << "от\\до";
+    for (uint32_t target : query.targets) {
+        std::cout << '\t' << target;
+    }
+    std::cout << "\n";
+    for (std::size_t i = 0; i < query.sources.size(); ++i) {
+        std::cout << query.sources[i];
+        for (std::size_t j = 0; j < query.targets.size(); ++j) {
+            const uint32_t distance = response.dist[i * query.targets.size() + j];
+            std::cout << '\t';
+            if (distance == netproto::kUnreachableDistance) {
+                std::cout << '-';
+            } else {
+                std::cout << distance;
+            }
+        }
+        std::cout << "\n";
+    }
+}
+
 // Запуск TCP-клиента: устанавливает соединение с сервером и обрабатывает команды пользователя.
-// Поддерживает команды: help, input, load, query, exit.
+// Поддерживает команды: help, input, load, query, batch, dist, table, exit.
 // Для каждой команды отправляет соответствующий запрос серверу и обрабатывает ответ.
 void runTcpClient(const ClientConfig& config) {
     TcpConnection connection;
@@ -518,28 +1224,32 @@ void runTcpClient(const ClientConfig& config) {
             if (!inputGraphFromConsole(graphDef)) {
                 continue;
             }
-            std::vector<uint8_t> payload = buildUploadPayload(graphDef);
-            netproto::MessageHeader header{netproto::Command::UploadGraph,
-                                           netproto::Status::Ok,
-                                           0,
-                                           static_cast<uint32_t>(payload.size()),
-                                           0};
-            if (!sendTcpMessage(connection.socket, header, payload)) {
+            const netproto::ProtocolVersion version = requiredVersion(graphDef);
+            if (!tcpServerSupports(connection, version)) {
+                std::cerr << "Сервер не поддерживает графы более 65535 вершин или рёбер.\n";
+                continue;
+            }
+            auto uploadPayload = buildUploadPayload(graphDef, version);
+            if (!uploadPayload) {
+                continue;
+            }
+            auto requestId = submitTcpRequest(connection, netproto::Command::UploadEdgeList, *uploadPayload, version);
+            if (!requestId) {
                 std::cerr << "Ошибка при отправке графа.\n";
                 break;
             }
-            netproto::MessageHeader responseHeader;
-            std::vector<uint8_t> responsePayload;
-            if (!readTcpMessage(connection.socket, responseHeader, responsePayload)) {
+            auto response = awaitTcpResponse(connection, *requestId);
+            if (!response) {
                 std::cerr << "Соединение с сервером разорвано.\n";
                 break;
             }
-            if (responseHeader.status == netproto::Status::Ok) {
+            if (response->first.status == netproto::Status::Ok) {
                 state.graph = graphDef;
                 state.graphLoaded = true;
+                state.version = version;
                 std::cout << "Граф успешно загружен на сервер.\n";
             }
-            processResponse(responseHeader, responsePayload);
+            processResponse(response->first, response->second);
         } else if (command == "load") {
             std::string path;
             cmd >> path;
@@ -551,64 +1261,119 @@ void runTcpClient(const ClientConfig& config) {
             if (!loadGraphFromFile(path, graphDef)) {
                 continue;
             }
-            std::vector<uint8_t> payload = buildUploadPayload(graphDef);
-            netproto::MessageHeader header{netproto::Command::UploadGraph,
-                                           netproto::Status::Ok,
-                                           0,
-                                           static_cast<uint32_t>(payload.size()),
-                                           0};
-            if (!sendTcpMessage(connection.socket, header, payload)) {
+            const netproto::ProtocolVersion version = requiredVersion(graphDef);
+            if (!tcpServerSupports(connection, version)) {
+                std::cerr << "Сервер не поддерживает графы более 65535 вершин или рёбер.\n";
+                continue;
+            }
+            auto uploadPayload = buildUploadPayload(graphDef, version);
+            if (!uploadPayload) {
+                continue;
+            }
+            auto requestId = submitTcpRequest(connection, netproto::Command::UploadEdgeList, *uploadPayload, version);
+            if (!requestId) {
                 std::cerr << "Ошибка при отправке графа.\n";
                 break;
             }
-            netproto::MessageHeader responseHeader;
-            std::vector<uint8_t> responsePayload;
-            if (!readTcpMessage(connection.socket, responseHeader, responsePayload)) {
+            auto response = awaitTcpResponse(connection, *requestId);
+            if (!response) {
                 std::cerr << "Соединение с сервером разорвано.\n";
                 break;
             }
-            if (responseHeader.status == netproto::Status::Ok) {
+            if (response->first.status == netproto::Status::Ok) {
                 state.graph = graphDef;
                 state.graphLoaded = true;
+                state.version = version;
                 std::cout << "Граф успешно загружен на сервер.\n";
             }
-            processResponse(responseHeader, responsePayload);
+            processResponse(response->first, response->second);
         } else if (command == "query") {
-            int source = -1;
-            int target = -1;
-            cmd >> source >> target;
-            if (source < 0 || target < 0) {
-                std::cerr << "Укажите вершины в формате: query <u> <v>.\n";
+            auto queries = parseQueryPairs(cmd, state, command);
+            if (!queries) {
                 continue;
             }
-            if (!state.graphLoaded) {
-                std::cerr << "Сначала загрузите граф (команды input/load).\n";
+            // Все запросы отправляются без ожидания ответов, ответы выводятся в порядке запросов.
+            std::vector<uint16_t> requestIds;
+            for (const netproto::PathQueryPayload& query : *queries) {
+                auto requestId = submitTcpRequest(connection, netproto::Command::PathQuery,
+                                                  netproto::serializePathQuery(query, state.version), state.version);
+                if (!requestId) {
+                    break;
+                }
+                requestIds.push_back(*requestId);
+            }
+            if (requestIds.size() < queries->size()) {
+                std::cerr << "Ошибка отправки запроса пути.\n";
+                break;
+            }
+            bool connected = true;
+            for (std::size_t i = 0; i < requestIds.size() && connected; ++i) {
+                auto response = awaitTcpResponse(connection, requestIds[i]);
+                if (!response) {
+                    std::cerr << "Соединение с сервером разорвано.\n";
+                    connected = false;
+                    break;
+                }
+                printQueryLabel(*queries, i);
+                processResponse(response->first, response->second);
+            }
+            if (!connected) {
+                break;
+            }
+        } else if (command == "batch") {
+            auto queries = parseQueryPairs(cmd, state, command);
+            if (!queries) {
                 continue;
             }
-            if (source >= state.graph.vertexCount || target >= state.graph.vertexCount) {
-                std::cerr << "Вершины вне диапазона [0, "
-                          << state.graph.vertexCount - 1 << "].\n";
+            auto requestId = submitTcpRequest(connection, netproto::Command::BatchPathQuery,
+                                              netproto::serializeBatchPathQuery({*queries}, state.version),
+                                              state.version);
+            if (!requestId) {
+                std::cerr << "Ошибка отправки пакетного запроса.\n";
+                break;
+            }
+            BatchResponse response;
+            if (!awaitTcpResponseParts(connection, *requestId, collectBatchResponse(response))) {
+                std::cerr << "Соединение с сервером разорвано.\n";
+                break;
+            }
+            printBatchResponse(*queries, response);
+        } else if (command == "dist") {
+            auto query = parseDistanceQuery(cmd, state);
+            if (!query) {
                 continue;
             }
-            netproto::PathQueryPayload queryPayload{static_cast<uint16_t>(source),
-                                                    static_cast<uint16_t>(target)};
-            std::vector<uint8_t> payload = netproto::serializePathQuery(queryPayload);
-            netproto::MessageHeader header{netproto::Command::PathQuery,
-                                           netproto::Status::Ok,
-                                           0,
-                                           static_cast<uint32_t>(payload.size()),
-                                           0};
-            if (!sendTcpMessage(connection.socket, header, payload)) {
-                std::cerr << "Ошибка отправки запроса пути.\n";
+            auto requestId = submitTcpRequest(connection, netproto::Command::DistanceVector,
+                                              netproto::serializeDistanceVectorQuery(*query, state.version),
+                                              state.version);
+            if (!requestId) {
+                std::cerr << "Ошибка отправки запроса расстояний.\n";
                 break;
             }
-            netproto::MessageHeader responseHeader;
-            std::vector<uint8_t> responsePayload;
-            if (!readTcpMessage(connection.socket, responseHeader, responsePayload)) {
+            DistanceResponse response;
+            if (!awaitTcpResponseParts(connection, *requestId, collectDistanceResponse(response))) {
                 std::cerr << "Соединение с сервером разорвано.\n";
                 break;
             }
-            processResponse(responseHeader, responsePayload);
+            printDistanceResponse(*query, response);
+        } else if (command == "table") {
+            auto query = parseTableQuery(cmd, state);
+            if (!query) {
+                continue;
+            }
+            auto requestId = submitTcpRequest(connection, netproto::Command::DistanceTable,
+                                              netproto::serializeDistanceTableQuery(*query, state.version),
+                                              state.version);
+            if (!requestId) {
+                std::cerr << "Ошибка отправки запроса таблицы расстояний.\n";
+                break;
+            }
+            TableResponse response;
+            if (!awaitTcpResponseParts(connection, *requestId, collectTableResponse(*query, response))) {
+                std::cerr << "Соединение с сервером разорвано.\n";
+                break;
+            }
+            printTableResponse(*query, response);
         } else if (command == "exit") {
             netproto::MessageHeader header{netproto::Command::Exit,
                                            netproto::Status::Ok,
@@ -672,17 +1437,32 @@ void runUdpClient(const ClientConfig& config) {
             if (!inputGraphFromConsole(graphDef)) {
                 continue;
             }
-            std::vector<uint8_t> payload = buildUploadPayload(graphDef);
-            netproto::MessageHeader header{netproto::Command::UploadGraph,
-                                           netproto::Status::Ok,
-                                           nextRequestId(),
-                                           static_cast<uint32_t>(payload.size()),
-                                           0};
+            const netproto::ProtocolVersion version = requiredVersion(graphDef);
+            if (version != netproto::ProtocolVersion::V1) {
+                auto help = sendUdpWithAck(connection,
+                                           makeRequestHeader(netproto::Command::Help, nextRequestId(), 0, version),
+                                           {});
+                if (!help) {
+                    break;
+                }
+                if (!supportsVersion(help->first, version)) {
+                    std::cerr << "Сервер не поддерживает графы более 65535 вершин или рёбер.\n";
+                    continue;
+                }
+            }
+            auto uploadPayload = buildUploadPayload(graphDef, version);
+            if (!uploadPayload) {
+                continue;
+            }
+            const std::vector<uint8_t>& payload = *uploadPayload;
+            const netproto::MessageHeader header =
+                makeRequestHeader(netproto::Command::UploadEdgeList, nextRequestId(), payload.size(), version);
             auto response = sendUdpWithAck(connection, header, payload);
             if (response) {
                 if (response->first.status == netproto::Status::Ok) {
                     state.graph = graphDef;
                     state.graphLoaded = true;
+                    state.version = version;
                     std::cout << "Граф успешно загружен на сервер.\n";
                 }
                 processResponse(response->first, response->second);
@@ -700,17 +1480,32 @@ void runUdpClient(const ClientConfig& config) {
             if (!loadGraphFromFile(path, graphDef)) {
                 continue;
             }
-            std::vector<uint8_t> payload = buildUploadPayload(graphDef);
-            netproto::MessageHeader header{netproto::Command::UploadGraph,
-                                           netproto::Status::Ok,
-                                           nextRequestId(),
-                                           static_cast<uint32_t>(payload.size()),
-                                           0};
+            const netproto::ProtocolVersion version = requiredVersion(graphDef);
+            if (version != netproto::ProtocolVersion::V1) {
+                auto help = sendUdpWithAck(connection,
+                                           makeRequestHeader(netproto::Command::Help, nextRequestId(), 0, version),
+                                           {});
+                if (!help) {
+                    break;
+                }
+                if (!supportsVersion(help->first, version)) {
+                    std::cerr << "Сервер не поддерживает графы более 65535 вершин или рёбер.\n";
+                    continue;
+                }
+            }
+            auto uploadPayload = buildUploadPayload(graphDef, version);
+            if (!uploadPayload) {
+                continue;
+            }
+            const std::vector<uint8_t>& payload = *uploadPayload;
+            const netproto::MessageHeader header =
+                makeRequestHeader(netproto::Command::UploadEdgeList, nextRequestId(), payload.size(), version);
             auto response = sendUdpWithAck(connection, header, payload);
             if (response) {
                 if (response->first.status == netproto::Status::Ok) {
                     state.graph = graphDef;
                     state.graphLoaded = true;
+                    state.version = version;
                     std::cout << "Граф успешно загружен на сервер.\n";
                 }
                 processResponse(response->first, response->second);
@@ -718,36 +1513,65 @@ void runUdpClient(const ClientConfig& config) {
                 break;
             }
         } else if (command == "query") {
-            int source = -1;
-            int target = -1;
-            cmd >> source >> target;
-            if (source < 0 || target < 0) {
-                std::cerr << "Укажите вершины в формате: query <u> <v>.\n";
+            auto queries = parseQueryPairs(cmd, state, command);
+            if (!queries) {
                 continue;
             }
-            if (!state.graphLoaded) {
-                std::cerr << "Сначала загрузите граф (команды input/load).\n";
+            bool connected = true;
+            for (std::size_t i = 0; i < queries->size() && connected; ++i) {
+                std::vector<uint8_t> payload = netproto::serializePathQuery((*queries)[i], state.version);
+                const netproto::MessageHeader header =
+                    makeRequestHeader(netproto::Command::PathQuery, nextRequestId(), payload.size(), state.version);
+                auto response = sendUdpWithAck(connection, header, payload);
+                if (!response) {
+                    connected = false;
+                    break;
+                }
+                printQueryLabel(*queries, i);
+                processResponse(response->first, response->second);
+            }
+            if (!connected) {
+                break;
+            }
+        } else if (command == "batch") {
+            auto queries = parseQueryPairs(cmd, state, command);
+            if (!queries) {
                 continue;
             }
-            if (source >= state.graph.vertexCount || target >= state.graph.vertexCount) {
-                std::cerr << "Вершины вне диапазона [0, "
-                          << state.graph.vertexCount - 1 << "].\n";
+            std::vector<uint8_t> payload = netproto::serializeBatchPathQuery({*queries}, state.version);
+            const netproto::MessageHeader header =
+                makeRequestHeader(netproto::Command::BatchPathQuery, nextRequestId(), payload.size(), state.version);
+            BatchResponse response;
+            if (!exchangeUdp(connection, header, payload, collectBatchResponse(response))) {
+                break;
+            }
+            printBatchResponse(*queries, response);
+        } else if (command == "dist") {
+            auto query = parseDistanceQuery(cmd, state);
+            if (!query) {
                 continue;
             }
-            netproto::PathQueryPayload queryPayload{static_cast<uint16_t>(source),
-                                                    static_cast<uint16_t>(target)};
-            std::vector<uint8_t> payload = netproto::serializePathQuery(queryPayload);
-            netproto::MessageHeader header{netproto::Command::PathQuery,
-                                           netproto::Status::Ok,
-                                           nextRequestId(),
-                                           static_cast<uint32_t>(payload.size()),
-                                           0};
-            auto response = sendUdpWithAck(connection, header, payload);
-            if (response) {
-                processResponse(response->first, response->second);
-            } else {
+            std::vector<uint8_t> payload = netproto::serializeDistanceVectorQuery(*query, state.version);
+            const netproto::MessageHeader header =
+                makeRequestHeader(netproto::Command::DistanceVector, nextRequestId(), payload.size(), state.version);
+            DistanceResponse response;
+            if (!exchangeUdp(connection, header, payload, collectDistanceResponse(response))) {
+                break;
+            }
+            printDistanceResponse(*query, response);
+        } else if (command == "table") {
+            auto query = parseTableQuery(cmd, state);
+            if (!query) {
+                continue;
+            }
+            std::vector<uint8_t> payload = netproto::serializeDistanceTableQuery(*query, state.version);
+            const netproto::MessageHeader header =
+                makeRequestHeader(netproto::Command::DistanceTable, nextRequestId(), payload.size(), state.version);
+            TableResponse response;
+            if (!exchangeUdp(connection, header, payload, collectTableResponse(*query, response))) {
                 break;
             }
+            printTableResponse(*query, response);
         } else if (command == "exit") {
             netproto::MessageHeader header{netproto::Command::Exit,
                                            netproto::Status::Ok,
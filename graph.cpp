@@ -1,73 +1,146 @@
 #include "graph.hpp"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 #include <algorithm>
+#include <cstddef>
 #include <limits>
+#include <queue>
+#include <utility>
 #include <unordered_map>
+#include <variant>
 
 namespace graph {
 
 namespace {
 
 // Значение бесконечности для алгоритма кратчайшего пути (используется для недостижимых вершин).
-constexpr uint32_t kInfinity = std::numeric_limits<uint32_t>::max() / 4; // делим на 4 для избежания переполнения при сложении в алгоритме Беллмана-Форда
+constexpr uint32_t kInfinity = kUnreachable; // max / 4 для избежания переполнения при сложении в алгоритме Беллмана-Форда
 
 // Внутренняя структура для представления ребра графа.
 struct EdgeData {
-    uint16_t u;      // Начальная вершина
-    uint16_t v;      // Конечная вершина
+    VertexId u;      // Начальная вершина
+    VertexId v;      // Конечная вершина
     uint32_t weight; // Вес ребра
 };
 
-// Сборка списка рёбер из матрицы инцидентности: преобразует матрицу в список рёбер (u, v, weight).
-// Для каждого столбца матрицы находит инцидентные вершины и создаёт соответствующее ребро.
-// Поддерживает петли
-// В случае ошибки записывает описание в параметр message и возвращает пустой список.
-std::vector<EdgeData> collectEdges(const GraphDefinition& definition, std::string& message) {
-    std::vector<EdgeData> edges;
-    edges.reserve(definition.edgeCount);
+// Обозначение отсутствующего предшественника в массиве parent с номерами вершин типа Index
+// (номера вершин меньше максимума типа: 16-битные номера используются только для графов
+// не более чем из kCompactIndexLimit вершин).
+template <typename Index>
+constexpr Index kNoVertex = std::numeric_limits<Index>::max();
 
-    for (uint16_t e = 0; e < definition.edgeCount; ++e) {
-        std::vector<uint16_t> endpoints;
-        endpoints.reserve(2);
-        for (uint16_t v = 0; v < definition.vertexCount; ++v) {
-            if (definition.incidence[v][e] == 1) {
-                endpoints.push_back(v);
-            }
+// Результат просмотра столбца матрицы инцидентности: количество концов ребра (установленных битов;
+// просмотр прекращается на третьем) и номера первых двух из них.
+struct ColumnEndpoints {
+    uint32_t count = 0;
+    VertexId first = 0;
+    VertexId second = 0;
+};
+
+// Учёт ненулевого слова w столбца: количество концов увеличивается на popcount слова, номера
+// концов берутся командой подсчёта младших нулей. Возвращает false, если концов уже больше двух.
+inline bool takeColumnWord(uint64_t bits, std::size_t w, ColumnEndpoints& endpoints) {
+    const uint32_t seen = endpoints.count;
+    endpoints.count += static_cast<uint32_t>(__builtin_popcountll(bits));
+    if (endpoints.count > 2) {
+        return false;
+    }
+    const VertexId lowest = static_cast<VertexId>(w * 64 + __builtin_ctzll(bits));
+    if (seen == 1) {
+        endpoints.second = lowest;
+        return true;
+    }
+    endpoints.first = lowest;
+    bits &= bits - 1;
+    if (bits != 0) {
+        endpoints.second = static_cast<VertexId>(w * 64 + __builtin_ctzll(bits));
+    }
+    return true;
+}
+
+// Переносимое ядро просмотра столбца: слово за словом.
+ColumnEndpoints scanColumnScalar(const uint64_t* column, std::size_t words) {
+    ColumnEndpoints endpoints;
+    for (std::size_t w = 0; w < words; ++w) {
+        if (column[w] != 0 && !takeColumnWord(column[w], w, endpoints)) {
+            break;
         }
+    }
+    return endpoints;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
 
-        if (endpoints.empty()) {
-            message = "Найден столбец матрицы без инцидентных вершин.";
-            edges.clear();
-            return edges;
+// Ядро AVX2: столбец проверяется блоками по 4 слова (256 вершин), нулевые блоки пропускаются
+// одной командой vptest. В столбце корректного графа ровно два бита, поэтому почти все блоки нулевые.
+__attribute__((target("avx2"))) ColumnEndpoints scanColumnAvx2(const uint64_t* column, std::size_t words) {
+    ColumnEndpoints endpoints;
+    std::size_t w = 0;
+    for (; w + 4 <= words; w += 4) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + w));
+        if (_mm256_testz_si256(block, block)) {
+            continue;
         }
-        if (endpoints.size() > 2) {
-            message = "Ребро соединяет более двух вершин.";
-            edges.clear();
-            return edges;
+        for (std::size_t i = w; i < w + 4; ++i) {
+            if (column[i] != 0 && !takeColumnWord(column[i], i, endpoints)) {
+                return endpoints;
+            }
         }
-
-        const uint32_t weight = definition.weights[e];
-        if (weight == kInfinity) {
-            message = "Вес ребра превышает допустимый диапазон.";
-            edges.clear();
-            return edges;
+    }
+    for (; w < words; ++w) {
+        if (column[w] != 0 && !takeColumnWord(column[w], w, endpoints)) {
+            break;
         }
+    }
+    return endpoints;
+}
 
-        if (endpoints.size() == 1) {
-            edges.push_back({endpoints[0], endpoints[0], weight});
-        } else {
-            edges.push_back({endpoints[0], endpoints[1], weight});
+// Ядро AVX-512: блоки по 8 слов (512 вершин); маска ненулевых слов блока даёт vptestmq,
+// хвост столбца загружается маскированно.
+__attribute__((target("avx512f"))) ColumnEndpoints scanColumnAvx512(const uint64_t* column, std::size_t words) {
+    ColumnEndpoints endpoints;
+    for (std::size_t w = 0; w < words; w += 8) {
+        const std::size_t left = std::min<std::size_t>(8, words - w);
+        const __mmask8 lanes = static_cast<__mmask8>((1u << left) - 1);
+        const __m512i block = _mm512_maskz_loadu_epi64(lanes, column + w);
+        for (unsigned mask = _mm512_test_epi64_mask(block, block); mask != 0; mask &= mask - 1) {
+            const std::size_t i = w + static_cast<std::size_t>(__builtin_ctz(mask));
+            if (!takeColumnWord(column[i], i, endpoints)) {
+                return endpoints;
+            }
         }
     }
-    return edges;
+    return endpoints;
 }
 
-}  // namespace
+#endif
 
-// Валидация графа: проверяет соответствие графа всем требованиям.
-// соответствие размеров матрицы, корректность матрицы инцидентности, неотрицательность весов.
-// Возвращает ValidationResult с результатом проверки.
-ValidationResult validateGraph(const GraphDefinition& graph) {
+using ColumnScanner = ColumnEndpoints (*)(const uint64_t*, std::size_t);
+
+// Выбор ядра просмотра столбцов по возможностям процессора (один раз за время работы процесса).
+ColumnScanner columnScanner() {
+    static const ColumnScanner scanner = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return &scanColumnAvx512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return &scanColumnAvx2;
+        }
+#endif
+        return &scanColumnScalar;
+    }();
+    return scanner;
+}
+
+// Проверка графа с извлечением концов рёбер за один проход по столбцам матрицы инцидентности.
+// Если edges не nullptr, в него записываются рёбра (u, v, weight), пригодные для построения CSR.
+// Порядок проверок и сообщения об ошибках совпадают с validateGraph.
+ValidationResult inspectGraph(const GraphDefinition& graph, std::vector<EdgeData>* edges) {
     ValidationResult result;
 
     for (uint32_t weight : graph.weights) {
@@ -77,94 +150,813 @@ ValidationResult validateGraph(const GraphDefinition& graph) {
         }
     }
 
-    std::string message;
-    for (uint16_t e = 0; e < graph.edgeCount; ++e) {
-        uint16_t ones = 0;
-        for (uint16_t v = 0; v < graph.vertexCount; ++v) {
-            const int value = graph.incidence[v][e];
-            if (value != 0 && value != 1) {
-                message = "Матрица инцидентности должна содержать только 0 или 1.";
-                result.message = message;
+    if (graph.incidence.vertexCount() != graph.vertexCount || graph.incidence.edgeCount() != graph.edgeCount ||
+        graph.weights.size() != graph.edgeCount) {
+        result.message = "Размер матрицы инцидентности не соответствует графу.";
+        return result;
+    }
+
+    if (edges != nullptr) {
+        edges->assign(graph.edgeCount, EdgeData{0, 0, 0});
+    }
+    const ColumnScanner scan = columnScanner();
+    const std::size_t words = graph.incidence.wordsPerColumn();
+    for (uint32_t e = 0; e < graph.edgeCount; ++e) {
+        const ColumnEndpoints endpoints = scan(graph.incidence.column(e), words);
+        if (endpoints.count < 2) {
+            result.message = "Каждое ребро должно быть инцидентно двум вершинам.";
+            return result;
+        }
+        if (endpoints.count > 2) {
+            result.message = "Ребро не может соединять более двух вершин.";
+            return result;
+        }
+        if (edges != nullptr) {
+            (*edges)[e] = EdgeData{endpoints.first, endpoints.second, graph.weights[e]};
+        }
+    }
+
+    if (edges != nullptr) {
+        for (uint32_t weight : graph.weights) {
+            if (weight == kInfinity) {
+                result.message = "Вес ребра превышает допустимый диапазон.";
+                edges->clear();
                 return result;
             }
-            if (value == 1) {
-                ++ones;
+        }
+    }
+
+    result.ok = true;
+    return result;
+}
+
+// Восстановление пути по массиву предшественников: проходит от target к source и разворачивает маршрут.
+// Возвращает false, если цепочка предшественников не приводит к source.
+template <typename Index>
+bool restorePath(const std::vector<Index>& parent,
+                 VertexId source,
+                 VertexId target,
+                 std::vector<VertexId>& path) {
+    path.clear();
+    for (VertexId v = target; v != kNoVertex<Index>; v = parent[v]) {
+        path.push_back(v);
+        if (v == source || path.size() > parent.size()) {
+            break;
+        }
+    }
+    std::reverse(path.begin(), path.end());
+    return !path.empty() && path.front() == source;
+}
+
+// Индексированная 4-арная куча с минимумом в корне: хранит пары (расстояние, вершина)
+// и позицию каждой вершины в куче, что позволяет уменьшать ключ без дубликатов.
+// Четыре потомка на узел уменьшают высоту кучи и число промахов кэша при просеивании.
+template <typename Index>
+class IndexedQuaternaryHeap {
+public:
+    explicit IndexedQuaternaryHeap(uint32_t vertexCount) : position_(vertexCount, kAbsent) {}
+
+    bool empty() const { return heap_.empty(); }
+
+    // Очистка кучи для повторного использования на графе из vertexCount вершин.
+    void reset(uint32_t vertexCount) {
+        for (const Entry& entry : heap_) {
+            position_[entry.vertex] = kAbsent;
+        }
+        heap_.clear();
+        if (position_.size() != vertexCount) {
+            position_.assign(vertexCount, kAbsent);
+        }
+    }
+
+    // Минимальный ключ в куче (куча не должна быть пустой).
+    uint32_t topKey() const { return heap_.front().key; }
+
+    // Добавление вершины или уменьшение её ключа, если она уже находится в куче.
+    void pushOrDecrease(Index vertex, uint32_t key) {
+        uint32_t index = position_[vertex];
+        if (index == kAbsent) {
+            index = static_cast<uint32_t>(heap_.size());
+            heap_.push_back({key, vertex});
+        } else {
+            heap_[index].key = key;
+        }
+        siftUp(index);
+    }
+
+    // Извлечение вершины с минимальным ключом.
+    Index popMin() {
+        const Index top = heap_.front().vertex;
+        position_[top] = kAbsent;
+        const Entry last = heap_.back();
+        heap_.pop_back();
+        if (!heap_.empty()) {
+            heap_.front() = last;
+            position_[last.vertex] = 0;
+            siftDown(0);
+        }
+        return top;
+    }
+
+private:
+    static constexpr uint32_t kArity = 4;
+    static constexpr uint32_t kAbsent = std::numeric_limits<uint32_t>::max();
+
+    struct Entry {
+        uint32_t key;
+        Index vertex;
+    };
+
+    void siftUp(uint32_t index) {
+        const Entry entry = heap_[index];
+        while (index > 0) {
+            const uint32_t parentIndex = (index - 1) / kArity;
+            if (heap_[parentIndex].key <= entry.key) {
+                break;
             }
+            heap_[index] = heap_[parentIndex];
+            position_[heap_[index].vertex] = index;
+            index = parentIndex;
         }
-        if (ones < 2) {
-            message = "Каждое ребро должно быть инцидентно двум вершинам.";
-            result.message = message;
-            return result;
+        heap_[index] = entry;
+        position_[entry.vertex] = index;
+    }
+
+    void siftDown(uint32_t index) {
+        const Entry entry = heap_[index];
+        const uint32_t size = static_cast<uint32_t>(heap_.size());
+        while (true) {
+            const uint32_t firstChild = index * kArity + 1;
+            if (firstChild >= size) {
+                break;
+            }
+            const uint32_t lastChild = std::min(firstChild + kArity, size);
+            uint32_t best = firstChild;
+            for (uint32_t child = firstChild + 1; child < lastChild; ++child) {
+                if (heap_[child].key < heap_[best].key) {
+                    best = child;
+                }
+            }
+            if (heap_[best].key >= entry.key) {
+                break;
+            }
+            heap_[index] = heap_[best];
+            position_[heap_[index].vertex] = index;
+            index = best;
         }
-        if (ones > 2) {
-            message = "Ребро не может соединять более двух вершин.";
-            result.message = message;
-            return result;
+        heap_[index] = entry;
+        position_[entry.vertex] = index;
+    }
+
+    std::vector<Entry> heap_;         // Элементы кучи
+    std::vector<uint32_t> position_;  // Позиция вершины в куче (kAbsent, если вершины в куче нет)
+};
+
+// Поразрядная (radix) куча для монотонной очереди с приоритетом: извлекаемые ключи не убывают.
+// Элемент с ключом key лежит в корзине с номером старшего бита, в котором key отличается
+// от последнего извлечённого ключа. При опустошении корзины 0 ближайшая непустая корзина
+// перераспределяется относительно своего минимума. Устаревшие элементы не удаляются,
+// а пропускаются при извлечении (ленивое удаление).
+template <typename Index>
+class RadixHeap {
+public:
+    bool empty() const { return size_ == 0; }
+
+    void push(uint32_t key, Index vertex) {
+        buckets_[bucketIndex(key)].push_back({key, vertex});
+        ++size_;
+    }
+
+    // Извлечение элемента с минимальным ключом; key получает значение ключа.
+    Index pop(uint32_t& key) {
+        if (buckets_[0].empty()) {
+            std::size_t index = 1;
+            while (buckets_[index].empty()) {
+                ++index;
+            }
+            std::vector<Entry>& source = buckets_[index];
+            uint32_t minimum = source.front().key;
+            for (const Entry& entry : source) {
+                minimum = std::min(minimum, entry.key);
+            }
+            last_ = minimum;
+            for (const Entry& entry : source) {
+                buckets_[bucketIndex(entry.key)].push_back(entry);
+            }
+            source.clear();
         }
+        const Entry top = buckets_[0].back();
+        buckets_[0].pop_back();
+        --size_;
+        key = top.key;
+        return top.vertex;
     }
 
-    result.ok = true;
+private:
+    static constexpr std::size_t kBucketCount = 33;
+
+    struct Entry {
+        uint32_t key;
+        Index vertex;
+    };
+
+    std::size_t bucketIndex(uint32_t key) const {
+        const uint32_t diff = key ^ last_;
+        return diff == 0 ? 0 : static_cast<std::size_t>(32 - __builtin_clz(diff));
+    }
+
+    std::vector<Entry> buckets_[kBucketCount];  // Корзины по старшему отличающемуся биту
+    uint32_t last_ = 0;                         // Последний извлечённый ключ
+    std::size_t size_ = 0;                      // Количество элементов (включая устаревшие)
+};
+
+// Результат поиска для недостижимой вершины target.
+PathComputation unreachablePath() {
+    PathComputation result;
+    result.reachable = false;
+    result.distance = kInfinity;
+    result.error = "Путь между вершинами не найден.";
     return result;
 }
 
-// Алгоритм Беллмана-Форда для поиска кратчайшего пути в неориентированном графе.
-// Выполняет V-1 итераций релаксации всех рёбер для нахождения кратчайших расстояний от source.
-// Для неориентированного графа релаксация выполняется в обе стороны каждого ребра.
-// После вычисления расстояний восстанавливает путь по массиву предшественников.
-// Возвращает PathComputation с информацией о пути от source до target.
-PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint16_t target) {
+// Диапазон номеров [first, first + size) компоненты связности: поиск из вершины компоненты
+// выделяет массивы размера size и хранит в них вершину v под локальным номером v - first.
+struct ComponentRange {
+    uint32_t first = 0;
+    uint32_t size = 0;
+
+    bool contains(VertexId v) const { return v >= first && v - first < size; }
+};
+
+template <typename Index>
+ComponentRange componentRange(const AdjacencyList<Index>& adjacency, VertexId v) {
+    const Index c = adjacency.component[v];
+    return {adjacency.componentStart[c], adjacency.componentStart[c + 1] - adjacency.componentStart[c]};
+}
+
+// Формирование результата поиска по массивам расстояний и предшественников в локальной нумерации
+// диапазона, начинающегося с вершины first (предшественники тоже локальные).
+// Общая часть для всех алгоритмов поиска кратчайшего пути.
+template <typename Index>
+PathComputation makePathResult(const std::vector<uint32_t>& dist,
+                               const std::vector<Index>& parent,
+                               VertexId first,
+                               VertexId source,
+                               VertexId target) {
     PathComputation result;
+    if (target < first || target - first >= dist.size() || dist[target - first] == kInfinity) {
+        return unreachablePath();
+    }
 
-    if (graph.vertexCount == 0) {
-        result.error = "Граф не инициализирован.";
+    std::vector<VertexId> path;
+    if (!restorePath(parent, source - first, target - first, path)) {
+        result.error = "Не удалось восстановить путь.";
         return result;
     }
-    if (source >= graph.vertexCount || target >= graph.vertexCount) {
-        result.error = "Вершины выходят за границы графа.";
-        return result;
+    for (VertexId& v : path) {
+        v += first;
     }
 
-    ValidationResult validation = validateGraph(graph);
-    if (!validation.ok) {
-        result.error = validation.message;
-        return result;
+    result.reachable = true;
+    result.distance = dist[target - first];
+    result.path = std::move(path);
+    return result;
+}
+
+// Максимальное число вершин, просматриваемых одним поиском свидетеля при сжатии вершины.
+// При превышении лимита шорткат добавляется без доказательства его необходимости (это безопасно).
+constexpr std::size_t kWitnessSettleLimit = 128;
+
+// Лимит поиска свидетеля при оценке приоритета вершины (симуляции сжатия): оценка может быть
+// приблизительной, поэтому поиск делается заметно короче.
+constexpr std::size_t kSimulationSettleLimit = 32;
+
+// Бюджет шорткатов иерархии сжатия относительно числа рёбер исходного графа.
+constexpr std::size_t kShortcutBudgetFactor = 2;
+
+// Максимальная степень сжимаемой вершины. Если даже у лучшего кандидата степень больше,
+// оставшееся ядро графа слишком плотное и иерархия не даст выигрыша - построение прерывается.
+constexpr std::size_t kMaxContractionDegree = 128;
+
+// Ребро динамического графа, используемого при построении иерархии сжатия.
+template <typename Index>
+struct ContractionArc {
+    Index to;         // Соседняя вершина
+    uint32_t weight;  // Вес ребра (или шортката)
+    Index middle;     // Промежуточная вершина шортката (kNoVertex для исходного ребра)
+};
+
+// Вспомогательное состояние построения иерархии сжатия: динамические списки смежности
+// ещё не сжатых вершин и переиспользуемые массивы поиска свидетелей.
+template <typename Index>
+struct ContractionState {
+    std::vector<std::vector<ContractionArc<Index>>> arcs;  // Рёбра между ещё не сжатыми вершинами
+    std::vector<uint8_t> contracted;                       // Признак сжатой вершины
+    std::vector<uint32_t> witnessDist;                     // Расстояния поиска свидетеля
+    std::vector<Index> touched;                            // Вершины, расстояния которых нужно сбросить
+};
+
+// Добавление или укорочение ребра u - w в динамическом графе.
+template <typename Index>
+void upsertArc(ContractionState<Index>& state, Index u, Index w, uint32_t weight, Index middle) {
+    for (ContractionArc<Index>& arc : state.arcs[u]) {
+        if (arc.to == w) {
+            if (weight < arc.weight) {
+                arc.weight = weight;
+                arc.middle = middle;
+            }
+            return;
+        }
+    }
+    state.arcs[u].push_back({w, weight, middle});
+}
+
+// Поиск свидетеля: ограниченный алгоритм Дейкстры от from, не проходящий через вершину excluded.
+// Останавливается по достижении maxDist или после settleLimit извлечённых вершин.
+// Расстояния остаются в state.witnessDist до вызова resetWitnessSearch.
+template <typename Index>
+void witnessSearch(ContractionState<Index>& state,
+                   Index from,
+                   Index excluded,
+                   uint32_t maxDist,
+                   std::size_t settleLimit) {
+    using QueueEntry = std::pair<uint32_t, Index>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    state.witnessDist[from] = 0;
+    state.touched.push_back(from);
+    queue.push({0, from});
+    std::size_t settled = 0;
+    while (!queue.empty() && settled < settleLimit) {
+        const auto [du, u] = queue.top();
+        queue.pop();
+        if (du != state.witnessDist[u]) {
+            continue;
+        }
+        if (du > maxDist) {
+            break;
+        }
+        ++settled;
+        for (const ContractionArc<Index>& arc : state.arcs[u]) {
+            if (arc.to == excluded) {
+                continue;
+            }
+            const uint32_t candidate = du + arc.weight;
+            if (candidate < state.witnessDist[arc.to]) {
+                if (state.witnessDist[arc.to] == kInfinity) {
+                    state.touched.push_back(arc.to);
+                }
+                state.witnessDist[arc.to] = candidate;
+                queue.push({candidate, arc.to});
+            }
+        }
+    }
+}
+
+// Сброс расстояний, изменённых поиском свидетеля.
+template <typename Index>
+void resetWitnessSearch(ContractionState<Index>& state) {
+    for (Index v : state.touched) {
+        state.witnessDist[v] = kInfinity;
+    }
+    state.touched.clear();
+}
+
+// Сжатие (или его симуляция) вершины v: для каждой пары соседей u, w проверяет,
+// существует ли путь u -> w в обход v не длиннее u - v - w. Если нет, нужен шорткат.
+// При apply = true шорткаты добавляются в граф. Возвращает количество требуемых шорткатов.
+template <typename Index>
+std::size_t contractVertex(ContractionState<Index>& state, Index v, bool apply) {
+    const std::vector<ContractionArc<Index>> neighbors = state.arcs[v];
+    uint32_t maxWeight = 0;
+    for (const ContractionArc<Index>& arc : neighbors) {
+        maxWeight = std::max(maxWeight, arc.weight);
+    }
+
+    std::size_t shortcuts = 0;
+    for (std::size_t i = 0; i < neighbors.size(); ++i) {
+        const Index u = neighbors[i].to;
+        witnessSearch(state,
+                      u,
+                      v,
+                      neighbors[i].weight + maxWeight,
+                      apply ? kWitnessSettleLimit : kSimulationSettleLimit);
+        for (std::size_t j = i + 1; j < neighbors.size(); ++j) {
+            const Index w = neighbors[j].to;
+            const uint32_t viaWeight = neighbors[i].weight + neighbors[j].weight;
+            if (state.witnessDist[w] <= viaWeight) {
+                continue;
+            }
+            ++shortcuts;
+            if (apply) {
+                upsertArc(state, u, w, viaWeight, v);
+                upsertArc(state, w, u, viaWeight, v);
+            }
+        }
+        resetWitnessSearch(state);
+    }
+    return shortcuts;
+}
+
+}  // namespace
+
+// Валидация графа: проверяет соответствие графа всем требованиям.
+// соответствие размеров матрицы, корректность матрицы инцидентности, неотрицательность весов.
+// Количество концов ребра - число установленных битов столбца; столбцы просматриваются
+// векторным ядром, выбранным по возможностям процессора.
+// Возвращает ValidationResult с результатом проверки.
+ValidationResult validateGraph(const GraphDefinition& graph) {
+    return inspectGraph(graph, nullptr);
+}
+
+// Преобразование графа в список рёбер: проверяет граф и извлекает концы каждого ребра
+// из матрицы инцидентности в одном проходе. При ошибке возвращает пустой список, описание - в status.
+std::vector<Edge> buildEdgeList(const GraphDefinition& graph, ValidationResult& status) {
+    std::vector<EdgeData> collected;
+    status = inspectGraph(graph, &collected);
+    if (!status.ok) {
+        return {};
+    }
+    std::vector<Edge> edges;
+    edges.reserve(collected.size());
+    for (const auto& edge : collected) {
+        edges.emplace_back(edge.u, edge.v, edge.weight);
+    }
+    return edges;
+}
+
+namespace {
+
+// Группировка вершин по компонентам связности. Компоненты находятся системой непересекающихся
+// множеств (объединение по размеру, сокращение путей делением пополам) и нумеруются подряд
+// в порядке наименьших вершин. Вершины перенумеровываются так, что каждая компонента занимает
+// непрерывный диапазон номеров, а внутри компоненты порядок вершин сохраняется; концы рёбер
+// переписываются в новую нумерацию. Записывает начала компонент в componentStart и возвращает
+// новый номер каждой вершины (пустой список, если нумерация не изменилась).
+std::vector<VertexId> groupComponents(uint32_t vertexCount,
+                                      std::vector<EdgeData>& edges,
+                                      std::vector<uint32_t>& componentStart) {
+    std::vector<uint32_t> parent(vertexCount);
+    std::vector<uint32_t> size(vertexCount, 1);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        parent[v] = v;
+    }
+    auto find = [&parent](uint32_t v) {
+        while (parent[v] != v) {
+            parent[v] = parent[parent[v]];
+            v = parent[v];
+        }
+        return v;
+    };
+    for (const auto& edge : edges) {
+        uint32_t a = find(edge.u);
+        uint32_t b = find(edge.v);
+        if (a == b) {
+            continue;
+        }
+        if (size[a] < size[b]) {
+            std::swap(a, b);
+        }
+        parent[b] = a;
+        size[a] += size[b];
+    }
+
+    // Номер компоненты по корню множества; size переиспользуется для номеров компонент вершин.
+    std::vector<uint32_t> label(vertexCount, kNoVertex<uint32_t>);
+    componentStart.assign(1, 0);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        const uint32_t root = find(v);
+        if (label[root] == kNoVertex<uint32_t>) {
+            label[root] = static_cast<uint32_t>(componentStart.size() - 1);
+            componentStart.push_back(0);
+        }
+        size[v] = label[root];
+        ++componentStart[size[v] + 1];
+    }
+    for (std::size_t c = 1; c < componentStart.size(); ++c) {
+        componentStart[c] += componentStart[c - 1];
+    }
+
+    std::vector<VertexId> order(vertexCount);
+    std::vector<uint32_t> cursor(componentStart.begin(), componentStart.end() - 1);
+    bool unchanged = true;
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        order[v] = cursor[size[v]]++;
+        unchanged = unchanged && order[v] == v;
+    }
+    if (unchanged) {
+        return {};
+    }
+    for (auto& edge : edges) {
+        edge.u = order[edge.u];
+        edge.v = order[edge.v];
+    }
+    return order;
+}
+
+// Раскладка списка рёбер в CSR: подсчитывает степени вершин и раскладывает соседей
+// в сплошные массивы. Каждое ребро добавляется в списки обоих концов (петля - один раз).
+// Затем размечает компоненты связности по их диапазонам номеров (вершины уже сгруппированы).
+template <typename Index>
+void fillAdjacency(uint32_t vertexCount,
+                   uint32_t edgeCount,
+                   const std::vector<EdgeData>& edges,
+                   std::vector<uint32_t> componentStart,
+                   AdjacencyList<Index>& adjacency) {
+    const uint32_t n = vertexCount;
+    adjacency.vertexCount = n;
+    adjacency.edgeCount = edgeCount;
+    adjacency.offsets.assign(static_cast<std::size_t>(n) + 1, 0);
+
+    for (const auto& edge : edges) {
+        ++adjacency.offsets[edge.u + 1];
+        if (edge.u != edge.v) {
+            ++adjacency.offsets[edge.v + 1];
+        }
+    }
+    for (uint32_t v = 0; v < n; ++v) {
+        adjacency.offsets[v + 1] += adjacency.offsets[v];
     }
 
-    std::string edgeError;
-    std::vector<EdgeData> edges = collectEdges(graph, edgeError);
-    if (!edgeError.empty()) {
-        result.error = edgeError;
+    adjacency.maxWeight = 0;
+    for (const auto& edge : edges) {
+        adjacency.maxWeight = std::max(adjacency.maxWeight, edge.weight);
+    }
+
+    adjacency.neighbors.assign(adjacency.offsets[n], 0);
+    adjacency.weights.assign(adjacency.offsets[n], 0);
+    std::vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (const auto& edge : edges) {
+        uint32_t slot = cursor[edge.u]++;
+        adjacency.neighbors[slot] = static_cast<Index>(edge.v);
+        adjacency.weights[slot] = edge.weight;
+        if (edge.u != edge.v) {
+            slot = cursor[edge.v]++;
+            adjacency.neighbors[slot] = static_cast<Index>(edge.u);
+            adjacency.weights[slot] = edge.weight;
+        }
+    }
+    adjacency.componentCount = static_cast<uint32_t>(componentStart.size() - 1);
+    adjacency.component.resize(n);
+    for (uint32_t c = 0; c < adjacency.componentCount; ++c) {
+        std::fill(adjacency.component.begin() + componentStart[c], adjacency.component.begin() + componentStart[c + 1],
+                  static_cast<Index>(c));
+    }
+    adjacency.componentStart = std::move(componentStart);
+}
+
+// Сжатие нумерации вершин: вершины, инцидентные хотя бы одному ребру, получают подряд идущие
+// внутренние номера в порядке внешних, концы рёбер переписываются во внутреннюю нумерацию.
+// Если объявленных вершин не больше, чем концов рёбер, номера размечаются массивом по всем вершинам;
+// иначе концы рёбер сортируются, чтобы память не зависела от объявленного количества вершин
+// (граф на миллиарды вершин с немногими рёбрами). Возвращает внешние номера внутренних вершин;
+// если изолированных вершин нет (или нет рёбер), нумерация не меняется и возвращается пустой список.
+std::vector<VertexId> compactVertices(VertexId vertexCount, std::vector<EdgeData>& edges) {
+    std::vector<VertexId> externalIds;
+    if (vertexCount <= 2 * edges.size()) {
+        std::vector<VertexId> internalId(vertexCount, kIsolatedVertex);
+        for (const auto& edge : edges) {
+            internalId[edge.u] = 0;
+            internalId[edge.v] = 0;
+        }
+        for (uint32_t v = 0; v < vertexCount; ++v) {
+            if (internalId[v] != kIsolatedVertex) {
+                internalId[v] = static_cast<VertexId>(externalIds.size());
+                externalIds.push_back(v);
+            }
+        }
+        if (externalIds.size() == vertexCount || externalIds.empty()) {
+            return {};
+        }
+        for (auto& edge : edges) {
+            edge.u = internalId[edge.u];
+            edge.v = internalId[edge.v];
+        }
+        return externalIds;
+    }
+
+    externalIds.reserve(2 * edges.size());
+    for (const auto& edge : edges) {
+        externalIds.push_back(edge.u);
+        externalIds.push_back(edge.v);
+    }
+    std::sort(externalIds.begin(), externalIds.end());
+    externalIds.erase(std::unique(externalIds.begin(), externalIds.end()), externalIds.end());
+    if (externalIds.empty()) {
+        return {};
+    }
+    auto internal = [&externalIds](VertexId v) {
+        return static_cast<VertexId>(std::lower_bound(externalIds.begin(), externalIds.end(), v) -
+                                     externalIds.begin());
+    };
+    for (auto& edge : edges) {
+        edge.u = internal(edge.u);
+        edge.v = internal(edge.v);
+    }
+    return externalIds;
+}
+
+// Соответствие внешних и внутренних номеров вершин (поля PreparedGraph с теми же именами).
+struct VertexNumbering {
+    std::vector<VertexId> sortedIds;
+    std::vector<VertexId> internalIds;
+    std::vector<VertexId> externalIds;
+};
+
+// Раскладка рёбер в CSR после сжатия нумерации вершин и группировки вершин по компонентам
+// связности. Разрядность номеров списков смежности выбирается по количеству вершин с рёбрами.
+void fillCompactAdjacency(VertexId vertexCount,
+                          std::vector<EdgeData>& edges,
+                          PreparedGraph::Adjacency& adjacency,
+                          VertexNumbering& numbering) {
+    numbering.sortedIds = compactVertices(vertexCount, edges);
+    const uint32_t n =
+        numbering.sortedIds.empty() ? vertexCount : static_cast<uint32_t>(numbering.sortedIds.size());
+    std::vector<uint32_t> componentStart;
+    numbering.internalIds = groupComponents(n, edges, componentStart);
+    numbering.externalIds.clear();
+    if (!numbering.internalIds.empty()) {
+        numbering.externalIds.resize(n);
+        for (uint32_t v = 0; v < n; ++v) {
+            numbering.externalIds[numbering.internalIds[v]] =
+                numbering.sortedIds.empty() ? v : numbering.sortedIds[v];
+        }
+    }
+    const uint32_t edgeCount = static_cast<uint32_t>(edges.size());
+    if (n <= kCompactIndexLimit) {
+        fillAdjacency(n, edgeCount, edges, std::move(componentStart), adjacency.emplace<AdjacencyList<uint16_t>>());
+    } else {
+        fillAdjacency(n, edgeCount, edges, std::move(componentStart), adjacency.emplace<AdjacencyList<uint32_t>>());
+    }
+}
+
+// Построение списков смежности (CSR) из матрицы инцидентности: концы рёбер, найденные
+// при проверке столбцов, сразу раскладываются в CSR без повторного просмотра матрицы.
+bool buildAdjacencyList(const GraphDefinition& graph,
+                        PreparedGraph::Adjacency& adjacency,
+                        VertexNumbering& numbering,
+                        std::string& error) {
+    std::vector<EdgeData> edges;
+    ValidationResult status = inspectGraph(graph, &edges);
+    if (!status.ok) {
+        error = status.message;
+        return false;
+    }
+    fillCompactAdjacency(graph.vertexCount, edges, adjacency, numbering);
+    return true;
+}
+
+// Построение списков смежности (CSR) из списка рёбер с проверкой каждого ребра
+// (номера вершин, отсутствие петель, допустимость весов).
+bool buildAdjacencyList(VertexId vertexCount,
+                        const std::vector<Edge>& edges,
+                        PreparedGraph::Adjacency& adjacency,
+                        VertexNumbering& numbering,
+                        std::string& error) {
+    if (vertexCount == 0 || edges.empty()) {
+        error = "Пустой граф.";
+        return false;
+    }
+    std::vector<EdgeData> collected;
+    collected.reserve(edges.size());
+    for (const auto& [u, v, weight] : edges) {
+        if (u >= vertexCount || v >= vertexCount) {
+            error = "Ребро ссылается на несуществующую вершину.";
+            return false;
+        }
+        if (u == v) {
+            error = "Каждое ребро должно быть инцидентно двум вершинам.";
+            return false;
+        }
+        if (weight >= kInfinity) {
+            error = "Вес ребра либо < 0, либо слишком велик.";
+            return false;
+        }
+        collected.push_back({u, v, weight});
+    }
+    fillCompactAdjacency(vertexCount, collected, adjacency, numbering);
+    return true;
+}
+
+// Выбор алгоритма по диапазону весов и размеру графа: при малых весах корзинные очереди
+// (Дайал, radix-куча) работают за O(1) на операцию и быстрее сравнивающей кучи;
+// на больших графах с широким диапазоном весов встречный поиск сокращает число
+// просмотренных вершин примерно вдвое.
+template <typename Index>
+PathAlgorithm selectPathAlgorithm(const AdjacencyList<Index>& adjacency) {
+    if (adjacency.maxWeight <= kDialMaxWeight) {
+        return PathAlgorithm::Dial;
+    }
+    if (adjacency.vertexCount >= kBidirectionalMinVertices) {
+        return PathAlgorithm::Bidirectional;
+    }
+    if (adjacency.maxWeight <= kRadixHeapMaxWeight) {
+        return PathAlgorithm::RadixHeap;
+    }
+    return PathAlgorithm::Dijkstra;
+}
+
+}  // namespace
+
+// Подготовка графа из матрицы инцидентности. Граф строится во временном объекте, поэтому
+// при ошибке prepared сохраняет прежнее содержимое.
+bool prepareGraph(const GraphDefinition& graph, PreparedGraph& prepared, std::string& error) {
+    PreparedGraph::Adjacency adjacency;
+    VertexNumbering numbering;
+    if (!buildAdjacencyList(graph, adjacency, numbering, error)) {
+        return false;
+    }
+    prepared.algorithm_ = std::visit([](const auto& list) { return selectPathAlgorithm(list); }, adjacency);
+    prepared.adjacency_ = std::move(adjacency);
+    prepared.vertexCount_ = graph.vertexCount;
+    prepared.sortedIds_ = std::move(numbering.sortedIds);
+    prepared.internalIds_ = std::move(numbering.internalIds);
+    prepared.externalIds_ = std::move(numbering.externalIds);
+    return true;
+}
+
+// Подготовка графа из списка рёбер.
+bool prepareGraph(VertexId vertexCount,
+                  const std::vector<Edge>& edges,
+                  PreparedGraph& prepared,
+                  std::string& error) {
+    PreparedGraph::Adjacency adjacency;
+    VertexNumbering numbering;
+    if (!buildAdjacencyList(vertexCount, edges, adjacency, numbering, error)) {
+        return false;
+    }
+    prepared.algorithm_ = std::visit([](const auto& list) { return selectPathAlgorithm(list); }, adjacency);
+    prepared.adjacency_ = std::move(adjacency);
+    prepared.vertexCount_ = vertexCount;
+    prepared.sortedIds_ = std::move(numbering.sortedIds);
+    prepared.internalIds_ = std::move(numbering.internalIds);
+    prepared.externalIds_ = std::move(numbering.externalIds);
+    return true;
+}
+
+// Внутренний номер вершины: двоичный поиск по упорядоченным внешним номерам вершин с рёбрами,
+// затем перевод в нумерацию, сгруппированную по компонентам связности.
+VertexId PreparedGraph::toInternal(VertexId vertex) const {
+    VertexId compact = vertex;
+    if (!sortedIds_.empty()) {
+        const auto it = std::lower_bound(sortedIds_.begin(), sortedIds_.end(), vertex);
+        if (it == sortedIds_.end() || *it != vertex) {
+            return kIsolatedVertex;
+        }
+        compact = static_cast<VertexId>(it - sortedIds_.begin());
+    }
+    return internalIds_.empty() ? compact : internalIds_[compact];
+}
+
+// Перевод пути во внешнюю нумерацию.
+void PreparedGraph::toExternal(std::vector<VertexId>& vertices) const {
+    if (externalIds_.empty() && sortedIds_.empty()) {
+        return;
+    }
+    for (VertexId& vertex : vertices) {
+        vertex = toExternal(vertex);
+    }
+}
+
+namespace {
+
+// Алгоритм Беллмана-Форда по спискам смежности.
+// Выполняет до V-1 итераций релаксации; на каждой итерации просматриваются только рёбра
+// вершин с уже известным расстоянием. Каждое ребро хранится в обоих направлениях,
+// поэтому релаксация неориентированного графа выполняется автоматически.
+// Возвращает PathComputation с информацией о пути от source до target.
+template <typename Index>
+PathComputation bellmanFord(const AdjacencyList<Index>& adjacency, VertexId source, VertexId target) {
+    PathComputation result;
+
+    if (adjacency.vertexCount == 0) {
+        result.error = "Граф не инициализирован.";
+        return result;
+    }
+    if (source >= adjacency.vertexCount || target >= adjacency.vertexCount) {
+        result.error = "Вершины выходят за границы графа.";
         return result;
     }
 
-    const uint16_t n = graph.vertexCount;
+    const uint32_t n = adjacency.vertexCount;
     std::vector<uint32_t> dist(n, kInfinity);
-    std::vector<int16_t> parent(n, -1);
+    std::vector<Index> parent(n, kNoVertex<Index>);  // Исходная вершина не имеет предшественника
 
     dist[source] = 0;
-    parent[source] = -1;  // Исходная вершина не имеет предшественника
 
-    for (uint16_t iter = 0; iter < n - 1; ++iter) {
+    for (uint32_t iter = 0; iter + 1 < n; ++iter) {
         bool updated = false;
-        for (const auto& edge : edges) {
-            const uint16_t u = edge.u;
-            const uint16_t v = edge.v;
-            const uint32_t w = edge.weight;
-
-            // Релаксация ребра u -> v
-            if (dist[u] != kInfinity && dist[u] + w < dist[v]) {
-                dist[v] = dist[u] + w;
-                parent[v] = static_cast<int16_t>(u);
-                updated = true;
-            }
-            // Релаксация ребра v -> u (для неориентированного графа)
-            if (dist[v] != kInfinity && dist[v] + w < dist[u]) {
-                dist[u] = dist[v] + w;
-                // Не обновляем parent[source], так как это исходная вершина
-                if (u != source) {
-                    parent[u] = static_cast<int16_t>(v);
+        for (uint32_t u = 0; u < n; ++u) {
+            const uint32_t du = dist[u];
+            if (du == kInfinity) {
+                continue;
+            }
+            for (uint32_t i = adjacency.offsets[u]; i < adjacency.offsets[u + 1]; ++i) {
+                const Index v = adjacency.neighbors[i];
+                if (du + adjacency.weights[i] < dist[v]) {
+                    dist[v] = du + adjacency.weights[i];
+                    parent[v] = static_cast<Index>(u);
+                    updated = true;
                 }
-                updated = true;
             }
         }
         if (!updated) {
@@ -172,34 +964,810 @@ PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint1
         }
     }
 
-    if (dist[target] == kInfinity) {
-        result.reachable = false;
-        result.distance = kInfinity;
-        result.path.clear();
-        result.error = "Путь между вершинами не найден.";
+    return makePathResult(dist, parent, 0, source, target);
+}
+
+// Алгоритм Дейкстры по спискам смежности с индексированной 4-арной кучей.
+// Каждая вершина извлекается из кучи не более одного раза; поиск прекращается,
+// как только извлечена вершина target (её расстояние окончательно).
+// Массивы поиска покрывают только компоненту связности source (локальные номера v - first).
+// Возвращает PathComputation с информацией о пути от source до target.
+template <typename Index>
+PathComputation dijkstra(const AdjacencyList<Index>& adjacency, VertexId source, VertexId target) {
+    PathComputation result;
+
+    if (adjacency.vertexCount == 0) {
+        result.error = "Граф не инициализирован.";
         return result;
     }
+    if (source >= adjacency.vertexCount || target >= adjacency.vertexCount) {
+        result.error = "Вершины выходят за границы графа.";
+        return result;
+    }
+
+    const ComponentRange range = componentRange(adjacency, source);
+    if (!range.contains(target)) {
+        return unreachablePath();
+    }
+    const uint32_t first = range.first;
+    std::vector<uint32_t> dist(range.size, kInfinity);
+    std::vector<Index> parent(range.size, kNoVertex<Index>);
+    IndexedQuaternaryHeap<Index> heap(range.size);
 
-    std::vector<uint16_t> path;
-    for (int16_t v = static_cast<int16_t>(target); v != -1; v = parent[v]) {
-        path.push_back(static_cast<uint16_t>(v));
-        if (v == static_cast<int16_t>(source)) {
+    const Index goal = static_cast<Index>(target - first);
+    dist[source - first] = 0;
+    heap.pushOrDecrease(static_cast<Index>(source - first), 0);
+
+    while (!heap.empty()) {
+        const Index u = heap.popMin();
+        if (u == goal) {
             break;
         }
+        const uint32_t du = dist[u];
+        for (uint32_t i = adjacency.offsets[first + u]; i < adjacency.offsets[first + u + 1]; ++i) {
+            const Index v = static_cast<Index>(adjacency.neighbors[i] - first);
+            const uint32_t candidate = du + adjacency.weights[i];
+            if (candidate < dist[v]) {
+                dist[v] = candidate;
+                parent[v] = u;
+                heap.pushOrDecrease(v, candidate);
+            }
+        }
     }
-    std::reverse(path.begin(), path.end());
 
-    if (path.empty() || path.front() != source) {
+    return makePathResult(dist, parent, first, source, target);
+}
+
+// Полный проход алгоритма Дейкстры от source: в отличие от dijkstra, поиск не останавливается
+// на целевой вершине, поэтому расстояния и предшественники окончательны для всех вершин
+// компоненты source. Вершины других компонент в дерево не входят.
+template <typename Index>
+bool buildShortestPathTree(const AdjacencyList<Index>& adjacency, VertexId source, ShortestPathTree& tree) {
+    if (source >= adjacency.vertexCount) {
+        return false;
+    }
+    const ComponentRange range = componentRange(adjacency, source);
+    const uint32_t first = range.first;
+    tree.source = source;
+    tree.first = first;
+    tree.dist.assign(range.size, kInfinity);
+    std::vector<Index>& parent = tree.parent.emplace<std::vector<Index>>(range.size, kNoVertex<Index>);
+    IndexedQuaternaryHeap<Index> heap(range.size);
+
+    tree.dist[source - first] = 0;
+    heap.pushOrDecrease(static_cast<Index>(source - first), 0);
+    while (!heap.empty()) {
+        const Index u = heap.popMin();
+        const uint32_t du = tree.dist[u];
+        for (uint32_t i = adjacency.offsets[first + u]; i < adjacency.offsets[first + u + 1]; ++i) {
+            const Index v = static_cast<Index>(adjacency.neighbors[i] - first);
+            const uint32_t candidate = du + adjacency.weights[i];
+            if (candidate < tree.dist[v]) {
+                tree.dist[v] = candidate;
+                parent[v] = u;
+                heap.pushOrDecrease(v, candidate);
+            }
+        }
+    }
+    return true;
+}
+
+// Алгоритм Дайала: корзина с номером d % (maxWeight + 1) содержит вершины с предварительным
+// расстоянием d. Все расстояния в очереди лежат в диапазоне [current, current + maxWeight],
+// поэтому циклического массива из maxWeight + 1 корзин достаточно. Элемент корзины устарел,
+// если расстояние вершины с тех пор уменьшилось; такие элементы пропускаются.
+// Поиск завершается, как только вершина target извлечена из корзины.
+template <typename Index>
+PathComputation dialSearch(const AdjacencyList<Index>& adjacency, VertexId source, VertexId target) {
+    PathComputation result;
+
+    if (adjacency.vertexCount == 0) {
+        result.error = "Граф не инициализирован.";
+        return result;
+    }
+    if (source >= adjacency.vertexCount || target >= adjacency.vertexCount) {
+        result.error = "Вершины выходят за границы графа.";
+        return result;
+    }
+
+    const ComponentRange range = componentRange(adjacency, source);
+    if (!range.contains(target)) {
+        return unreachablePath();
+    }
+    const uint32_t first = range.first;
+    const uint32_t bucketCount = adjacency.maxWeight + 1;
+    std::vector<uint32_t> dist(range.size, kInfinity);
+    std::vector<Index> parent(range.size, kNoVertex<Index>);
+    std::vector<std::vector<Index>> buckets(bucketCount);
+
+    const Index goal = static_cast<Index>(target - first);
+    dist[source - first] = 0;
+    buckets[0].push_back(static_cast<Index>(source - first));
+    std::size_t pending = 1;
+
+    bool targetSettled = false;
+    for (uint32_t current = 0; pending > 0 && !targetSettled; ++current) {
+        std::vector<Index>& bucket = buckets[current % bucketCount];
+        // Рёбра нулевого веса добавляют вершины в текущую корзину, поэтому она обрабатывается как стек.
+        while (!bucket.empty()) {
+            const Index u = bucket.back();
+            bucket.pop_back();
+            --pending;
+            if (dist[u] != current) {
+                continue;
+            }
+            if (u == goal) {
+                targetSettled = true;
+                break;
+            }
+            for (uint32_t i = adjacency.offsets[first + u]; i < adjacency.offsets[first + u + 1]; ++i) {
+                const Index v = static_cast<Index>(adjacency.neighbors[i] - first);
+                const uint32_t candidate = current + adjacency.weights[i];
+                if (candidate < dist[v]) {
+                    dist[v] = candidate;
+                    parent[v] = u;
+                    buckets[candidate % bucketCount].push_back(v);
+                    ++pending;
+                }
+            }
+        }
+    }
+
+    return makePathResult(dist, parent, first, source, target);
+}
+
+// Алгоритм Дейкстры с поразрядной кучей: расстояния извлекаются в неубывающем порядке,
+// что позволяет использовать RadixHeap вместо сравнивающей кучи.
+// Поиск завершается, как только вершина target извлечена из кучи.
+template <typename Index>
+PathComputation radixHeapSearch(const AdjacencyList<Index>& adjacency, VertexId source, VertexId target) {
+    PathComputation result;
+
+    if (adjacency.vertexCount == 0) {
+        result.error = "Граф не инициализирован.";
+        return result;
+    }
+    if (source >= adjacency.vertexCount || target >= adjacency.vertexCount) {
+        result.error = "Вершины выходят за границы графа.";
+        return result;
+    }
+
+    const ComponentRange range = componentRange(adjacency, source);
+    if (!range.contains(target)) {
+        return unreachablePath();
+    }
+    const uint32_t first = range.first;
+    std::vector<uint32_t> dist(range.size, kInfinity);
+    std::vector<Index> parent(range.size, kNoVertex<Index>);
+    RadixHeap<Index> heap;
+
+    const Index goal = static_cast<Index>(target - first);
+    dist[source - first] = 0;
+    heap.push(0, static_cast<Index>(source - first));
+
+    while (!heap.empty()) {
+        uint32_t du = 0;
+        const Index u = heap.pop(du);
+        if (du != dist[u]) {
+            continue;
+        }
+        if (u == goal) {
+            break;
+        }
+        for (uint32_t i = adjacency.offsets[first + u]; i < adjacency.offsets[first + u + 1]; ++i) {
+            const Index v = static_cast<Index>(adjacency.neighbors[i] - first);
+            const uint32_t candidate = du + adjacency.weights[i];
+            if (candidate < dist[v]) {
+                dist[v] = candidate;
+                parent[v] = u;
+                heap.push(candidate, v);
+            }
+        }
+    }
+
+    return makePathResult(dist, parent, first, source, target);
+}
+
+// Двунаправленный алгоритм Дейкстры с двумя индексированными 4-арными кучами.
+// На каждом шаге расширяется направление с меньшим минимальным ключом. При каждом уменьшении
+// расстояния вершины, достигнутой обоими поисками, обновляется лучший путь best через неё.
+// Поиск останавливается, когда minForward + minBackward >= best: более короткого пути не существует.
+// Путь собирается из прямого дерева (source -> meet) и обратного (meet -> target).
+template <typename Index>
+PathComputation bidirectionalDijkstra(const AdjacencyList<Index>& adjacency, VertexId source, VertexId target) {
+    PathComputation result;
+
+    if (adjacency.vertexCount == 0) {
+        result.error = "Граф не инициализирован.";
+        return result;
+    }
+    if (source >= adjacency.vertexCount || target >= adjacency.vertexCount) {
+        result.error = "Вершины выходят за границы графа.";
+        return result;
+    }
+
+    const ComponentRange range = componentRange(adjacency, source);
+    if (!range.contains(target)) {
+        return unreachablePath();
+    }
+    const uint32_t first = range.first;
+    const uint32_t n = range.size;
+    std::vector<uint32_t> dist[2] = {std::vector<uint32_t>(n, kInfinity),
+                                     std::vector<uint32_t>(n, kInfinity)};
+    std::vector<Index> parent[2] = {std::vector<Index>(n, kNoVertex<Index>),
+                                    std::vector<Index>(n, kNoVertex<Index>)};
+    IndexedQuaternaryHeap<Index> heaps[2] = {IndexedQuaternaryHeap<Index>(n), IndexedQuaternaryHeap<Index>(n)};
+
+    const Index start = static_cast<Index>(source - first);
+    const Index goal = static_cast<Index>(target - first);
+    dist[0][start] = 0;
+    dist[1][goal] = 0;
+    heaps[0].pushOrDecrease(start, 0);
+    heaps[1].pushOrDecrease(goal, 0);
+
+    uint32_t best = source == target ? 0 : kInfinity;
+    Index meet = source == target ? start : kNoVertex<Index>;
+
+    while (!heaps[0].empty() && !heaps[1].empty() &&
+           heaps[0].topKey() + heaps[1].topKey() < best) {
+        const int side = heaps[0].topKey() <= heaps[1].topKey() ? 0 : 1;
+        const int other = 1 - side;
+        const Index u = heaps[side].popMin();
+        const uint32_t du = dist[side][u];
+        for (uint32_t i = adjacency.offsets[first + u]; i < adjacency.offsets[first + u + 1]; ++i) {
+            const Index v = static_cast<Index>(adjacency.neighbors[i] - first);
+            const uint32_t candidate = du + adjacency.weights[i];
+            if (candidate >= dist[side][v]) {
+                continue;
+            }
+            dist[side][v] = candidate;
+            parent[side][v] = u;
+            heaps[side].pushOrDecrease(v, candidate);
+            if (dist[other][v] != kInfinity && candidate + dist[other][v] < best) {
+                best = candidate + dist[other][v];
+                meet = v;
+            }
+        }
+    }
+
+    if (best == kInfinity) {
+        return unreachablePath();
+    }
+
+    std::vector<VertexId> path;
+    if (!restorePath(parent[0], start, meet, path)) {
         result.error = "Не удалось восстановить путь.";
         return result;
     }
+    for (Index v = parent[1][meet]; v != kNoVertex<Index>; v = parent[1][v]) {
+        path.push_back(v);
+        if (v == goal || path.size() > n) {
+            break;
+        }
+    }
+    if (path.back() != goal) {
+        result.error = "Не удалось восстановить путь.";
+        return result;
+    }
+    for (VertexId& v : path) {
+        v += first;
+    }
 
     result.reachable = true;
-    result.distance = dist[target];
+    result.distance = best;
     result.path = std::move(path);
     return result;
 }
 
-}  // namespace graph
+// Построение иерархии сжатия. Порядок сжатия определяется ленивой очередью приоритетов:
+// приоритет вершины (требуемые шорткаты - степень + число уже сжатых соседей) пересчитывается
+// при извлечении, и вершина возвращается в очередь, если он стал хуже следующего кандидата.
+// Рёбра сжимаемой вершины к ещё не сжатым соседям становятся её восходящими рёбрами.
+// Иерархия получает разрядность номеров списков смежности.
+template <typename Index>
+bool buildContractionHierarchy(const AdjacencyList<Index>& adjacency, ContractionHierarchy& result) {
+    BasicContractionHierarchy<Index>& hierarchy = result.emplace<BasicContractionHierarchy<Index>>();
+    const uint32_t n = adjacency.vertexCount;
+    ContractionState<Index> state;
+    state.arcs.assign(n, {});
+    state.contracted.assign(n, 0);
+    state.witnessDist.assign(n, kInfinity);
+    for (uint32_t u = 0; u < n; ++u) {
+        for (uint32_t i = adjacency.offsets[u]; i < adjacency.offsets[u + 1]; ++i) {
+            if (adjacency.neighbors[i] != u) {
+                upsertArc(state, static_cast<Index>(u), adjacency.neighbors[i], adjacency.weights[i],
+                          kNoVertex<Index>);
+            }
+        }
+    }
+
+    std::vector<uint32_t> deletedNeighbors(n, 0);
+    auto priority = [&state, &deletedNeighbors](Index v) {
+        return static_cast<int64_t>(contractVertex(state, v, false)) -
+               static_cast<int64_t>(state.arcs[v].size()) +
+               static_cast<int64_t>(deletedNeighbors[v]);
+    };
+    using QueueEntry = std::pair<int64_t, Index>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    for (uint32_t v = 0; v < n; ++v) {
+        queue.push({priority(static_cast<Index>(v)), static_cast<Index>(v)});
+    }
+
+    const std::size_t shortcutBudget = kShortcutBudgetFactor * adjacency.edgeCount + n;
+    std::size_t shortcutsNeeded = 0;
+    std::vector<std::vector<ContractionArc<Index>>> upward(n);
+    hierarchy.vertexCount = 0;
+    hierarchy.rank.assign(n, 0);
+    Index nextRank = 0;
+
+    while (!queue.empty()) {
+        const Index v = queue.top().second;
+        queue.pop();
+        if (state.contracted[v]) {
+            continue;
+        }
+        const int64_t current = priority(v);
+        if (!queue.empty() && current > queue.top().first) {
+            queue.push({current, v});
+            continue;
+        }
 
+        if (state.arcs[v].size() > kMaxContractionDegree) {
+            return false;
+        }
+        shortcutsNeeded += contractVertex(state, v, true);
+        if (shortcutsNeeded > shortcutBudget) {
+            return false;
+        }
+        upward[v] = std::move(state.arcs[v]);
+        state.arcs[v].clear();
+        for (const ContractionArc<Index>& arc : upward[v]) {
+            std::vector<ContractionArc<Index>>& back = state.arcs[arc.to];
+            back.erase(std::remove_if(back.begin(), back.end(),
+                                      [v](const ContractionArc<Index>& item) { return item.to == v; }),
+                       back.end());
+            ++deletedNeighbors[arc.to];
+        }
+        state.contracted[v] = 1;
+        hierarchy.rank[v] = nextRank++;
+    }
+
+    hierarchy.upOffsets.assign(static_cast<std::size_t>(n) + 1, 0);
+    for (uint32_t v = 0; v < n; ++v) {
+        hierarchy.upOffsets[v + 1] = hierarchy.upOffsets[v] + static_cast<uint32_t>(upward[v].size());
+    }
+    hierarchy.upTargets.clear();
+    hierarchy.upWeights.clear();
+    hierarchy.upMiddle.clear();
+    hierarchy.upTargets.reserve(hierarchy.upOffsets[n]);
+    hierarchy.upWeights.reserve(hierarchy.upOffsets[n]);
+    hierarchy.upMiddle.reserve(hierarchy.upOffsets[n]);
+    hierarchy.shortcutCount = 0;
+    for (uint32_t v = 0; v < n; ++v) {
+        for (const ContractionArc<Index>& arc : upward[v]) {
+            hierarchy.upTargets.push_back(arc.to);
+            hierarchy.upWeights.push_back(arc.weight);
+            hierarchy.upMiddle.push_back(arc.middle);
+            if (arc.middle != kNoVertex<Index>) {
+                ++hierarchy.shortcutCount;
+            }
+        }
+    }
+    hierarchy.vertexCount = n;
+    return true;
+}
 
+}  // namespace
+
+// Функции поиска по подготовленному графу вызывают реализацию для списков смежности той
+// разрядности номеров вершин, которая была выбрана при подготовке графа.
+
+PathComputation bellmanFord(const PreparedGraph& graph, VertexId source, VertexId target) {
+    return std::visit([&](const auto& adjacency) { return bellmanFord(adjacency, source, target); },
+                      graph.adjacency());
+}
+
+PathComputation dijkstra(const PreparedGraph& graph, VertexId source, VertexId target) {
+    return std::visit([&](const auto& adjacency) { return dijkstra(adjacency, source, target); },
+                      graph.adjacency());
+}
+
+bool buildShortestPathTree(const PreparedGraph& graph, VertexId source, ShortestPathTree& tree) {
+    return std::visit([&](const auto& adjacency) { return buildShortestPathTree(adjacency, source, tree); },
+                      graph.adjacency());
+}
+
+PathComputation dialSearch(const PreparedGraph& graph, VertexId source, VertexId target) {
+    return std::visit([&](const auto& adjacency) { return dialSearch(adjacency, source, target); },
+                      graph.adjacency());
+}
+
+PathComputation radixHeapSearch(const PreparedGraph& graph, VertexId source, VertexId target) {
+    return std::visit([&](const auto& adjacency) { return radixHeapSearch(adjacency, source, target); },
+                      graph.adjacency());
+}
+
+PathComputation bidirectionalDijkstra(const PreparedGraph& graph, VertexId source, VertexId target) {
+    return std::visit([&](const auto& adjacency) { return bidirectionalDijkstra(adjacency, source, target); },
+                      graph.adjacency());
+}
+
+bool buildContractionHierarchy(const PreparedGraph& graph, ContractionHierarchy& hierarchy) {
+    return std::visit([&](const auto& adjacency) { return buildContractionHierarchy(adjacency, hierarchy); },
+                      graph.adjacency());
+}
+
+// Предшественник вершины в дереве: значение kNoVertex массива любой разрядности переводится в kNoTreeParent,
+// локальный номер предшественника - в номер вершины графа.
+VertexId ShortestPathTree::parentOf(VertexId v) const {
+    return std::visit(
+        [this, v](const auto& parents) {
+            using Index = typename std::decay_t<decltype(parents)>::value_type;
+            const Index local = parents[v - first];
+            return local == kNoVertex<Index> ? kNoTreeParent : first + static_cast<VertexId>(local);
+        },
+        parent);
+}
+
+std::size_t ShortestPathTree::memoryUsage() const {
+    return dist.size() * sizeof(uint32_t) +
+           std::visit([](const auto& parents) { return parents.size() * sizeof(parents[0]); }, parent);
+}
+
+// Восстановление пути по дереву кратчайших путей: проходит по parent от target к корню дерева.
+// Вершина вне компоненты дерева недостижима.
+PathComputation pathFromTree(const ShortestPathTree& tree, VertexId target) {
+    return std::visit(
+        [&](const auto& parents) { return makePathResult(tree.dist, parents, tree.first, tree.source, target); },
+        tree.parent);
+}
+
+namespace {
+
+// Обозначение отсутствующего ребра в массивах предшественников.
+constexpr uint32_t kNoEdge = std::numeric_limits<uint32_t>::max();
+
+// Поиск восходящего ребра owner -> target в иерархии сжатия. Возвращает индекс ребра или kNoEdge.
+template <typename Index>
+uint32_t findUpEdge(const BasicContractionHierarchy<Index>& hierarchy, Index owner, Index target) {
+    for (uint32_t i = hierarchy.upOffsets[owner]; i < hierarchy.upOffsets[owner + 1]; ++i) {
+        if (hierarchy.upTargets[i] == target) {
+            return i;
+        }
+    }
+    return kNoEdge;
+}
+
+// Рабочие массивы запроса к иерархии сжатия. Хранятся в thread_local-экземпляре и
+// переиспользуются между запросами: после запроса сбрасываются только затронутые вершины,
+// поэтому стоимость запроса не зависит от общего числа вершин графа.
+template <typename Index>
+struct HierarchyQueryWorkspace {
+    std::vector<uint32_t> dist[2];
+    std::vector<Index> parent[2];
+    std::vector<uint32_t> parentEdge[2];
+    std::vector<Index> touched;
+    IndexedQuaternaryHeap<Index> heaps[2] = {IndexedQuaternaryHeap<Index>(0), IndexedQuaternaryHeap<Index>(0)};
+
+    void prepare(uint32_t vertexCount) {
+        for (int side = 0; side < 2; ++side) {
+            if (dist[side].size() != vertexCount) {
+                dist[side].assign(vertexCount, kInfinity);
+                parent[side].assign(vertexCount, kNoVertex<Index>);
+                parentEdge[side].assign(vertexCount, kNoEdge);
+            }
+            heaps[side].reset(vertexCount);
+        }
+        for (Index v : touched) {
+            for (int side = 0; side < 2; ++side) {
+                dist[side][v] = kInfinity;
+                parent[side][v] = kNoVertex<Index>;
+                parentEdge[side][v] = kNoEdge;
+            }
+        }
+        touched.clear();
+    }
+};
+
+// Распаковка ребра иерархии from -> to в последовательность исходных рёбер.
+// Шорткат через middle заменяется парой рёбер from - middle и middle - to, которые хранятся
+// среди восходящих рёбер middle (ранг middle меньше рангов обоих концов).
+// Добавляет в path все вершины после from, включая to. Возвращает false при нарушении структуры.
+template <typename Index>
+bool unpackEdge(const BasicContractionHierarchy<Index>& hierarchy,
+                Index from,
+                Index to,
+                uint32_t edge,
+                std::vector<VertexId>& path) {
+    struct Segment {
+        Index from;
+        Index to;
+        uint32_t edge;
+    };
+    std::vector<Segment> stack{{from, to, edge}};
+    while (!stack.empty()) {
+        const Segment segment = stack.back();
+        stack.pop_back();
+        const Index middle = hierarchy.upMiddle[segment.edge];
+        if (middle == kNoVertex<Index>) {
+            path.push_back(segment.to);
+            continue;
+        }
+        const uint32_t first = findUpEdge(hierarchy, middle, segment.from);
+        const uint32_t second = findUpEdge(hierarchy, middle, segment.to);
+        if (first == kNoEdge || second == kNoEdge) {
+            return false;
+        }
+        stack.push_back({middle, segment.to, second});
+        stack.push_back({segment.from, middle, first});
+    }
+    return true;
+}
+
+// Рабочие массивы полного поиска по восходящим рёбрам (thread_local, сбрасываются только затронутые вершины).
+template <typename Index>
+struct UpwardSearchWorkspace {
+    std::vector<uint32_t> dist;
+    std::vector<Index> touched;
+    IndexedQuaternaryHeap<Index> heap{0};
+};
+
+// Поиск по восходящим рёбрам иерархии от source без остановки: записывает в space каждую
+// извлечённую из кучи вершину с расстоянием до неё по восходящему графу. Эти расстояния -
+// верхние оценки кратчайших, но для вершины наибольшего ранга на кратчайшем пути оценка точна.
+template <typename Index>
+void upwardSearch(const BasicContractionHierarchy<Index>& hierarchy,
+                  Index source,
+                  std::vector<std::pair<Index, uint32_t>>& space) {
+    thread_local UpwardSearchWorkspace<Index> workspace;
+    if (workspace.dist.size() != hierarchy.vertexCount) {
+        workspace.dist.assign(hierarchy.vertexCount, kInfinity);
+        workspace.touched.clear();
+    }
+    for (Index v : workspace.touched) {
+        workspace.dist[v] = kInfinity;
+    }
+    workspace.touched.clear();
+    workspace.heap.reset(hierarchy.vertexCount);
+    space.clear();
+
+    workspace.dist[source] = 0;
+    workspace.touched.push_back(source);
+    workspace.heap.pushOrDecrease(source, 0);
+    while (!workspace.heap.empty()) {
+        const Index u = workspace.heap.popMin();
+        const uint32_t du = workspace.dist[u];
+        space.emplace_back(u, du);
+        for (uint32_t i = hierarchy.upOffsets[u]; i < hierarchy.upOffsets[u + 1]; ++i) {
+            const Index v = hierarchy.upTargets[i];
+            const uint32_t candidate = du + hierarchy.upWeights[i];
+            if (candidate < workspace.dist[v]) {
+                if (workspace.dist[v] == kInfinity) {
+                    workspace.touched.push_back(v);
+                }
+                workspace.dist[v] = candidate;
+                workspace.heap.pushOrDecrease(v, candidate);
+            }
+        }
+    }
+}
+
+// Запрос к иерархии сжатия: прямой поиск от source и обратный от target идут только вверх
+// по рангу. Направление прекращает работу, когда его минимальный ключ не меньше лучшего
+// найденного расстояния. Найденный путь распаковывается до исходных рёбер.
+template <typename Index>
+PathComputation contractionHierarchyQuery(const BasicContractionHierarchy<Index>& hierarchy,
+                                          VertexId source,
+                                          VertexId target) {
+    PathComputation result;
+
+    if (hierarchy.vertexCount == 0) {
+        result.error = "Граф не инициализирован.";
+        return result;
+    }
+    if (source >= hierarchy.vertexCount || target >= hierarchy.vertexCount) {
+        result.error = "Вершины выходят за границы графа.";
+        return result;
+    }
+
+    const uint32_t n = hierarchy.vertexCount;
+    thread_local HierarchyQueryWorkspace<Index> workspace;
+    workspace.prepare(n);
+    auto& dist = workspace.dist;
+    auto& parent = workspace.parent;
+    auto& parentEdge = workspace.parentEdge;
+    auto& heaps = workspace.heaps;
+
+    dist[0][source] = 0;
+    dist[1][target] = 0;
+    workspace.touched.push_back(static_cast<Index>(source));
+    workspace.touched.push_back(static_cast<Index>(target));
+    heaps[0].pushOrDecrease(static_cast<Index>(source), 0);
+    heaps[1].pushOrDecrease(static_cast<Index>(target), 0);
+
+    uint32_t best = source == target ? 0 : kInfinity;
+    Index meet = source == target ? static_cast<Index>(source) : kNoVertex<Index>;
+
+    while (true) {
+        const bool forwardActive = !heaps[0].empty() && heaps[0].topKey() < best;
+        const bool backwardActive = !heaps[1].empty() && heaps[1].topKey() < best;
+        if (!forwardActive && !backwardActive) {
+            break;
+        }
+        const int side = forwardActive &&
+                                 (!backwardActive || heaps[0].topKey() <= heaps[1].topKey())
+                             ? 0
+                             : 1;
+        const int other = 1 - side;
+        const Index u = heaps[side].popMin();
+        const uint32_t du = dist[side][u];
+        for (uint32_t i = hierarchy.upOffsets[u]; i < hierarchy.upOffsets[u + 1]; ++i) {
+            const Index v = hierarchy.upTargets[i];
+            const uint32_t candidate = du + hierarchy.upWeights[i];
+            if (candidate >= dist[side][v]) {
+                continue;
+            }
+            if (dist[0][v] == kInfinity && dist[1][v] == kInfinity) {
+                workspace.touched.push_back(v);
+            }
+            dist[side][v] = candidate;
+            parent[side][v] = u;
+            parentEdge[side][v] = i;
+            heaps[side].pushOrDecrease(v, candidate);
+            if (dist[other][v] != kInfinity && candidate + dist[other][v] < best) {
+                best = candidate + dist[other][v];
+                meet = v;
+            }
+        }
+    }
+
+    if (best == kInfinity) {
+        return unreachablePath();
+    }
+
+    // Рёбра прямого дерева от meet к source (в обратном порядке).
+    std::vector<Index> forwardChain;
+    for (Index v = meet; v != source; v = parent[0][v]) {
+        forwardChain.push_back(v);
+        if (forwardChain.size() > n) {
+            result.error = "Не удалось восстановить путь.";
+            return result;
+        }
+    }
+
+    std::vector<VertexId> path{source};
+    for (auto it = forwardChain.rbegin(); it != forwardChain.rend(); ++it) {
+        if (!unpackEdge(hierarchy, parent[0][*it], *it, parentEdge[0][*it], path)) {
+            result.error = "Не удалось восстановить путь.";
+            return result;
+        }
+    }
+    for (Index v = meet; v != target; v = parent[1][v]) {
+        if (!unpackEdge(hierarchy, v, parent[1][v], parentEdge[1][v], path) || path.size() > n) {
+            result.error = "Не удалось восстановить путь.";
+            return result;
+        }
+    }
+
+    result.reachable = true;
+    result.distance = best;
+    result.path = std::move(path);
+    return result;
+}
+
+// Корзины строятся в формате CSR: сначала поиски из всех целей определяют диапазон достигнутых
+// вершин и размер корзины каждой из них, затем записи раскладываются по корзинам. Восходящий поиск
+// не выходит из компоненты связности цели, поэтому корзины не занимают памяти под другие компоненты.
+// Пространства поиска сохраняются между проходами.
+template <typename Index>
+void buildTargetBuckets(const BasicContractionHierarchy<Index>& hierarchy,
+                        const std::vector<VertexId>& targets,
+                        TargetBuckets& buckets) {
+    std::vector<std::vector<std::pair<Index, uint32_t>>> spaces(targets.size());
+    buckets.targetCount = static_cast<uint32_t>(targets.size());
+    VertexId low = kIsolatedVertex;
+    VertexId high = 0;
+    for (std::size_t t = 0; t < targets.size(); ++t) {
+        upwardSearch(hierarchy, static_cast<Index>(targets[t]), spaces[t]);
+        for (const auto& [v, d] : spaces[t]) {
+            low = std::min<VertexId>(low, v);
+            high = std::max<VertexId>(high, v);
+        }
+    }
+    buckets.first = targets.empty() ? 0 : low;
+    const uint32_t span = targets.empty() ? 0 : high - low + 1;
+    buckets.offsets.assign(static_cast<std::size_t>(span) + 1, 0);
+    for (const auto& space : spaces) {
+        for (const auto& [v, d] : space) {
+            ++buckets.offsets[v - buckets.first + 1];
+        }
+    }
+    for (uint32_t v = 0; v < span; ++v) {
+        buckets.offsets[v + 1] += buckets.offsets[v];
+    }
+    buckets.targets.resize(buckets.offsets.back());
+    buckets.dist.resize(buckets.offsets.back());
+    std::vector<uint32_t> fill(buckets.offsets.begin(), buckets.offsets.end() - 1);
+    for (std::size_t t = 0; t < targets.size(); ++t) {
+        for (const auto& [v, d] : spaces[t]) {
+            const uint32_t slot = fill[v - buckets.first]++;
+            buckets.targets[slot] = static_cast<uint32_t>(t);
+            buckets.dist[slot] = d;
+        }
+    }
+}
+
+// Кратчайший путь source - target проходит через вершину наибольшего ранга, которую достигают
+// оба восходящих поиска, поэтому минимум суммы по корзинам всех вершин пространства поиска
+// source даёт точное расстояние до каждой цели.
+template <typename Index>
+std::vector<uint32_t> distanceTableRow(const BasicContractionHierarchy<Index>& hierarchy,
+                                       const TargetBuckets& buckets,
+                                       VertexId source) {
+    std::vector<uint32_t> row(buckets.targetCount, kInfinity);
+    thread_local std::vector<std::pair<Index, uint32_t>> space;
+    upwardSearch(hierarchy, static_cast<Index>(source), space);
+    const uint32_t span = static_cast<uint32_t>(buckets.offsets.size() - 1);
+    for (const auto& [v, d] : space) {
+        if (v < buckets.first || v - buckets.first >= span) {
+            continue;
+        }
+        const uint32_t local = v - buckets.first;
+        for (uint32_t i = buckets.offsets[local]; i < buckets.offsets[local + 1]; ++i) {
+            const uint32_t candidate = d + buckets.dist[i];
+            if (candidate < row[buckets.targets[i]]) {
+                row[buckets.targets[i]] = candidate;
+            }
+        }
+    }
+    return row;
+}
+
+}  // namespace
+
+// Функции запросов к иерархии вызывают реализацию для её разрядности номеров вершин.
+
+PathComputation contractionHierarchyQuery(const ContractionHierarchy& hierarchy,
+                                          VertexId source,
+                                          VertexId target) {
+    return std::visit([&](const auto& levels) { return contractionHierarchyQuery(levels, source, target); },
+                      hierarchy);
+}
+
+void buildTargetBuckets(const ContractionHierarchy& hierarchy,
+                        const std::vector<VertexId>& targets,
+                        TargetBuckets& buckets) {
+    std::visit([&](const auto& levels) { buildTargetBuckets(levels, targets, buckets); }, hierarchy);
+}
+
+std::vector<uint32_t> distanceTableRow(const ContractionHierarchy& hierarchy,
+                                       const TargetBuckets& buckets,
+                                       VertexId source) {
+    return std::visit([&](const auto& levels) { return distanceTableRow(levels, buckets, source); }, hierarchy);
+}
+
+// Поиск кратчайшего пути алгоритмом, выбранным при подготовке графа.
+PathComputation findShortestPath(const PreparedGraph& graph, VertexId source, VertexId target) {
+    const PathAlgorithm algorithm = graph.algorithm();
+    return std::visit(
+        [&](const auto& adjacency) {
+            const uint32_t n = adjacency.vertexCount;
+            if (source < n && target < n && adjacency.component[source] != adjacency.component[target]) {
+                return unreachablePath();
+            }
+            switch (algorithm) {
+                case PathAlgorithm::Dial:
+                    return dialSearch(adjacency, source, target);
+                case PathAlgorithm::RadixHeap:
+                    return radixHeapSearch(adjacency, source, target);
+                case PathAlgorithm::Bidirectional:
+                    return bidirectionalDijkstra(adjacency, source, target);
+                case PathAlgorithm::Dijkstra:
+                default:
+                    return dijkstra(adjacency, source, target);
+            }
+        },
+        graph.adjacency());
+}
+
+}  // namespace graph
@@ -2,22 +2,178 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <optional>
 #include <string>
 #include <tuple>
+#include <variant>
 #include <vector>
 
 namespace graph {
 
+// Номер вершины (и количество вершин или рёбер) в интерфейсе модуля и в протоколе.
+using VertexId = uint32_t;
+
+// Наибольшее количество вершин, при котором подготовленный граф хранит номера вершин 16-битными
+// (значение 0xFFFF зарезервировано под отсутствующую вершину). Графы большего размера хранят
+// 32-битные номера; компактные массивы малых графов вдвое плотнее ложатся в кэш.
+constexpr uint32_t kCompactIndexLimit = 0xFFFF;
+
+// Структура данных в двух разрядностях номеров вершин: 16 бит для графов до kCompactIndexLimit
+// вершин и 32 бита для остальных. Разрядность выбирается один раз при подготовке графа.
+template <template <typename> class Structure>
+using IndexWidthVariant = std::variant<Structure<uint16_t>, Structure<uint32_t>>;
+
+// Матрица инцидентности в битовом представлении по столбцам: столбец ребра e занимает
+// wordsPerColumn() 64-битных слов подряд, бит v % 64 слова v / 64 столбца - инцидентность вершины v
+// ребру e. Все столбцы лежат в одном непрерывном массиве, поэтому матрица 705 x 705 занимает
+// около 62 КБ вместо 2 МБ, а столбец просматривается словами по 64 вершины.
+class IncidenceMatrix {
+public:
+    IncidenceMatrix() = default;
+    IncidenceMatrix(uint32_t vertexCount, uint32_t edgeCount) { reset(vertexCount, edgeCount); }
+
+    // Обнуление матрицы с новыми размерами.
+    void reset(uint32_t vertexCount, uint32_t edgeCount) {
+        vertexCount_ = vertexCount;
+        edgeCount_ = edgeCount;
+        wordsPerColumn_ = (static_cast<std::size_t>(vertexCount) + 63) / 64;
+        words_.assign(wordsPerColumn_ * edgeCount, 0);
+    }
+
+    uint32_t vertexCount() const { return vertexCount_; }
+    uint32_t edgeCount() const { return edgeCount_; }
+    std::size_t wordsPerColumn() const { return wordsPerColumn_; }
+
+    bool test(uint32_t vertex, uint32_t edge) const {
+        return (words_[edge * wordsPerColumn_ + vertex / 64] >> (vertex % 64)) & 1u;
+    }
+
+    void set(uint32_t vertex, uint32_t edge) {
+        words_[edge * wordsPerColumn_ + vertex / 64] |= uint64_t{1} << (vertex % 64);
+    }
+
+    // Слова столбца ребра edge (wordsPerColumn() слов; биты за пределами vertexCount нулевые).
+    const uint64_t* column(uint32_t edge) const { return words_.data() + edge * wordsPerColumn_; }
+
+private:
+    uint32_t vertexCount_ = 0;
+    uint32_t edgeCount_ = 0;
+    std::size_t wordsPerColumn_ = 0;
+    std::vector<uint64_t> words_;
+};
+
 // Структура, описывающая граф: количество вершин и рёбер, матрица инцидентности и веса рёбер.
 struct GraphDefinition {
-    uint16_t vertexCount = 0;                    // Количество вершин в графе
-    uint16_t edgeCount = 0;                      // Количество рёбер в графе
-    std::vector<std::vector<int>> incidence;    // Матрица инцидентности (вершины x рёбра, значения 0 или 1)
+    uint32_t vertexCount = 0;                    // Количество вершин в графе
+    uint32_t edgeCount = 0;                      // Количество рёбер в графе
+    IncidenceMatrix incidence;                   // Матрица инцидентности (вершины x рёбра)
     std::vector<uint32_t> weights;               // Список весов рёбер (индекс соответствует номеру ребра)
 };
 
+// Компактное представление графа в формате CSR (списки смежности в сплошных массивах).
+// Соседи вершины v и веса соответствующих рёбер лежат в neighbors/weights
+// в диапазоне [offsets[v], offsets[v + 1]). Каждое неориентированное ребро хранится дважды.
+// Строится один раз при загрузке графа и занимает O(V + E) памяти вместо O(V * E).
+// При построении вершины размечаются по компонентам связности, чтобы запросы между
+// разными компонентами отклонялись без поиска. Вершины каждой компоненты имеют подряд идущие номера,
+// поэтому поиск выделяет и просматривает массивы только компоненты начальной вершины.
+// Index - тип номера вершины (uint16_t или uint32_t).
+template <typename Index>
+struct AdjacencyList {
+    uint32_t vertexCount = 0;         // Количество вершин в графе
+    uint32_t edgeCount = 0;           // Количество рёбер в исходном графе
+    std::vector<uint32_t> offsets;    // Начало списка соседей каждой вершины (размер vertexCount + 1)
+    std::vector<Index> neighbors;     // Соседние вершины
+    std::vector<uint32_t> weights;    // Веса рёбер, ведущих к соседям
+    uint32_t maxWeight = 0;           // Максимальный вес ребра (определяет выбор алгоритма поиска)
+    std::vector<Index> component;     // Номер компоненты связности каждой вершины
+    uint32_t componentCount = 0;      // Количество компонент связности (изолированная вершина - отдельная)
+    std::vector<uint32_t> componentStart;  // Первая вершина каждой компоненты (размер componentCount + 1)
+};
+
+// Алгоритм поиска кратчайшего пути, выбираемый при загрузке графа по диапазону весов рёбер.
+enum class PathAlgorithm : uint8_t {
+    Dijkstra,       // Дейкстра с индексированной 4-арной кучей (произвольные веса)
+    Dial,           // Алгоритм Дайала: циклический массив корзин, веса не больше kDialMaxWeight
+    RadixHeap,      // Дейкстра с поразрядной (radix) кучей, веса не больше kRadixHeapMaxWeight
+    Bidirectional   // Двунаправленный Дейкстра для графов от kBidirectionalMinVertices вершин
+};
+
+// Максимальный вес ребра, при котором используется алгоритм Дайала (число корзин = maxWeight + 1).
+constexpr uint32_t kDialMaxWeight = 255;
+
+// Максимальный вес ребра, при котором используется поразрядная куча.
+constexpr uint32_t kRadixHeapMaxWeight = 65535;
+
+// Минимальное количество вершин, начиная с которого используется двунаправленный поиск.
+// На малых графах выигрыш от встречного поиска не окупает двойного набора массивов.
+constexpr uint32_t kBidirectionalMinVertices = 1024;
+
+// Иерархия сжатия (Contraction Hierarchies) для быстрых повторных запросов на одном графе.
+// Вершины упорядочены по рангу (порядку сжатия); для каждой вершины хранятся только рёбра
+// к вершинам с большим рангом (восходящий граф в формате CSR), включая добавленные шорткаты.
+// Шорткат заменяет путь u - middle - w, где middle имеет меньший ранг, чем u и w.
+template <typename Index>
+struct BasicContractionHierarchy {
+    uint32_t vertexCount = 0;            // Количество вершин в графе
+    std::vector<Index> rank;             // Ранг (порядковый номер сжатия) каждой вершины
+    std::vector<uint32_t> upOffsets;     // Начало списка восходящих рёбер вершины (размер vertexCount + 1)
+    std::vector<Index> upTargets;        // Конец восходящего ребра (вершина с большим рангом)
+    std::vector<uint32_t> upWeights;     // Вес восходящего ребра
+    std::vector<Index> upMiddle;         // Промежуточная вершина шортката (максимум Index для исходного ребра)
+    uint32_t shortcutCount = 0;          // Количество добавленных шорткатов
+};
+
+// Иерархия сжатия в разрядности номеров вершин подготовленного графа.
+using ContractionHierarchy = IndexWidthVariant<BasicContractionHierarchy>;
+
+// Расстояние до недостижимой вершины в дереве кратчайших путей.
+constexpr uint32_t kUnreachable = std::numeric_limits<uint32_t>::max() / 4;
+
+// Дерево кратчайших путей от вершины source: расстояния до вершин компоненты связности source
+// и предшественник каждой из них на кратчайшем пути (kNoTreeParent для source). Массивы покрывают
+// только компоненту: вершина v хранится под индексом v - first; вершины вне компоненты недостижимы.
+// Предшественники хранятся в разрядности номеров вершин подготовленного графа.
+// Позволяет ответить на любое количество запросов из source, восстанавливая путь за O(длины пути).
+struct ShortestPathTree {
+    VertexId source = 0;
+    VertexId first = 0;          // Первая вершина компоненты source
+    std::vector<uint32_t> dist;  // Расстояние до вершины first + i
+    std::variant<std::vector<uint16_t>, std::vector<uint32_t>> parent;  // Предшественник first + i (минус first)
+
+    // Расстояние до вершины v (kUnreachable для вершин вне компоненты source).
+    uint32_t distanceTo(VertexId v) const {
+        return v >= first && v - first < dist.size() ? dist[v - first] : kUnreachable;
+    }
+
+    // Предшественник вершины v компоненты (kNoTreeParent, если его нет).
+    VertexId parentOf(VertexId v) const;
+
+    // Объём памяти массивов дерева в байтах.
+    std::size_t memoryUsage() const;
+};
+
+// Отсутствующий предшественник в ShortestPathTree::parentOf.
+constexpr VertexId kNoTreeParent = std::numeric_limits<VertexId>::max();
+
+// Корзины целей для таблицы расстояний many-to-many по иерархии сжатия. Поиск по восходящим рёбрам
+// из каждой цели оставляет в каждой достигнутой вершине v запись (номер цели, расстояние от цели до v).
+// Записи вершины v лежат в targets/dist в диапазоне [offsets[v - first], offsets[v - first + 1]).
+// Корзины охватывают только диапазон вершин, достигнутых поисками из целей (компоненты целей).
+struct TargetBuckets {
+    uint32_t targetCount = 0;
+    VertexId first = 0;              // Наименьшая вершина с корзиной
+    std::vector<uint32_t> offsets;   // Начало корзины каждой вершины диапазона (размер диапазона + 1)
+    std::vector<uint32_t> targets;   // Номер цели в списке целей запроса
+    std::vector<uint32_t> dist;      // Расстояние от цели до вершины корзины
+};
+
+// Тип для представления ребра: (начальная вершина, конечная вершина, вес).
+using Edge = std::tuple<VertexId, VertexId, uint32_t>;
+
 // Результат валидации графа: содержит флаг успешности и сообщение об ошибке (если есть).
 struct ValidationResult {
     bool ok = false;        // true, если граф корректен
@@ -28,27 +184,160 @@ struct ValidationResult {
 struct PathComputation {
     bool reachable = false;              // true, если путь между вершинами существует
     uint32_t distance = 0;              // Длина кратчайшего пути (или INF, если путь не найден)
-    std::vector<uint16_t> path;          // Последовательность вершин кратчайшего пути
+    std::vector<VertexId> path;          // Последовательность вершин кратчайшего пути
     std::string error;                   // Сообщение об ошибке (если вычисление не удалось)
 };
 
+// Внутренний номер изолированной вершины: такая вершина не входит в списки смежности подготовленного графа.
+constexpr VertexId kIsolatedVertex = std::numeric_limits<VertexId>::max();
+
+// Граф, подготовленный к запросам: проверенный, со списками смежности (CSR), метками компонент
+// связности и алгоритмом поиска, выбранным по весам рёбер. Создаётся только функциями prepareGraph
+// один раз при загрузке графа и затем не изменяется. Функции запросов принимают только этот тип,
+// поэтому проверка графа и разбор матрицы инцидентности не повторяются на каждом запросе.
+// Изолированные вершины (без рёбер) в списки смежности не входят: остальные вершины получают
+// плотную внутреннюю нумерацию, поэтому память и инициализация поиска зависят от числа вершин
+// с рёбрами, а не от объявленного количества вершин. Внутренние номера сгруппированы по компонентам
+// связности (внутри компоненты - в порядке внешних номеров), поэтому поиск ограничен диапазоном
+// номеров компоненты начальной вершины. Функции поиска
+// работают во внутренней нумерации; номера из протокола переводятся toInternal и toExternal.
+// Списки смежности хранятся 16-битными, если вершин с рёбрами не больше kCompactIndexLimit.
+class PreparedGraph {
+public:
+    using Adjacency = IndexWidthVariant<AdjacencyList>;
+
+    PreparedGraph() = default;  // Пустой граф без вершин
+
+    const Adjacency& adjacency() const { return adjacency_; }
+    PathAlgorithm algorithm() const { return algorithm_; }
+
+    // Объявленное количество вершин (внешняя нумерация).
+    VertexId vertexCount() const { return vertexCount_; }
+    bool contains(VertexId vertex) const { return vertex < vertexCount_; }
+
+    // Количество вершин во внутренней нумерации (вершин с рёбрами).
+    VertexId internalVertexCount() const {
+        return std::visit([](const auto& adjacency) { return adjacency.vertexCount; }, adjacency_);
+    }
+
+    // Внутренний номер вершины с внешним номером vertex (kIsolatedVertex для изолированной вершины).
+    // Вершина должна входить в граф.
+    VertexId toInternal(VertexId vertex) const;
+
+    // Внешний номер вершины с внутренним номером vertex.
+    VertexId toExternal(VertexId vertex) const {
+        if (!externalIds_.empty()) {
+            return externalIds_[vertex];
+        }
+        return sortedIds_.empty() ? vertex : sortedIds_[vertex];
+    }
+
+    // Перевод последовательности вершин (пути) из внутренней нумерации во внешнюю.
+    void toExternal(std::vector<VertexId>& vertices) const;
+
+private:
+    friend bool prepareGraph(const GraphDefinition& graph, PreparedGraph& prepared, std::string& error);
+    friend bool prepareGraph(VertexId vertexCount,
+                             const std::vector<Edge>& edges,
+                             PreparedGraph& prepared,
+                             std::string& error);
+
+    Adjacency adjacency_;
+    PathAlgorithm algorithm_ = PathAlgorithm::Dijkstra;
+    VertexId vertexCount_ = 0;
+    std::vector<VertexId> sortedIds_;    // Внешние номера вершин с рёбрами по возрастанию (пусто без изолированных)
+    std::vector<VertexId> internalIds_;  // Внутренний номер по позиции в sortedIds_ или по внешнему номеру
+                                         // (пусто, если компоненты связности уже занимают диапазоны подряд)
+    std::vector<VertexId> externalIds_;  // Внешний номер каждой внутренней вершины (пусто, если это sortedIds_)
+};
+
 // Валидация графа: проверяет корректность структуры графа согласно требованиям.
 // Проверяет: количество вершин (>= 6), количество рёбер (>= 6), корректность матрицы инцидентности,
 // неотрицательность весов. Возвращает ValidationResult с результатом проверки.
 ValidationResult validateGraph(const GraphDefinition& graph);
 
-// Поиск кратчайшего пути алгоритмом Беллмана-Форда в неориентированном графе.
-// Алгоритм выполняет V-1 итераций релаксации всех рёбер для нахождения кратчайших расстояний.
-// Возвращает PathComputation с информацией о пути от source до target.
-PathComputation bellmanFord(const GraphDefinition& graph, uint16_t source, uint16_t target);
+// Преобразование графа в список рёбер для удобной обработки.
+// Также выполняет валидацию графа и записывает результат в параметр status.
+std::vector<Edge> buildEdgeList(const GraphDefinition& graph, ValidationResult& status);
+
+// Подготовка графа к запросам из матрицы инцидентности: выполняется один раз при загрузке графа.
+// Выполняет те же проверки, что validateGraph, в том же проходе по столбцам, в котором извлекаются
+// концы рёбер, строит списки смежности и выбирает алгоритм поиска. В случае ошибки записывает
+// описание в error и оставляет prepared без изменений. Изолированные вершины исключаются
+// из внутренней нумерации.
+bool prepareGraph(const GraphDefinition& graph, PreparedGraph& prepared, std::string& error);
 
+// Подготовка графа к запросам напрямую из списка рёбер, минуя матрицу инцидентности.
+// Проверяет номера вершин, отсутствие петель и допустимость весов (те же правила, что validateGraph).
+// В случае ошибки записывает описание в error и оставляет prepared без изменений.
+bool prepareGraph(VertexId vertexCount,
+                  const std::vector<Edge>& edges,
+                  PreparedGraph& prepared,
+                  std::string& error);
 
-// Тип для представления ребра: (начальная вершина, конечная вершина, вес).
-using Edge = std::tuple<uint16_t, uint16_t, uint32_t>;
+// Проверка, что вершины u и v (внутренние номера) лежат в одной компоненте связности
+// (путь между ними существует). Выполняется за O(1) по меткам, вычисленным при подготовке графа.
+inline bool sameComponent(const PreparedGraph& graph, VertexId u, VertexId v) {
+    return std::visit([u, v](const auto& adjacency) { return adjacency.component[u] == adjacency.component[v]; },
+                      graph.adjacency());
+}
 
-// Преобразование графа в список рёбер для удобной обработки.
-// Также выполняет валидацию графа и записывает результат в параметр status.
-// std::vector<Edge> buildEdgeList(const GraphDefinition& graph, ValidationResult& status);
+// Поиск кратчайшего пути алгоритмом Беллмана-Форда по подготовленному графу.
+// Алгоритм выполняет до V-1 итераций релаксации рёбер для нахождения кратчайших расстояний.
+PathComputation bellmanFord(const PreparedGraph& graph, VertexId source, VertexId target);
+
+// Поиск кратчайшего пути алгоритмом Дейкстры по спискам смежности.
+// Использует индексированную 4-арную кучу и завершается, как только вершина target извлечена из кучи.
+// Веса рёбер неотрицательны (uint32_t), поэтому результат совпадает с алгоритмом Беллмана-Форда.
+PathComputation dijkstra(const PreparedGraph& graph, VertexId source, VertexId target);
+
+// Поиск кратчайшего пути алгоритмом Дайала: очередь с приоритетом заменена циклическим массивом
+// из maxWeight + 1 корзин, индексируемых расстоянием. Эффективен при малых целых весах.
+PathComputation dialSearch(const PreparedGraph& graph, VertexId source, VertexId target);
+
+// Поиск кратчайшего пути алгоритмом Дейкстры с поразрядной (radix) кучей.
+// Использует монотонность извлекаемых расстояний: 33 корзины по старшему отличающемуся биту ключа.
+PathComputation radixHeapSearch(const PreparedGraph& graph, VertexId source, VertexId target);
+
+// Двунаправленный алгоритм Дейкстры: поиск ведётся одновременно от source и от target
+// (граф неориентированный, обратный граф не нужен) и завершается, когда сумма минимальных
+// ключей двух очередей не меньше длины лучшего найденного пути через точку встречи.
+PathComputation bidirectionalDijkstra(const PreparedGraph& graph, VertexId source, VertexId target);
+
+// Построение иерархии сжатия: вершины сжимаются в порядке возрастания приоритета
+// (разность рёбер + число сжатых соседей), для сохранения кратчайших расстояний добавляются шорткаты.
+// Возвращает false, если число шорткатов превышает допустимый бюджет (граф плохо поддаётся сжатию).
+bool buildContractionHierarchy(const PreparedGraph& graph, ContractionHierarchy& hierarchy);
+
+// Поиск кратчайшего пути по иерархии сжатия: двунаправленный поиск только по восходящим рёбрам
+// с последующей распаковкой шорткатов в полный путь по исходным рёбрам.
+PathComputation contractionHierarchyQuery(const ContractionHierarchy& hierarchy,
+                                          VertexId source,
+                                          VertexId target);
+
+// Обратная фаза таблицы расстояний many-to-many: поиски по восходящим рёбрам иерархии из всех целей
+// заполняют корзины вершин. Все цели должны входить в граф.
+void buildTargetBuckets(const ContractionHierarchy& hierarchy,
+                        const std::vector<VertexId>& targets,
+                        TargetBuckets& buckets);
+
+// Прямая фаза таблицы расстояний many-to-many: поиск по восходящим рёбрам из source просматривает
+// корзины достигнутых вершин. Возвращает строку таблицы: расстояния от source до каждой цели
+// (kUnreachable для недостижимых). Может вызываться параллельно для разных source.
+std::vector<uint32_t> distanceTableRow(const ContractionHierarchy& hierarchy,
+                                       const TargetBuckets& buckets,
+                                       VertexId source);
+
+// Построение полного дерева кратчайших путей от source алгоритмом Дейкстры с индексированной
+// 4-арной кучей (без ранней остановки). Возвращает false, если source вне графа.
+bool buildShortestPathTree(const PreparedGraph& graph, VertexId source, ShortestPathTree& tree);
+
+// Восстановление пути до target по дереву кратчайших путей.
+PathComputation pathFromTree(const ShortestPathTree& tree, VertexId target);
+
+// Поиск кратчайшего пути алгоритмом, выбранным при подготовке графа. Вершины из разных
+// компонент связности отклоняются без поиска.
+PathComputation findShortestPath(const PreparedGraph& graph, VertexId source, VertexId target);
 
 }  // namespace graph
 
@@ -0,0 +1,331 @@
+// Случайная сверка алгоритмов поиска модуля graph с алгоритмом Беллмана-Форда.
+// Для случайных графов (несколько компонент связности, изолированные вершины, веса около
+// порогов выбора алгоритма) каждый алгоритм поиска сравнивается с bellmanFord: совпадают
+// достижимость и расстояние, а найденный путь проходит по рёбрам графа и имеет ту же длину.
+// Сборка: g++ -std=c++17 -O2 graph_check.cpp graph.cpp -o graph_check
+// Запуск: ./graph_check [seed]; код возврата 0, если расхождений нет.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "graph.hpp"
+
+namespace {
+
+using graph::VertexId;
+
+// Параметры случайного графа.
+struct GraphCase {
+    std::string name;
+    VertexId vertexCount;      // Объявленное количество вершин
+    VertexId usedVertices;     // Вершины с рёбрами (остальные изолированы)
+    uint32_t components;       // Количество компонент связности среди вершин с рёбрами
+    uint32_t extraEdges;       // Рёбра сверх остовных деревьев компонент
+    uint32_t maxWeight;        // Наибольший вес ребра (встречается хотя бы один раз)
+    graph::PathAlgorithm expected;
+    std::size_t pairs;         // Количество проверяемых пар вершин
+    bool fromMatrix = false;   // Загружать через матрицу инцидентности
+};
+
+// Случайный граф: вершины с рёбрами выбираются случайно среди объявленных, делятся на компоненты,
+// каждая компонента связывается случайным остовным деревом и дополняется случайными рёбрами.
+std::vector<graph::Edge> randomGraph(const GraphCase& test, std::mt19937& rng, std::vector<VertexId>& used) {
+    used.clear();
+    if (test.usedVertices == test.vertexCount) {
+        for (VertexId v = 0; v < test.vertexCount; ++v) {
+            used.push_back(v);
+        }
+    } else {
+        std::uniform_int_distribution<VertexId> any(0, test.vertexCount - 1);
+        std::map<VertexId, bool> chosen;
+        while (chosen.size() < test.usedVertices) {
+            chosen[any(rng)] = true;
+        }
+        for (const auto& [v, flag] : chosen) {
+            used.push_back(v);
+        }
+    }
+    std::shuffle(used.begin(), used.end(), rng);
+
+    std::uniform_int_distribution<uint32_t> weight(0, test.maxWeight);
+    std::vector<graph::Edge> edges;
+    std::vector<std::pair<std::size_t, std::size_t>> parts;  // Диапазоны компонент в used
+    const std::size_t partSize = used.size() / test.components;
+    for (uint32_t c = 0; c < test.components; ++c) {
+        const std::size_t begin = c * partSize;
+        const std::size_t end = c + 1 == test.components ? used.size() : begin + partSize;
+        parts.emplace_back(begin, end);
+        for (std::size_t i = begin + 1; i < end; ++i) {
+            std::uniform_int_distribution<std::size_t> earlier(begin, i - 1);
+            edges.emplace_back(used[i], used[earlier(rng)], weight(rng));
+        }
+    }
+    std::uniform_int_distribution<uint32_t> part(0, test.components - 1);
+    for (uint32_t e = 0; e < test.extraEdges; ++e) {
+        const auto [begin, end] = parts[part(rng)];
+        if (end - begin < 2) {
+            continue;
+        }
+        std::uniform_int_distribution<std::size_t> inside(begin, end - 1);
+        const VertexId u = used[inside(rng)];
+        const VertexId v = used[inside(rng)];
+        if (u != v) {
+            edges.emplace_back(u, v, weight(rng));
+        }
+    }
+    std::get<2>(edges[std::uniform_int_distribution<std::size_t>(0, edges.size() - 1)(rng)]) = test.maxWeight;
+    std::shuffle(edges.begin(), edges.end(), rng);
+    return edges;
+}
+
+// Загрузка списка рёбер через матрицу инцидентности.
+bool prepareFromMatrix(VertexId vertexCount,
+                       const std::vector<graph::Edge>& edges,
+                       graph::PreparedGraph& prepared,
+                       std::string& error) {
+    graph::GraphDefinition definition;
+    definition.vertexCount = vertexCount;
+    definition.edgeCount = static_cast<uint32_t>(edges.size());
+    definition.incidence.reset(vertexCount, definition.edgeCount);
+    for (uint32_t e = 0; e < edges.size(); ++e) {
+        definition.incidence.set(std::get<0>(edges[e]), e);
+        definition.incidence.set(std::get<1>(edges[e]), e);
+        definition.weights.push_back(std::get<2>(edges[e]));
+    }
+    return graph::prepareGraph(definition, prepared, error);
+}
+
+const char* algorithmName(graph::PathAlgorithm algorithm) {
+    switch (algorithm) {
+        case graph::PathAlgorithm::Dial:
+            return "Dial";
+        case graph::PathAlgorithm::RadixHeap:
+            return "RadixHeap";
+        case graph::PathAlgorithm::Bidirectional:
+            return "Bidirectional";
+        case graph::PathAlgorithm::Dijkstra:
+        default:
+            return "Dijkstra";
+    }
+}
+
+// Сверка с эталоном: хранит вес кратчайшего ребра между каждой парой вершин (внешняя нумерация)
+// и считает расхождения.
+class Checker {
+public:
+    Checker(const graph::PreparedGraph& prepared, const std::vector<graph::Edge>& edges) : prepared_(prepared) {
+        for (const auto& [u, v, weight] : edges) {
+            const auto key = std::minmax(u, v);
+            auto it = lightest_.find(key);
+            if (it == lightest_.end() || weight < it->second) {
+                lightest_[key] = weight;
+            }
+        }
+    }
+
+    // Сравнение результата алгоритма engine для пары (source, target) во внутренней нумерации
+    // с результатом Беллмана-Форда.
+    void expect(const char* engine,
+                const graph::PathComputation& reference,
+                const graph::PathComputation& actual,
+                VertexId source,
+                VertexId target) {
+        std::string problem;
+        if (actual.reachable != reference.reachable) {
+            problem = "достижимость";
+        } else if (actual.reachable && actual.distance != reference.distance) {
+            problem = "расстояние " + std::to_string(actual.distance) + " вместо " +
+                      std::to_string(reference.distance);
+        } else if (actual.reachable && !validPath(actual, source, target)) {
+            problem = "путь не проходит по рёбрам графа или имеет другую длину";
+        }
+        report(engine, problem, source, target);
+    }
+
+    // Сравнение только расстояния (таблица расстояний, дерево кратчайших путей).
+    void expectDistance(const char* engine,
+                        const graph::PathComputation& reference,
+                        uint32_t distance,
+                        VertexId source,
+                        VertexId target) {
+        const uint32_t expected = reference.reachable ? reference.distance : graph::kUnreachable;
+        std::string problem;
+        if (distance != expected) {
+            problem = "расстояние " + std::to_string(distance) + " вместо " + std::to_string(expected);
+        }
+        report(engine, problem, source, target);
+    }
+
+    void fail(const std::string& message) {
+        ++failures_;
+        std::cout << "  FAIL " << message << "\n";
+    }
+
+    std::size_t checks() const { return checks_; }
+    std::size_t failures() const { return failures_; }
+
+private:
+    bool validPath(const graph::PathComputation& computation, VertexId source, VertexId target) const {
+        std::vector<VertexId> path = computation.path;
+        if (path.empty() || path.front() != source || path.back() != target) {
+            return false;
+        }
+        prepared_.toExternal(path);
+        uint64_t length = 0;
+        for (std::size_t i = 1; i < path.size(); ++i) {
+            const auto it = lightest_.find(std::minmax(path[i - 1], path[i]));
+            if (it == lightest_.end()) {
+                return false;
+            }
+            length += it->second;
+        }
+        return length == computation.distance;
+    }
+
+    void report(const char* engine, const std::string& problem, VertexId source, VertexId target) {
+        ++checks_;
+        if (!problem.empty()) {
+            fail(std::string(engine) + " " + std::to_string(prepared_.toExternal(source)) + " -> " +
+                 std::to_string(prepared_.toExternal(target)) + ": " + problem);
+        }
+    }
+
+    const graph::PreparedGraph& prepared_;
+    std::map<std::pair<VertexId, VertexId>, uint32_t> lightest_;
+    std::size_t checks_ = 0;
+    std::size_t failures_ = 0;
+};
+
+// Проверка одного случайного графа: нумерация вершин, выбор алгоритма по порогам и все алгоритмы
+// поиска на случайных парах вершин с рёбрами (включая пары из разных компонент).
+std::size_t runCase(const GraphCase& test, std::mt19937& rng) {
+    std::vector<VertexId> used;
+    const std::vector<graph::Edge> edges = randomGraph(test, rng, used);
+    graph::PreparedGraph prepared;
+    std::string error;
+    const bool ok = test.fromMatrix ? prepareFromMatrix(test.vertexCount, edges, prepared, error)
+                                    : graph::prepareGraph(test.vertexCount, edges, prepared, error);
+    std::cout << test.name << ": " << test.vertexCount << " вершин, " << edges.size() << " рёбер\n";
+    Checker checker(prepared, edges);
+    if (!ok) {
+        checker.fail("граф не подготовлен: " + error);
+        return checker.failures();
+    }
+
+    if (prepared.algorithm() != test.expected) {
+        checker.fail(std::string("выбран алгоритм ") + algorithmName(prepared.algorithm()) + " вместо " +
+                     algorithmName(test.expected));
+    }
+    const std::size_t indexBytes = std::visit(
+        [](const auto& adjacency) { return sizeof(adjacency.neighbors[0]); }, prepared.adjacency());
+    if (indexBytes != (test.usedVertices <= graph::kCompactIndexLimit ? 2u : 4u)) {
+        checker.fail("разрядность номеров вершин " + std::to_string(indexBytes * 8));
+    }
+    if (prepared.internalVertexCount() != test.usedVertices) {
+        checker.fail("вершин с рёбрами " + std::to_string(prepared.internalVertexCount()));
+    }
+    std::vector<bool> hasEdges(test.vertexCount, false);
+    for (VertexId v : used) {
+        hasEdges[v] = true;
+        const VertexId internal = prepared.toInternal(v);
+        if (internal == graph::kIsolatedVertex || prepared.toExternal(internal) != v) {
+            checker.fail("нумерация вершины " + std::to_string(v));
+        }
+    }
+    for (std::size_t i = 0; i < 100; ++i) {
+        const VertexId v = std::uniform_int_distribution<VertexId>(0, test.vertexCount - 1)(rng);
+        if (!hasEdges[v] && prepared.toInternal(v) != graph::kIsolatedVertex) {
+            checker.fail("изолированная вершина " + std::to_string(v) + " получила внутренний номер");
+        }
+    }
+
+    graph::ContractionHierarchy hierarchy;
+    const bool hasHierarchy = graph::buildContractionHierarchy(prepared, hierarchy);
+    std::uniform_int_distribution<std::size_t> pick(0, used.size() - 1);
+    std::vector<VertexId> sources;
+    std::vector<VertexId> targets;
+    for (std::size_t i = 0; i < test.pairs; ++i) {
+        sources.push_back(prepared.toInternal(used[pick(rng)]));
+        targets.push_back(prepared.toInternal(used[pick(rng)]));
+    }
+    graph::TargetBuckets buckets;
+    if (hasHierarchy) {
+        graph::buildTargetBuckets(hierarchy, targets, buckets);
+    }
+
+    for (std::size_t i = 0; i < test.pairs; ++i) {
+        const VertexId source = sources[i];
+        const VertexId target = targets[i];
+        const graph::PathComputation reference = graph::bellmanFord(prepared, source, target);
+        if (reference.reachable != graph::sameComponent(prepared, source, target)) {
+            checker.fail("метки компонент связности не совпадают с достижимостью");
+        }
+        checker.expect("dijkstra", reference, graph::dijkstra(prepared, source, target), source, target);
+        if (test.maxWeight <= graph::kRadixHeapMaxWeight) {
+            checker.expect("dialSearch", reference, graph::dialSearch(prepared, source, target), source, target);
+        }
+        checker.expect("radixHeapSearch", reference, graph::radixHeapSearch(prepared, source, target), source,
+                       target);
+        checker.expect("bidirectionalDijkstra", reference, graph::bidirectionalDijkstra(prepared, source, target),
+                       source, target);
+        checker.expect("findShortestPath", reference, graph::findShortestPath(prepared, source, target), source,
+                       target);
+
+        graph::ShortestPathTree tree;
+        graph::buildShortestPathTree(prepared, source, tree);
+        checker.expect("pathFromTree", reference, graph::pathFromTree(tree, target), source, target);
+        checker.expectDistance("ShortestPathTree", reference, tree.distanceTo(target), source, target);
+
+        if (hasHierarchy) {
+            checker.expect("contractionHierarchyQuery", reference,
+                           graph::contractionHierarchyQuery(hierarchy, source, target), source, target);
+            const std::vector<uint32_t> row = graph::distanceTableRow(hierarchy, buckets, source);
+            const uint32_t distance = row[i] >= graph::kUnreachable ? graph::kUnreachable : row[i];
+            checker.expectDistance("distanceTableRow", reference, distance, source, target);
+        }
+    }
+    std::cout << "  алгоритм " << algorithmName(prepared.algorithm()) << ", иерархия "
+              << (hasHierarchy ? "построена" : "не построена") << ", проверок " << checker.checks()
+              << ", расхождений " << checker.failures() << "\n";
+    return checker.failures();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const unsigned seed = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : 2024u;
+    std::mt19937 rng(seed);
+    std::cout << "seed " << seed << "\n";
+
+    using graph::PathAlgorithm;
+    // Пороги выбора алгоритма: kDialMaxWeight (255), kRadixHeapMaxWeight (65535),
+    // kBidirectionalMinVertices (1024 вершины с рёбрами) и разрядность номеров (kCompactIndexLimit).
+    const std::vector<GraphCase> cases = {
+        {"матрица, веса до 255", 40, 34, 3, 40, 255, PathAlgorithm::Dial, 200, true},
+        {"матрица, нулевые веса", 30, 30, 1, 30, 0, PathAlgorithm::Dial, 200, true},
+        {"веса до 256", 300, 250, 4, 400, 256, PathAlgorithm::RadixHeap, 200},
+        {"веса до 65535", 300, 300, 2, 300, 65535, PathAlgorithm::RadixHeap, 200},
+        {"веса до 65536", 300, 280, 3, 300, 65536, PathAlgorithm::Dijkstra, 200},
+        {"большие веса", 200, 150, 5, 200, 1000000, PathAlgorithm::Dijkstra, 200},
+        {"1023 вершины с рёбрами", 1500, 1023, 3, 2000, 300, PathAlgorithm::RadixHeap, 100},
+        {"1024 вершины с рёбрами", 1500, 1024, 3, 2000, 300, PathAlgorithm::Bidirectional, 100},
+        {"1024 вершины, веса до 255", 1024, 1024, 2, 2000, 255, PathAlgorithm::Dial, 100},
+        {"1024 вершины, большие веса", 2000, 1500, 4, 3000, 70000, PathAlgorithm::Bidirectional, 100},
+        {"редкие вершины с рёбрами", 50000000, 400, 6, 600, 1000, PathAlgorithm::RadixHeap, 100},
+        {"65535 вершин с рёбрами", 65535, 65535, 2, 2000, 1000, PathAlgorithm::Bidirectional, 20},
+        {"65536 вершин с рёбрами", 70000, 65536, 2, 2000, 1000, PathAlgorithm::Bidirectional, 20},
+    };
+
+    std::size_t failures = 0;
+    for (const GraphCase& test : cases) {
+        failures += runCase(test, rng);
+    }
+    std::cout << (failures == 0 ? "OK" : "FAIL") << ": расхождений " << failures << "\n";
+    return failures == 0 ? 0 : 1;
+}
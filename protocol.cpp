@@ -1,6 +1,9 @@
 #include "protocol.hpp"
 
 #include <arpa/inet.h>
+
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 #include <stdexcept>
 #include <type_traits>
@@ -9,8 +12,34 @@ namespace netproto {
 
 namespace {
 
-// Максимальный размер полезной нагрузки 64kb (максимальный размер udp)
-constexpr uint32_t kMaxPayloadSize = 1 << 16;
+// Размер номера вершины (и количества вершин или рёбер) в формате версии version.
+constexpr std::size_t vertexFieldSize(ProtocolVersion version) {
+    return version == ProtocolVersion::V1 ? 2 : 4;
+}
+
+// Размер одного ребра в полезной нагрузке UploadEdgeList: u + v + вес (4 байта).
+constexpr std::size_t edgeRecordSize(ProtocolVersion version) {
+    return 2 * vertexFieldSize(version) + 4;
+}
+
+// Размер заголовка части BatchPathResult: totalCount (2 байта) + firstIndex (2 байта) + количество
+// результатов (2 байта), и размер результата без вершин пути: статус (1 байт) + distance (4 байта)
+// + длина пути.
+constexpr std::size_t kBatchPartHeaderSize = 6;
+constexpr std::size_t batchEntryHeaderSize(ProtocolVersion version) {
+    return 5 + vertexFieldSize(version);
+}
+
+// Размер заголовка части DistanceVectorResult: vertexCount + firstVertex + количество вершин
+// + флаги (1 байт). Бит 0 флагов - в части передаются предшественники.
+constexpr std::size_t distancePartHeaderSize(ProtocolVersion version) {
+    return 3 * vertexFieldSize(version) + 1;
+}
+constexpr uint8_t kDistanceFlagParents = 0x1;
+
+// Размер заголовка части DistanceTableResult: sourceCount (2 байта) + targetCount (2 байта)
+// + firstCell (4 байта) + количество ячеек (2 байта).
+constexpr std::size_t kTablePartHeaderSize = 10;
 
 // Вспомогательная функция: добавляет целочисленное значение в буфер в сетевом порядке (big endian).
 // Поддерживает типы размером 1, 2 и 4 байта.
@@ -37,19 +66,19 @@ void appendBytes(std::vector<uint8_t>& buffer, T value) {
 // Вспомогательная функция: читает целочисленное значение из буфера в сетевом порядке (big endian).
 // Поддерживает типы размером 1, 2 и 4 байта. Смещение offset увеличивается после чтения.
 template <typename T>
-bool readBytes(const std::vector<uint8_t>& buffer, std::size_t& offset, T& value) {
-    if (offset + sizeof(T) > buffer.size()) {
+bool readBytes(const uint8_t* data, std::size_t size, std::size_t& offset, T& value) {
+    if (offset + sizeof(T) > size) {
         return false;
     }
     if constexpr (sizeof(T) == 1) {
-        value = static_cast<T>(buffer[offset]);
+        value = static_cast<T>(data[offset]);
     } else if constexpr (sizeof(T) == 2) {
         uint16_t raw = 0;
-        std::memcpy(&raw, buffer.data() + offset, sizeof(raw));
+        std::memcpy(&raw, data + offset, sizeof(raw));
         value = static_cast<T>(ntohs(raw));
     } else if constexpr (sizeof(T) == 4) {
         uint32_t raw = 0;
-        std::memcpy(&raw, buffer.data() + offset, sizeof(raw));
+        std::memcpy(&raw, data + offset, sizeof(raw));
         value = static_cast<T>(ntohl(raw));
     } else {
         return false;
@@ -58,19 +87,67 @@ bool readBytes(const std::vector<uint8_t>& buffer, std::size_t& offset, T& value
     return true;
 }
 
+template <typename T>
+bool readBytes(const std::vector<uint8_t>& buffer, std::size_t& offset, T& value) {
+    return readBytes(buffer.data(), buffer.size(), offset, value);
+}
+
+// Запись номера вершины (или количества) в формате версии version: 2 байта в версии 1, 4 байта в версии 2.
+// В версии 1 передаются младшие 16 бит (kNoParent становится 0xFFFF).
+void appendVertex(std::vector<uint8_t>& buffer, uint32_t value, ProtocolVersion version) {
+    if (version == ProtocolVersion::V1) {
+        appendBytes<uint16_t>(buffer, static_cast<uint16_t>(value));
+    } else {
+        appendBytes<uint32_t>(buffer, value);
+    }
+}
+
+// Чтение номера вершины (или количества) в формате версии version.
+bool readVertex(const std::vector<uint8_t>& buffer, std::size_t& offset, uint32_t& value, ProtocolVersion version) {
+    if (version == ProtocolVersion::V1) {
+        uint16_t narrow = 0;
+        if (!readBytes(buffer, offset, narrow)) {
+            return false;
+        }
+        value = narrow;
+        return true;
+    }
+    return readBytes(buffer, offset, value);
+}
+
 }  // namespace
 
+// Версия из битов kVersionMask поля reserved; клиенты без поддержки версий передают 0.
+uint8_t protocolVersionNumber(const MessageHeader& header) {
+    const uint8_t version = static_cast<uint8_t>((header.reserved & kVersionMask) >> kVersionShift);
+    return version == 0 ? static_cast<uint8_t>(ProtocolVersion::V1) : version;
+}
+
+void setProtocolVersion(MessageHeader& header, ProtocolVersion version) {
+    header.reserved = (header.reserved & ~kVersionMask) | (static_cast<uint32_t>(version) << kVersionShift);
+}
+
+// В версии 1 номер вершины занимает 2 байта; значение 0xFFFF зарезервировано под kNoParent.
+uint32_t maxVertexCount(ProtocolVersion version) {
+    return version == ProtocolVersion::V1 ? 0xFFFF : 0xFFFFFFFF;
+}
+
 // Сериализация заголовка сообщения: преобразует структуру MessageHeader в массив байтов.
 // Все числовые поля конвертируются в сетевой порядок байтов (big endian).
 std::vector<uint8_t> serializeHeader(const MessageHeader& header) {
     std::vector<uint8_t> buffer;
     buffer.reserve(kHeaderSize);
+    appendHeader(buffer, header);
+    return buffer;
+}
+
+// Добавление сериализованного заголовка в конец буфера без выделения отдельного массива.
+void appendHeader(std::vector<uint8_t>& buffer, const MessageHeader& header) {
     appendBytes<uint8_t>(buffer, static_cast<uint8_t>(header.command));
     appendBytes<uint8_t>(buffer, static_cast<uint8_t>(header.status));
     appendBytes<uint16_t>(buffer, header.requestId);
     appendBytes<uint32_t>(buffer, header.payloadSize);
     appendBytes<uint32_t>(buffer, header.reserved);
-    return buffer;
 }
 
 // Десериализация заголовка сообщения: восстанавливает структуру MessageHeader из массива байтов.
@@ -79,15 +156,21 @@ bool deserializeHeader(const std::vector<uint8_t>& buffer, MessageHeader& header
     if (buffer.size() != kHeaderSize) {
         return false;
     }
+    return deserializeHeader(buffer.data(), buffer.size(), header);
+}
+
+// Десериализация заголовка из начала буфера произвольного размера (например, принятой датаграммы),
+// без копирования заголовка в отдельный массив.
+bool deserializeHeader(const uint8_t* data, std::size_t size, MessageHeader& header) {
     std::size_t offset = 0;
     uint8_t commandRaw = 0;
     uint8_t statusRaw = 0;
 
-    if (!readBytes(buffer, offset, commandRaw) ||
-        !readBytes(buffer, offset, statusRaw) ||
-        !readBytes(buffer, offset, header.requestId) ||
-        !readBytes(buffer, offset, header.payloadSize) ||
-        !readBytes(buffer, offset, header.reserved)) {
+    if (!readBytes(data, size, offset, commandRaw) ||
+        !readBytes(data, size, offset, statusRaw) ||
+        !readBytes(data, size, offset, header.requestId) ||
+        !readBytes(data, size, offset, header.payloadSize) ||
+        !readBytes(data, size, offset, header.reserved)) {
         return false;
     }
 
@@ -100,12 +183,13 @@ bool deserializeHeader(const std::vector<uint8_t>& buffer, MessageHeader& header
 }
 
 // Сериализация полезной нагрузки UploadGraph: упаковывает граф в бинарный формат.
-// Формат: vertexCount (2 байта) + edgeCount (2 байта) + размер битов (4 байта) + биты матрицы + количество весов (4 байта) + веса.
-std::vector<uint8_t> serializeUploadGraph(const UploadGraphPayload& payload) {
+// Формат: vertexCount + edgeCount (по 2 байта в версии 1, по 4 в версии 2) + размер битов (4 байта)
+// + биты матрицы + количество весов (4 байта) + веса.
+std::vector<uint8_t> serializeUploadGraph(const UploadGraphPayload& payload, ProtocolVersion version) {
     std::vector<uint8_t> buffer;
-    buffer.reserve(4 + payload.incidenceBits.size() + payload.weights.size() * sizeof(uint32_t));
-    appendBytes<uint16_t>(buffer, payload.vertexCount);
-    appendBytes<uint16_t>(buffer, payload.edgeCount);
+    buffer.reserve(16 + payload.incidenceBits.size() + payload.weights.size() * sizeof(uint32_t));
+    appendVertex(buffer, payload.vertexCount, version);
+    appendVertex(buffer, payload.edgeCount, version);
 
     appendBytes<uint32_t>(buffer, static_cast<uint32_t>(payload.incidenceBits.size()));
     buffer.insert(buffer.end(), payload.incidenceBits.begin(), payload.incidenceBits.end());
@@ -121,20 +205,21 @@ std::vector<uint8_t> serializeUploadGraph(const UploadGraphPayload& payload) {
 // Проверяет корректность размеров и соответствие количества весов количеству рёбер.
 // В случае ошибки записывает описание в параметр error и возвращает false.
 bool deserializeUploadGraph(const std::vector<uint8_t>& buffer,
+                            ProtocolVersion version,
                             UploadGraphPayload& payload,
                             std::string& error) {
     std::size_t offset = 0;
     uint32_t bitsSize = 0;
     uint32_t weightCount = 0;
 
-    if (!readBytes(buffer, offset, payload.vertexCount) ||
-        !readBytes(buffer, offset, payload.edgeCount) ||
+    if (!readVertex(buffer, offset, payload.vertexCount, version) ||
+        !readVertex(buffer, offset, payload.edgeCount, version) ||
         !readBytes(buffer, offset, bitsSize)) {
         error = "Заголовок поврежден.";
         return false;
     }
 
-    if (offset + bitsSize > buffer.size()) {
+    if (bitsSize > buffer.size() - offset) {
         error = "Неверный размер блока бит матрицы инцидентности.";
         return false;
     }
@@ -151,7 +236,7 @@ bool deserializeUploadGraph(const std::vector<uint8_t>& buffer,
         return false;
     }
 
-    if (offset + weightCount * sizeof(uint32_t) > buffer.size()) {
+    if (static_cast<std::size_t>(weightCount) * sizeof(uint32_t) > buffer.size() - offset) {
         error = "Недостаточно данных для списка весов.";
         return false;
     }
@@ -175,36 +260,172 @@ bool deserializeUploadGraph(const std::vector<uint8_t>& buffer,
     return true;
 }
 
-// Сериализация полезной нагрузки PathQuery: упаковывает запрос пути в бинарный формат.
-// Формат: source (2 байта) + target (2 байта).
-std::vector<uint8_t> serializePathQuery(const PathQueryPayload& payload) {
+// Сериализация полезной нагрузки UploadEdgeList: упаковывает список рёбер в бинарный формат.
+// Формат: vertexCount + edgeCount + рёбра (u, v, вес - 4 байта); номера вершин и количества
+// занимают 2 байта в версии 1 и 4 байта в версии 2.
+std::vector<uint8_t> serializeUploadEdgeList(const UploadEdgeListPayload& payload, ProtocolVersion version) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(2 * vertexFieldSize(version) + payload.edges.size() * edgeRecordSize(version));
+    appendVertex(buffer, payload.vertexCount, version);
+    appendVertex(buffer, static_cast<uint32_t>(payload.edges.size()), version);
+    for (const EdgeRecord& edge : payload.edges) {
+        appendVertex(buffer, edge.u, version);
+        appendVertex(buffer, edge.v, version);
+        appendBytes<uint32_t>(buffer, edge.weight);
+    }
+    return buffer;
+}
+
+// Десериализация полезной нагрузки UploadEdgeList: восстанавливает список рёбер из бинарного формата.
+// Проверяет, что размер буфера точно соответствует заявленному количеству рёбер.
+// В случае ошибки записывает описание в параметр error и возвращает false.
+bool deserializeUploadEdgeList(const std::vector<uint8_t>& buffer,
+                               ProtocolVersion version,
+                               UploadEdgeListPayload& payload,
+                               std::string& error) {
+    std::size_t offset = 0;
+    uint32_t edgeCount = 0;
+    if (!readVertex(buffer, offset, payload.vertexCount, version) ||
+        !readVertex(buffer, offset, edgeCount, version)) {
+        error = "Заголовок поврежден.";
+        return false;
+    }
+    if (offset + static_cast<std::size_t>(edgeCount) * edgeRecordSize(version) != buffer.size()) {
+        error = "Размер списка рёбер не совпадает с количеством рёбер.";
+        return false;
+    }
+    payload.edges.clear();
+    payload.edges.reserve(edgeCount);
+    for (uint32_t i = 0; i < edgeCount; ++i) {
+        EdgeRecord edge{};
+        if (!readVertex(buffer, offset, edge.u, version) ||
+            !readVertex(buffer, offset, edge.v, version) ||
+            !readBytes(buffer, offset, edge.weight)) {
+            error = "Ошибка чтения ребра.";
+            return false;
+        }
+        payload.edges.push_back(edge);
+    }
+    return true;
+}
+
+// Разбиение полезной нагрузки на фрагменты: каждый фрагмент, кроме последнего, содержит
+// ровно kChunkDataSize байт, поэтому получатель вычисляет смещение фрагмента по его номеру.
+std::vector<ChunkPayload> splitIntoChunks(Command command, const std::vector<uint8_t>& payload) {
+    const std::size_t count = payload.empty() ? 1 : (payload.size() + kChunkDataSize - 1) / kChunkDataSize;
+    std::vector<ChunkPayload> chunks;
+    chunks.reserve(count);
+    for (std::size_t index = 0; index < count; ++index) {
+        const std::size_t begin = index * kChunkDataSize;
+        const std::size_t end = std::min(payload.size(), begin + kChunkDataSize);
+        ChunkPayload chunk;
+        chunk.command = command;
+        chunk.index = static_cast<uint16_t>(index);
+        chunk.count = static_cast<uint16_t>(count);
+        chunk.totalSize = static_cast<uint32_t>(payload.size());
+        chunk.data.assign(payload.begin() + begin, payload.begin() + end);
+        chunks.push_back(std::move(chunk));
+    }
+    return chunks;
+}
+
+// Сериализация полезной нагрузки Chunk.
+// Формат: command (1 байт) + index (2 байта) + count (2 байта) + totalSize (4 байта) + данные.
+std::vector<uint8_t> serializeChunk(const ChunkPayload& payload) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(kChunkHeaderSize + payload.data.size());
+    appendBytes<uint8_t>(buffer, static_cast<uint8_t>(payload.command));
+    appendBytes<uint16_t>(buffer, payload.index);
+    appendBytes<uint16_t>(buffer, payload.count);
+    appendBytes<uint32_t>(buffer, payload.totalSize);
+    buffer.insert(buffer.end(), payload.data.begin(), payload.data.end());
+    return buffer;
+}
+
+// Десериализация полезной нагрузки Chunk: проверяет, что количество фрагментов соответствует
+// totalSize, номер фрагмента не выходит за границы, а размер данных совпадает с ожидаемым.
+bool deserializeChunk(const std::vector<uint8_t>& buffer, ChunkPayload& payload, std::string& error) {
+    std::size_t offset = 0;
+    uint8_t commandRaw = 0;
+    if (!readBytes(buffer, offset, commandRaw) ||
+        !readBytes(buffer, offset, payload.index) ||
+        !readBytes(buffer, offset, payload.count) ||
+        !readBytes(buffer, offset, payload.totalSize)) {
+        error = "Заголовок фрагмента поврежден.";
+        return false;
+    }
+    payload.command = static_cast<Command>(commandRaw);
+    if (payload.totalSize > kMaxPayloadSize) {
+        error = "Сообщение превышает допустимый размер.";
+        return false;
+    }
+    const std::size_t expectedCount =
+        payload.totalSize == 0 ? 1 : (payload.totalSize + kChunkDataSize - 1) / kChunkDataSize;
+    if (payload.count != expectedCount || payload.index >= payload.count) {
+        error = "Некорректный номер или количество фрагментов.";
+        return false;
+    }
+    const std::size_t begin = static_cast<std::size_t>(payload.index) * kChunkDataSize;
+    const std::size_t expectedSize = std::min<std::size_t>(kChunkDataSize, payload.totalSize - begin);
+    if (buffer.size() - offset != expectedSize) {
+        error = "Размер фрагмента не соответствует его номеру.";
+        return false;
+    }
+    payload.data.assign(buffer.begin() + offset, buffer.end());
+    return true;
+}
+
+// Сериализация полезной нагрузки ChunkAck.
+// Формат: index (2 байта) + receivedCount (2 байта).
+std::vector<uint8_t> serializeChunkAck(const ChunkAckPayload& payload) {
     std::vector<uint8_t> buffer;
     buffer.reserve(4);
-    appendBytes<uint16_t>(buffer, payload.source);
-    appendBytes<uint16_t>(buffer, payload.target);
+    appendBytes<uint16_t>(buffer, payload.index);
+    appendBytes<uint16_t>(buffer, payload.receivedCount);
     return buffer;
 }
 
-// Десериализация полезной нагрузки PathQuery: восстанавливает запрос пути из бинарного формата.
-// Проверяет, что размер буфера равен 4 байтам (2 байта на каждую вершину).
-bool deserializePathQuery(const std::vector<uint8_t>& buffer, PathQueryPayload& payload) {
+// Десериализация полезной нагрузки ChunkAck: размер буфера должен быть равен 4 байтам.
+bool deserializeChunkAck(const std::vector<uint8_t>& buffer, ChunkAckPayload& payload) {
     if (buffer.size() != 4) {
         return false;
     }
     std::size_t offset = 0;
-    return readBytes(buffer, offset, payload.source) &&
-           readBytes(buffer, offset, payload.target);
+    return readBytes(buffer, offset, payload.index) &&
+           readBytes(buffer, offset, payload.receivedCount);
+}
+
+// Сериализация полезной нагрузки PathQuery: упаковывает запрос пути в бинарный формат.
+// Формат: source + target (по 2 байта в версии 1, по 4 байта в версии 2).
+std::vector<uint8_t> serializePathQuery(const PathQueryPayload& payload, ProtocolVersion version) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(2 * vertexFieldSize(version));
+    appendVertex(buffer, payload.source, version);
+    appendVertex(buffer, payload.target, version);
+    return buffer;
+}
+
+// Десериализация полезной нагрузки PathQuery: восстанавливает запрос пути из бинарного формата.
+// Проверяет, что размер буфера равен размеру двух номеров вершин.
+bool deserializePathQuery(const std::vector<uint8_t>& buffer, ProtocolVersion version, PathQueryPayload& payload) {
+    if (buffer.size() != 2 * vertexFieldSize(version)) {
+        return false;
+    }
+    std::size_t offset = 0;
+    return readVertex(buffer, offset, payload.source, version) &&
+           readVertex(buffer, offset, payload.target, version);
 }
 
 // Сериализация полезной нагрузки PathResult: упаковывает результат поиска пути в бинарный формат.
-// Формат: distance (4 байта) + длина пути (2 байта) + последовательность вершин (по 2 байта каждая).
-std::vector<uint8_t> serializePathResult(const PathResultPayload& payload) {
+// Формат: distance (4 байта) + длина пути + последовательность вершин (длина и вершины - по 2 байта
+// в версии 1, по 4 байта в версии 2).
+std::vector<uint8_t> serializePathResult(const PathResultPayload& payload, ProtocolVersion version) {
     std::vector<uint8_t> buffer;
-    buffer.reserve(4 + 2 + payload.path.size() * 2);
+    buffer.reserve(4 + (1 + payload.path.size()) * vertexFieldSize(version));
     appendBytes<uint32_t>(buffer, payload.distance);
-    appendBytes<uint16_t>(buffer, static_cast<uint16_t>(payload.path.size()));
-    for (uint16_t vertex : payload.path) {
-        appendBytes<uint16_t>(buffer, vertex);
+    appendVertex(buffer, static_cast<uint32_t>(payload.path.size()), version);
+    for (uint32_t vertex : payload.path) {
+        appendVertex(buffer, vertex, version);
     }
     return buffer;
 }
@@ -213,25 +434,26 @@ std::vector<uint8_t> serializePathResult(const PathResultPayload& payload) {
 // Проверяет корректность размера буфера и читает последовательность вершин пути.
 // В случае ошибки записывает описание в параметр error и возвращает false.
 bool deserializePathResult(const std::vector<uint8_t>& buffer,
+                           ProtocolVersion version,
                            PathResultPayload& payload,
                            std::string& error) {
     std::size_t offset = 0;
-    uint16_t pathSize = 0;
+    uint32_t pathSize = 0;
 
     if (!readBytes(buffer, offset, payload.distance) ||
-        !readBytes(buffer, offset, pathSize)) {
+        !readVertex(buffer, offset, pathSize, version)) {
         error = "Некорректный заголовок ответа пути.";
         return false;
     }
-    if (offset + pathSize * sizeof(uint16_t) != buffer.size()) {
+    if (offset + static_cast<std::size_t>(pathSize) * vertexFieldSize(version) != buffer.size()) {
         error = "Неверный размер массива пути.";
         return false;
     }
     payload.path.clear();
     payload.path.reserve(pathSize);
-    for (uint16_t i = 0; i < pathSize; ++i) {
-        uint16_t vertex = 0;
-        if (!readBytes(buffer, offset, vertex)) {
+    for (uint32_t i = 0; i < pathSize; ++i) {
+        uint32_t vertex = 0;
+        if (!readVertex(buffer, offset, vertex, version)) {
             error = "Ошибка чтения вершины пути.";
             return false;
         }
@@ -240,86 +462,398 @@ bool deserializePathResult(const std::vector<uint8_t>& buffer,
     return true;
 }
 
-// Сериализация строки: упаковывает строку в бинарный формат.
-// Формат: длина строки (2 байта) + байты строки.
-std::vector<uint8_t> serializeString(const std::string& text) {
+// Сериализация полезной нагрузки BatchPathQuery.
+// Формат: количество пар (2 байта) + пары (source, target) по 2 байта (версия 1) или по 4 байта
+// (версия 2) на вершину.
+std::vector<uint8_t> serializeBatchPathQuery(const BatchPathQueryPayload& payload, ProtocolVersion version) {
     std::vector<uint8_t> buffer;
-    buffer.reserve(2 + text.size());
-    appendBytes<uint16_t>(buffer, static_cast<uint16_t>(text.size()));
-    buffer.insert(buffer.end(), text.begin(), text.end());
+    buffer.reserve(2 + payload.queries.size() * 2 * vertexFieldSize(version));
+    appendBytes<uint16_t>(buffer, static_cast<uint16_t>(payload.queries.size()));
+    for (const PathQueryPayload& query : payload.queries) {
+        appendVertex(buffer, query.source, version);
+        appendVertex(buffer, query.target, version);
+    }
     return buffer;
 }
 
-// Десериализация строки: восстанавливает строку из бинарного формата.
-// Проверяет, что размер буфера соответствует заявленной длине строки.
-bool deserializeString(const std::vector<uint8_t>& buffer, std::string& text) {
+// Десериализация полезной нагрузки BatchPathQuery: проверяет, что размер буфера соответствует
+// количеству пар и что запрос не пуст.
+bool deserializeBatchPathQuery(const std::vector<uint8_t>& buffer,
+                               ProtocolVersion version,
+                               BatchPathQueryPayload& payload,
+                               std::string& error) {
     std::size_t offset = 0;
-    uint16_t size = 0;
-    if (!readBytes(buffer, offset, size)) {
+    uint16_t count = 0;
+    if (!readBytes(buffer, offset, count)) {
+        error = "Недостаточно данных для заголовка пакетного запроса.";
         return false;
     }
-    if (offset + size != buffer.size()) {
+    if (count == 0) {
+        error = "Пакетный запрос не содержит пар вершин.";
         return false;
     }
-    text.assign(reinterpret_cast<const char*>(buffer.data() + offset), size);
+    if (offset + static_cast<std::size_t>(count) * 2 * vertexFieldSize(version) != buffer.size()) {
+        error = "Размер пакетного запроса не соответствует количеству пар.";
+        return false;
+    }
+    payload.queries.resize(count);
+    for (PathQueryPayload& query : payload.queries) {
+        readVertex(buffer, offset, query.source, version);
+        readVertex(buffer, offset, query.target, version);
+    }
     return true;
 }
 
-// Упаковка матрицы инцидентности в битовый массив для компактной передачи.
-// Каждый элемент матрицы кодируется одним битом: 1 - есть связь вершины с ребром, 0 - нет связи.
-// Элементы матрицы упаковываются построчно (сначала все рёбра для первой вершины, затем для второй и т.д.).
-std::vector<uint8_t> packIncidenceMatrix(const std::vector<std::vector<int>>& matrix) {
-    if (matrix.empty() || matrix[0].empty()) {
-        return {};
-    }
-    const uint16_t vertexCount = static_cast<uint16_t>(matrix.size());
-    const uint16_t edgeCount = static_cast<uint16_t>(matrix[0].size());
-    const std::size_t totalBits = static_cast<std::size_t>(vertexCount) * edgeCount;
-    std::vector<uint8_t> bits((totalBits + 7) / 8, 0);
-
-    std::size_t bitIndex = 0;
-    for (uint16_t v = 0; v < vertexCount; ++v) {
-        for (uint16_t e = 0; e < edgeCount; ++e) {
-            if (matrix[v][e] != 0) {
-                const std::size_t byteIndex = bitIndex / 8;
-                const uint8_t bitPos = static_cast<uint8_t>(bitIndex % 8);
-                bits[byteIndex] |= static_cast<uint8_t>(1u << bitPos);
+// Сериализация результатов пакетного запроса по частям. Формат части: totalCount (2 байта) +
+// firstIndex (2 байта) + количество результатов (2 байта) + результаты; результат - статус (1 байт)
+// + distance (4 байта) + длина пути + вершины пути в формате PathResult той же версии.
+// Результаты не делятся между частями; новая часть начинается, когда следующий результат
+// не помещается в maxPartSize.
+std::vector<std::vector<uint8_t>> serializeBatchPathResults(const std::vector<BatchPathEntry>& entries,
+                                                            ProtocolVersion version,
+                                                            std::size_t maxPartSize) {
+    std::vector<std::vector<uint8_t>> parts;
+    std::size_t index = 0;
+    do {
+        std::vector<uint8_t> part;
+        part.reserve(maxPartSize);
+        appendBytes<uint16_t>(part, static_cast<uint16_t>(entries.size()));
+        appendBytes<uint16_t>(part, static_cast<uint16_t>(index));
+        appendBytes<uint16_t>(part, 0);
+        uint16_t count = 0;
+        while (index < entries.size()) {
+            const BatchPathEntry& entry = entries[index];
+            const std::size_t entrySize =
+                batchEntryHeaderSize(version) + entry.result.path.size() * vertexFieldSize(version);
+            if (count > 0 && part.size() + entrySize > maxPartSize) {
+                break;
             }
-            ++bitIndex;
+            appendBytes<uint8_t>(part, static_cast<uint8_t>(entry.status));
+            appendBytes<uint32_t>(part, entry.result.distance);
+            appendVertex(part, static_cast<uint32_t>(entry.result.path.size()), version);
+            for (uint32_t vertex : entry.result.path) {
+                appendVertex(part, vertex, version);
+            }
+            ++count;
+            ++index;
+        }
+        const uint16_t netCount = htons(count);
+        std::memcpy(part.data() + 4, &netCount, sizeof(netCount));
+        parts.push_back(std::move(part));
+    } while (index < entries.size());
+    return parts;
+}
+
+// Десериализация части BatchPathResult: проверяет, что результаты части лежат в диапазоне
+// [0, totalCount) и что размер буфера соответствует длинам путей.
+bool deserializeBatchPathResult(const std::vector<uint8_t>& buffer,
+                                ProtocolVersion version,
+                                BatchPathResultPayload& payload,
+                                std::string& error) {
+    std::size_t offset = 0;
+    uint16_t count = 0;
+    if (!readBytes(buffer, offset, payload.totalCount) ||
+        !readBytes(buffer, offset, payload.firstIndex) ||
+        !readBytes(buffer, offset, count)) {
+        error = "Некорректный заголовок части пакетного ответа.";
+        return false;
+    }
+    if (static_cast<std::size_t>(payload.firstIndex) + count > payload.totalCount) {
+        error = "Номера результатов выходят за пределы пакетного запроса.";
+        return false;
+    }
+    payload.entries.resize(count);
+    for (BatchPathEntry& entry : payload.entries) {
+        uint8_t status = 0;
+        uint32_t pathSize = 0;
+        if (!readBytes(buffer, offset, status) ||
+            !readBytes(buffer, offset, entry.result.distance) ||
+            !readVertex(buffer, offset, pathSize, version) ||
+            status > static_cast<uint8_t>(Status::NotReady) ||
+            static_cast<std::size_t>(pathSize) * vertexFieldSize(version) > buffer.size() - offset) {
+            error = "Некорректный результат в пакетном ответе.";
+            return false;
+        }
+        entry.status = static_cast<Status>(status);
+        entry.result.path.resize(pathSize);
+        for (uint32_t& vertex : entry.result.path) {
+            readVertex(buffer, offset, vertex, version);
         }
     }
-    return bits;
+    if (offset != buffer.size()) {
+        error = "Лишние данные в части пакетного ответа.";
+        return false;
+    }
+    return true;
 }
 
-// Распаковка матрицы инцидентности из битового массива в двумерную матрицу.
-// Каждый бит соответствует элементу матрицы: 1 - есть связь вершины с ребром, 0 - нет связи.
-// Проверяет корректность размера битового массива. В случае ошибки записывает описание в параметр error.
-bool unpackIncidenceMatrix(uint16_t vertexCount,
-                           uint16_t edgeCount,
-                           const std::vector<uint8_t>& bits,
-                           std::vector<std::vector<int>>& matrix,
-                           std::string& error) {
-    if (vertexCount == 0 || edgeCount == 0) {
-        error = "Пустая матрица.";
+// Сериализация полезной нагрузки DistanceVector.
+// Формат: source (2 байта в версии 1, 4 байта в версии 2) + флаги (1 байт, бит 0 - вернуть предшественников).
+std::vector<uint8_t> serializeDistanceVectorQuery(const DistanceVectorQueryPayload& payload,
+                                                  ProtocolVersion version) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(vertexFieldSize(version) + 1);
+    appendVertex(buffer, payload.source, version);
+    appendBytes<uint8_t>(buffer, payload.includeParents ? kDistanceFlagParents : 0);
+    return buffer;
+}
+
+// Десериализация полезной нагрузки DistanceVector: проверяет размер буфера (номер вершины и байт флагов)
+// и что не установлены неизвестные флаги.
+bool deserializeDistanceVectorQuery(const std::vector<uint8_t>& buffer,
+                                    ProtocolVersion version,
+                                    DistanceVectorQueryPayload& payload) {
+    if (buffer.size() != vertexFieldSize(version) + 1) {
         return false;
     }
-    const std::size_t totalBits = static_cast<std::size_t>(vertexCount) * edgeCount;
-    const std::size_t expectedBytes = (totalBits + 7) / 8;
-    if (bits.size() != expectedBytes) {
-        error = "Несоответствие размера битового массива матрице.";
+    std::size_t offset = 0;
+    uint8_t flags = 0;
+    if (!readVertex(buffer, offset, payload.source, version) || !readBytes(buffer, offset, flags) ||
+        (flags & ~kDistanceFlagParents) != 0) {
         return false;
     }
-    matrix.assign(vertexCount, std::vector<int>(edgeCount, 0));
-    std::size_t bitIndex = 0;
-    for (uint16_t v = 0; v < vertexCount; ++v) {
-        for (uint16_t e = 0; e < edgeCount; ++e) {
-            const std::size_t byteIndex = bitIndex / 8;
-            const uint8_t bitPos = static_cast<uint8_t>(bitIndex % 8);
-            const bool set = (bits[byteIndex] >> bitPos) & 0x01u;
-            matrix[v][e] = set ? 1 : 0;
-            ++bitIndex;
+    payload.includeParents = (flags & kDistanceFlagParents) != 0;
+    return true;
+}
+
+// Сериализация вектора расстояний по частям. Формат части: vertexCount + firstVertex + количество
+// вершин count (по 2 байта в версии 1, по 4 байта в версии 2) + флаги (1 байт) + битовая маска
+// достижимости (ceil(count / 8) байт, бит i - вершина firstVertex + i, старший бит байта первый)
+// + для каждой достижимой вершины по порядку distance (4 байта) и, если установлен флаг,
+// предшественник (номер вершины). Недостижимые вершины занимают только бит маски. Новая часть
+// начинается, когда следующая вершина не помещается в maxPartSize (в версии 1 - и после 65535 вершин).
+std::vector<std::vector<uint8_t>> serializeDistanceVector(const DistanceVectorPayload& payload,
+                                                          ProtocolVersion version,
+                                                          std::size_t maxPartSize) {
+    const std::size_t headerSize = distancePartHeaderSize(version);
+    const std::size_t entrySize = payload.includeParents ? 4 + vertexFieldSize(version) : 4;
+    const std::size_t maxCount = maxVertexCount(version);
+    std::vector<std::vector<uint8_t>> parts;
+    std::size_t vertex = 0;
+    do {
+        const std::size_t first = vertex;
+        std::size_t valuesSize = 0;
+        while (vertex < payload.dist.size()) {
+            const std::size_t count = vertex - first + 1;
+            const std::size_t extra = payload.dist[vertex] != kUnreachableDistance ? entrySize : 0;
+            if (count > maxCount ||
+                (count > 1 && headerSize + (count + 7) / 8 + valuesSize + extra > maxPartSize)) {
+                break;
+            }
+            valuesSize += extra;
+            ++vertex;
+        }
+        const std::size_t count = vertex - first;
+        std::vector<uint8_t> part;
+        part.reserve(headerSize + (count + 7) / 8 + valuesSize);
+        appendVertex(part, payload.vertexCount, version);
+        appendVertex(part, static_cast<uint32_t>(first), version);
+        appendVertex(part, static_cast<uint32_t>(count), version);
+        appendBytes<uint8_t>(part, payload.includeParents ? kDistanceFlagParents : 0);
+        part.resize(part.size() + (count + 7) / 8, 0);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (payload.dist[first + i] != kUnreachableDistance) {
+                part[headerSize + i / 8] |= static_cast<uint8_t>(0x80 >> (i % 8));
+            }
+        }
+        for (std::size_t i = first; i < vertex; ++i) {
+            if (payload.dist[i] == kUnreachableDistance) {
+                continue;
+            }
+            appendBytes<uint32_t>(part, payload.dist[i]);
+            if (payload.includeParents) {
+                appendVertex(part, payload.parent[i], version);
+            }
+        }
+        parts.push_back(std::move(part));
+    } while (vertex < payload.dist.size());
+    return parts;
+}
+
+// Десериализация части DistanceVectorResult: проверяет, что вершины части лежат в диапазоне
+// [0, vertexCount) и что размер буфера соответствует маске достижимости.
+bool deserializeDistanceVectorPart(const std::vector<uint8_t>& buffer,
+                                   ProtocolVersion version,
+                                   DistanceVectorPayload& payload,
+                                   std::string& error) {
+    std::size_t offset = 0;
+    uint32_t count = 0;
+    uint8_t flags = 0;
+    if (!readVertex(buffer, offset, payload.vertexCount, version) ||
+        !readVertex(buffer, offset, payload.firstVertex, version) ||
+        !readVertex(buffer, offset, count, version) ||
+        !readBytes(buffer, offset, flags) ||
+        (flags & ~kDistanceFlagParents) != 0) {
+        error = "Некорректный заголовок части вектора расстояний.";
+        return false;
+    }
+    if (static_cast<std::size_t>(payload.firstVertex) + count > payload.vertexCount) {
+        error = "Вершины части выходят за пределы графа.";
+        return false;
+    }
+    const std::size_t maskOffset = offset;
+    if ((static_cast<std::size_t>(count) + 7) / 8 > buffer.size() - offset) {
+        error = "Недостаточно данных для маски достижимости.";
+        return false;
+    }
+    offset += (static_cast<std::size_t>(count) + 7) / 8;
+    payload.includeParents = (flags & kDistanceFlagParents) != 0;
+    payload.dist.assign(count, kUnreachableDistance);
+    payload.parent.assign(payload.includeParents ? count : 0, kNoParent);
+    for (std::size_t i = 0; i < count; ++i) {
+        if ((buffer[maskOffset + i / 8] & (0x80 >> (i % 8))) == 0) {
+            continue;
+        }
+        if (!readBytes(buffer, offset, payload.dist[i]) ||
+            (payload.includeParents && !readVertex(buffer, offset, payload.parent[i], version))) {
+            error = "Недостаточно данных для расстояний.";
+            return false;
+        }
+        if (payload.includeParents && version == ProtocolVersion::V1 && payload.parent[i] == 0xFFFF) {
+            payload.parent[i] = kNoParent;
         }
     }
+    if (offset != buffer.size()) {
+        error = "Лишние данные в части вектора расстояний.";
+        return false;
+    }
+    return true;
+}
+
+// Сериализация полезной нагрузки DistanceTable.
+// Формат: количество начальных вершин (2 байта) + количество конечных вершин (2 байта)
+// + начальные вершины + конечные вершины (по 2 байта на вершину в версии 1, по 4 байта в версии 2).
+std::vector<uint8_t> serializeDistanceTableQuery(const DistanceTableQueryPayload& payload,
+                                                 ProtocolVersion version) {
+    assert(payload.sources.size() <= kMaxDistanceTableVertices &&
+           payload.targets.size() <= kMaxDistanceTableVertices);
+    std::vector<uint8_t> buffer;
+    buffer.reserve(4 + (payload.sources.size() + payload.targets.size()) * vertexFieldSize(version));
+    appendBytes<uint16_t>(buffer, static_cast<uint16_t>(payload.sources.size()));
+    appendBytes<uint16_t>(buffer, static_cast<uint16_t>(payload.targets.size()));
+    for (uint32_t vertex : payload.sources) {
+        appendVertex(buffer, vertex, version);
+    }
+    for (uint32_t vertex : payload.targets) {
+        appendVertex(buffer, vertex, version);
+    }
+    return buffer;
+}
+
+// Десериализация полезной нагрузки DistanceTable: проверяет, что списки вершин не пусты,
+// таблица не превышает kMaxDistanceTableCells ячеек и размер буфера соответствует спискам.
+bool deserializeDistanceTableQuery(const std::vector<uint8_t>& buffer,
+                                   ProtocolVersion version,
+                                   DistanceTableQueryPayload& payload,
+                                   std::string& error) {
+    std::size_t offset = 0;
+    uint16_t sourceCount = 0;
+    uint16_t targetCount = 0;
+    if (!readBytes(buffer, offset, sourceCount) || !readBytes(buffer, offset, targetCount)) {
+        error = "Недостаточно данных для заголовка запроса таблицы расстояний.";
+        return false;
+    }
+    if (sourceCount == 0 || targetCount == 0) {
+        error = "Запрос таблицы расстояний не содержит вершин.";
+        return false;
+    }
+    if (static_cast<std::size_t>(sourceCount) * targetCount > kMaxDistanceTableCells) {
+        error = "Таблица расстояний слишком велика.";
+        return false;
+    }
+    const std::size_t vertexBytes = (static_cast<std::size_t>(sourceCount) + targetCount) * vertexFieldSize(version);
+    if (offset + vertexBytes != buffer.size()) {
+        error = "Размер запроса таблицы расстояний не соответствует количеству вершин.";
+        return false;
+    }
+    payload.sources.resize(sourceCount);
+    payload.targets.resize(targetCount);
+    for (uint32_t& vertex : payload.sources) {
+        readVertex(buffer, offset, vertex, version);
+    }
+    for (uint32_t& vertex : payload.targets) {
+        readVertex(buffer, offset, vertex, version);
+    }
+    return true;
+}
+
+// Сериализация таблицы расстояний по частям. Формат части: sourceCount (2 байта) + targetCount
+// (2 байта) + firstCell (4 байта) + количество ячеек (2 байта) + расстояния (по 4 байта, построчно).
+std::vector<std::vector<uint8_t>> serializeDistanceTable(const DistanceTablePayload& payload,
+                                                         std::size_t maxPartSize) {
+    const std::size_t cellsPerPart =
+        std::min<std::size_t>(65535, std::max<std::size_t>(1, (maxPartSize - kTablePartHeaderSize) / 4));
+    std::vector<std::vector<uint8_t>> parts;
+    std::size_t cell = 0;
+    do {
+        const std::size_t count = std::min(cellsPerPart, payload.dist.size() - cell);
+        std::vector<uint8_t> part;
+        part.reserve(kTablePartHeaderSize + count * 4);
+        appendBytes<uint16_t>(part, payload.sourceCount);
+        appendBytes<uint16_t>(part, payload.targetCount);
+        appendBytes<uint32_t>(part, static_cast<uint32_t>(cell));
+        appendBytes<uint16_t>(part, static_cast<uint16_t>(count));
+        for (std::size_t i = cell; i < cell + count; ++i) {
+            appendBytes<uint32_t>(part, payload.dist[i]);
+        }
+        parts.push_back(std::move(part));
+        cell += count;
+    } while (cell < payload.dist.size());
+    return parts;
+}
+
+// Десериализация части DistanceTableResult: проверяет, что ячейки части лежат в пределах таблицы
+// и что размер буфера соответствует количеству ячеек.
+bool deserializeDistanceTablePart(const std::vector<uint8_t>& buffer,
+                                  DistanceTablePayload& payload,
+                                  std::string& error) {
+    std::size_t offset = 0;
+    uint16_t count = 0;
+    if (!readBytes(buffer, offset, payload.sourceCount) ||
+        !readBytes(buffer, offset, payload.targetCount) ||
+        !readBytes(buffer, offset, payload.firstCell) ||
+        !readBytes(buffer, offset, count)) {
+        error = "Некорректный заголовок части таблицы расстояний.";
+        return false;
+    }
+    if (static_cast<std::size_t>(payload.firstCell) + count >
+        static_cast<std::size_t>(payload.sourceCount) * payload.targetCount) {
+        error = "Ячейки части выходят за пределы таблицы расстояний.";
+        return false;
+    }
+    if (offset + static_cast<std::size_t>(count) * 4 != buffer.size()) {
+        error = "Размер части не соответствует количеству ячеек.";
+        return false;
+    }
+    payload.dist.resize(count);
+    for (uint32_t& distance : payload.dist) {
+        readBytes(buffer, offset, distance);
+    }
+    return true;
+}
+
+// Сериализация строки: упаковывает строку в бинарный формат.
+// Формат: длина строки (2 байта) + байты строки.
+std::vector<uint8_t> serializeString(const std::string& text) {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(2 + text.size());
+    appendBytes<uint16_t>(buffer, static_cast<uint16_t>(text.size()));
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    return buffer;
+}
+
+// Десериализация строки: восстанавливает строку из бинарного формата.
+// Проверяет, что размер буфера соответствует заявленной длине строки.
+bool deserializeString(const std::vector<uint8_t>& buffer, std::string& text) {
+    std::size_t offset = 0;
+    uint16_t size = 0;
+    if (!readBytes(buffer, offset, size)) {
+        return false;
+    }
+    if (offset + size != buffer.size()) {
+        return false;
+    }
+    text.assign(reinterpret_cast<const char*>(buffer.data() + offset), size);
     return true;
 }
 
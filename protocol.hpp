@@ -13,15 +13,39 @@ namespace netproto {
 // Размер заголовка сетевого сообщения в байтах (12 байт: command + status + requestId + payloadSize + reserved).
 constexpr std::size_t kHeaderSize = 12;
 
+// Максимальный размер полезной нагрузки 64 МБ: вмещает список из 5 миллионов рёбер в формате
+// версии 2 (12 байт на ребро). Фрагментами UDP передаётся до 65535 * kChunkDataSize (около 90 МБ).
+// Размер одной UDP-датаграммы ограничен отдельно (не более 64 КБ).
+constexpr uint32_t kMaxPayloadSize = 1 << 26;
+
+// Размер датаграммы с фрагментом сообщения: не превышает типичный MTU Ethernet (1500 байт)
+// с учётом заголовков IP и UDP, поэтому фрагменты не дробятся на уровне IP.
+constexpr std::size_t kChunkDatagramSize = 1400;
+
+// Размер заголовка фрагмента: command (1 байт) + index (2 байта) + count (2 байта) + totalSize (4 байта).
+constexpr std::size_t kChunkHeaderSize = 9;
+
+// Размер данных в одном фрагменте (все фрагменты, кроме последнего, имеют ровно такой размер).
+constexpr std::size_t kChunkDataSize = kChunkDatagramSize - kHeaderSize - kChunkHeaderSize;
+
 // Коды команд, используемые в протоколе для идентификации типа запроса/ответа.
 enum class Command : uint8_t {
-    Help = 1,        // Запрос справки по командам
-    UploadGraph = 2, // Загрузка графа на сервер
-    PathQuery = 3,   // Запрос кратчайшего пути между вершинами
-    PathResult = 4,  // Ответ с результатом поиска пути
-    Error = 5,       // Сообщение об ошибке
-    Ack = 6,         // Подтверждение получения (для UDP)
-    Exit = 7         // Завершение соединения
+    Help = 1,           // Запрос справки по командам
+    UploadGraph = 2,    // Загрузка графа на сервер
+    PathQuery = 3,      // Запрос кратчайшего пути между вершинами
+    PathResult = 4,     // Ответ с результатом поиска пути
+    Error = 5,          // Сообщение об ошибке
+    Ack = 6,            // Подтверждение получения (для UDP)
+    Exit = 7,           // Завершение соединения
+    UploadEdgeList = 8, // Загрузка графа в виде списка рёбер (u, v, вес)
+    Chunk = 9,          // Фрагмент сообщения, не помещающегося в одну UDP-датаграмму
+    ChunkAck = 10,      // Подтверждение (или отказ в приёме) фрагмента
+    BatchPathQuery = 11,  // Пакетный запрос путей для списка пар вершин
+    BatchPathResult = 12, // Часть ответа на пакетный запрос путей
+    DistanceVector = 13,       // Запрос расстояний от одной вершины до всех вершин графа
+    DistanceVectorResult = 14, // Часть ответа с вектором расстояний
+    DistanceTable = 15,        // Запрос таблицы расстояний между списками начальных и конечных вершин
+    DistanceTableResult = 16   // Часть ответа с таблицей расстояний
 };
 
 // Статусы выполнения команды, указывающие на результат обработки запроса.
@@ -39,55 +63,291 @@ struct MessageHeader {
     Status status;        // Статус выполнения
     uint16_t requestId;   // Идентификатор запроса (для UDP, чтобы связать запрос и ответ)
     uint32_t payloadSize; // Размер полезной нагрузки в байтах
-    uint32_t reserved;    // Зарезервированное поле для будущего использования
+    uint32_t reserved;    // Флаги (kFlag*) и версия формата (kVersionMask); остальные биты передаются нулевыми
 };
 
+// Флаг поля reserved: клиент UDP согласен получить ответ без отдельного ACK. Сервер, поддерживающий
+// режим, не отправляет ACK, если успевает ответить за короткое время, и повторяет флаг в ответе.
+// Сервер без поддержки режима игнорирует флаг и отправляет ACK, а затем ответ.
+constexpr uint32_t kFlagPiggybackAck = 0x1;
+
+// Версия формата полезной нагрузки. В версии 1 номера вершин и количества вершин и рёбер
+// передаются 2 байтами (графы до 65535 вершин), в версии 2 - 4 байтами. Остальные поля
+// (количество пар пакетного запроса, размеры таблицы расстояний, строки, фрагменты) не меняются.
+enum class ProtocolVersion : uint8_t {
+    V1 = 1,
+    V2 = 2
+};
+
+// Последняя версия формата, поддерживаемая этой сборкой.
+constexpr ProtocolVersion kLatestProtocolVersion = ProtocolVersion::V2;
+
+// Биты поля reserved, в которых передаётся версия формата полезной нагрузки. Нулевое значение
+// (клиенты и серверы без поддержки версий) означает версию 1. Ответ передаётся в версии запроса;
+// на команду Help сервер отвечает наибольшей общей версией, что позволяет клиенту её выбрать.
+constexpr uint32_t kVersionMask = 0xFF00;
+constexpr unsigned kVersionShift = 8;
+
+// Версия формата полезной нагрузки сообщения (значение из битов kVersionMask, 0 - версия 1).
+// Версии новее kLatestProtocolVersion возвращаются как есть: получатель должен их отклонить.
+uint8_t protocolVersionNumber(const MessageHeader& header);
+
+// Запись версии формата полезной нагрузки в поле reserved заголовка.
+void setProtocolVersion(MessageHeader& header, ProtocolVersion version);
+
+// Наибольшее количество вершин графа, номера которых представимы в формате версии version.
+uint32_t maxVertexCount(ProtocolVersion version);
+
 // Полезная нагрузка команды UploadGraph: содержит описание графа
 struct UploadGraphPayload {
-    uint16_t vertexCount;              // Количество вершин в графе
-    uint16_t edgeCount;                // Количество рёбер в графе
+    uint32_t vertexCount;              // Количество вершин в графе
+    uint32_t edgeCount;                // Количество рёбер в графе
     std::vector<uint8_t> incidenceBits; // Матрица инцидентности в битовом формате (упакована)
     std::vector<uint32_t> weights;     // Список весов рёбер
 };
 
+// Ребро в полезной нагрузке UploadEdgeList.
+struct EdgeRecord {
+    uint32_t u;       // Первая вершина ребра
+    uint32_t v;       // Вторая вершина ребра
+    uint32_t weight;  // Вес ребра
+};
+
+// Полезная нагрузка команды UploadEdgeList: граф в виде списка рёбер.
+// Размер полезной нагрузки O(E) в отличие от O(V * E) для матрицы инцидентности.
+struct UploadEdgeListPayload {
+    uint32_t vertexCount;            // Количество вершин в графе
+    std::vector<EdgeRecord> edges;   // Список рёбер
+};
+
+// Полезная нагрузка команды Chunk: фрагмент полезной нагрузки большого сообщения.
+// Все фрагменты одного сообщения передаются с одинаковым requestId в заголовке.
+struct ChunkPayload {
+    Command command;            // Команда собранного сообщения
+    uint16_t index;             // Номер фрагмента (с 0)
+    uint16_t count;             // Общее количество фрагментов
+    uint32_t totalSize;         // Размер собранной полезной нагрузки
+    std::vector<uint8_t> data;  // Данные фрагмента
+};
+
+// Полезная нагрузка команды ChunkAck: подтверждение фрагмента.
+// Статус Ok означает, что фрагмент принят; InvalidRequest - что передача отклонена целиком.
+struct ChunkAckPayload {
+    uint16_t index;          // Номер подтверждаемого фрагмента
+    uint16_t receivedCount;  // Количество уже принятых фрагментов сообщения
+};
+
 // Полезная нагрузка команды PathQuery: запрос пути между двумя вершинами.
 struct PathQueryPayload {
-    uint16_t source; // Начальная вершина
-    uint16_t target; // Конечная вершина
+    uint32_t source; // Начальная вершина
+    uint32_t target; // Конечная вершина
 };
 
 // Полезная нагрузка ответа PathResult: результат поиска кратчайшего пути.
 struct PathResultPayload {
     uint32_t distance;              // Длина найденного пути
-    std::vector<uint16_t> path;     // Последовательность вершин пути
+    std::vector<uint32_t> path;     // Последовательность вершин пути
+};
+
+// Полезная нагрузка команды BatchPathQuery: список пар вершин (не более kMaxBatchQueries).
+struct BatchPathQueryPayload {
+    std::vector<PathQueryPayload> queries;
+};
+
+// Максимальное количество пар вершин в одном пакетном запросе.
+constexpr std::size_t kMaxBatchQueries = 65535;
+
+// Результат одной пары пакетного запроса. Статус Ok - путь найден (result заполнен),
+// NotReady - путь не существует, InvalidRequest - вершины вне графа.
+struct BatchPathEntry {
+    Status status;
+    PathResultPayload result;
+};
+
+// Полезная нагрузка ответа BatchPathResult. Ответ на пакетный запрос передаётся одной или
+// несколькими частями (с тем же requestId), каждая из которых содержит результаты пар
+// [firstIndex, firstIndex + entries.size()) в порядке запроса; totalCount - количество пар в запросе.
+struct BatchPathResultPayload {
+    uint16_t totalCount;
+    uint16_t firstIndex;
+    std::vector<BatchPathEntry> entries;
+};
+
+// Полезная нагрузка команды DistanceVector: расстояния от вершины source до всех вершин графа;
+// при includeParents в ответ добавляются предшественники вершин на кратчайших путях.
+struct DistanceVectorQueryPayload {
+    uint32_t source;
+    bool includeParents;
+};
+
+// Расстояние до недостижимой вершины в DistanceVectorPayload (по сети не передаётся).
+constexpr uint32_t kUnreachableDistance = 0xFFFFFFFF;
+
+// Предшественник начальной и недостижимых вершин в DistanceVectorPayload
+// (в формате версии 1 передаётся как 0xFFFF).
+constexpr uint32_t kNoParent = 0xFFFFFFFF;
+
+// Полезная нагрузка ответа DistanceVectorResult. Вектор передаётся одной или несколькими частями
+// (с тем же requestId), каждая из которых содержит вершины [firstVertex, firstVertex + dist.size());
+// vertexCount - количество вершин графа. parent заполнен, только если includeParents.
+struct DistanceVectorPayload {
+    uint32_t vertexCount;
+    uint32_t firstVertex;
+    bool includeParents;
+    std::vector<uint32_t> dist;
+    std::vector<uint32_t> parent;
+};
+
+// Полезная нагрузка команды DistanceTable: таблица расстояний от каждой вершины sources
+// до каждой вершины targets (не более kMaxDistanceTableVertices вершин в каждом списке
+// и не более kMaxDistanceTableCells ячеек).
+struct DistanceTableQueryPayload {
+    std::vector<uint32_t> sources;
+    std::vector<uint32_t> targets;
+};
+
+// Максимальное количество вершин в списке sources или targets: размер списка передаётся 2 байтами.
+constexpr std::size_t kMaxDistanceTableVertices = 65535;
+
+// Максимальное количество ячеек таблицы расстояний (1 МБ расстояний).
+constexpr std::size_t kMaxDistanceTableCells = 1 << 18;
+
+// Полезная нагрузка ответа DistanceTableResult. Таблица sourceCount x targetCount хранится
+// построчно (ячейка source i, target j имеет номер i * targetCount + j; kUnreachableDistance для
+// недостижимых) и передаётся одной или несколькими частями с ячейками [firstCell, firstCell + dist.size()).
+struct DistanceTablePayload {
+    uint16_t sourceCount;
+    uint16_t targetCount;
+    uint32_t firstCell;
+    std::vector<uint32_t> dist;
 };
 
 // Сериализация заголовка: преобразует структуру MessageHeader в массив байтов для передачи по сети.
 std::vector<uint8_t> serializeHeader(const MessageHeader& header);
 
+// Добавление сериализованного заголовка в конец буфера.
+void appendHeader(std::vector<uint8_t>& buffer, const MessageHeader& header);
+
 // Десериализация заголовка: восстанавливает структуру MessageHeader из массива байтов.
 // Возвращает false, если данные некорректны.
 bool deserializeHeader(const std::vector<uint8_t>& buffer, MessageHeader& header);
 
+// Десериализация заголовка из первых kHeaderSize байтов буфера data размера size.
+bool deserializeHeader(const uint8_t* data, std::size_t size, MessageHeader& header);
+
 // Сериализация полезной нагрузки UploadGraph: упаковывает граф в бинарный формат.
-std::vector<uint8_t> serializeUploadGraph(const UploadGraphPayload& payload);
+std::vector<uint8_t> serializeUploadGraph(const UploadGraphPayload& payload, ProtocolVersion version);
 
 // Десериализация полезной нагрузки UploadGraph: восстанавливает граф из бинарного формата.
 // В случае ошибки записывает описание в параметр error.
-bool deserializeUploadGraph(const std::vector<uint8_t>& buffer, UploadGraphPayload& payload, std::string& error);
+bool deserializeUploadGraph(const std::vector<uint8_t>& buffer,
+                            ProtocolVersion version,
+                            UploadGraphPayload& payload,
+                            std::string& error);
+
+// Сериализация полезной нагрузки UploadEdgeList: упаковывает список рёбер в бинарный формат.
+std::vector<uint8_t> serializeUploadEdgeList(const UploadEdgeListPayload& payload, ProtocolVersion version);
+
+// Десериализация полезной нагрузки UploadEdgeList: восстанавливает список рёбер из бинарного формата.
+// В случае ошибки записывает описание в параметр error.
+bool deserializeUploadEdgeList(const std::vector<uint8_t>& buffer,
+                               ProtocolVersion version,
+                               UploadEdgeListPayload& payload,
+                               std::string& error);
+
+// Разбиение полезной нагрузки сообщения command на фрагменты по kChunkDataSize байт.
+std::vector<ChunkPayload> splitIntoChunks(Command command, const std::vector<uint8_t>& payload);
+
+// Сериализация полезной нагрузки Chunk.
+std::vector<uint8_t> serializeChunk(const ChunkPayload& payload);
+
+// Десериализация полезной нагрузки Chunk: проверяет номер фрагмента и соответствие размера данных
+// его положению в сообщении. В случае ошибки записывает описание в параметр error.
+bool deserializeChunk(const std::vector<uint8_t>& buffer, ChunkPayload& payload, std::string& error);
+
+// Сериализация полезной нагрузки ChunkAck.
+std::vector<uint8_t> serializeChunkAck(const ChunkAckPayload& payload);
+
+// Десериализация полезной нагрузки ChunkAck.
+bool deserializeChunkAck(const std::vector<uint8_t>& buffer, ChunkAckPayload& payload);
 
 // Сериализация PathQuery
-std::vector<uint8_t> serializePathQuery(const PathQueryPayload& payload);
+std::vector<uint8_t> serializePathQuery(const PathQueryPayload& payload, ProtocolVersion version);
 
 // Десериализация PathQuery: восстанавливает запрос пути из бинарного формата.
-bool deserializePathQuery(const std::vector<uint8_t>& buffer, PathQueryPayload& payload);
+bool deserializePathQuery(const std::vector<uint8_t>& buffer, ProtocolVersion version, PathQueryPayload& payload);
 
 // Сериализация полезной нагрузки PathResult: упаковывает результат поиска пути в бинарный формат.
-std::vector<uint8_t> serializePathResult(const PathResultPayload& payload);
+std::vector<uint8_t> serializePathResult(const PathResultPayload& payload, ProtocolVersion version);
 
 // Десериализация полезной нагрузки PathResult: восстанавливает результат из бинарного формата.
 // В случае ошибки записывает описание в параметр error.
-bool deserializePathResult(const std::vector<uint8_t>& buffer, PathResultPayload& payload, std::string& error);
+bool deserializePathResult(const std::vector<uint8_t>& buffer,
+                           ProtocolVersion version,
+                           PathResultPayload& payload,
+                           std::string& error);
+
+// Сериализация полезной нагрузки BatchPathQuery.
+std::vector<uint8_t> serializeBatchPathQuery(const BatchPathQueryPayload& payload, ProtocolVersion version);
+
+// Десериализация полезной нагрузки BatchPathQuery. В случае ошибки записывает описание в параметр error.
+bool deserializeBatchPathQuery(const std::vector<uint8_t>& buffer,
+                               ProtocolVersion version,
+                               BatchPathQueryPayload& payload,
+                               std::string& error);
+
+// Сериализация результатов пакетного запроса в части BatchPathResult размером не более maxPartSize
+// байт каждая (часть с единственным результатом может быть больше, если путь очень длинный).
+std::vector<std::vector<uint8_t>> serializeBatchPathResults(const std::vector<BatchPathEntry>& entries,
+                                                            ProtocolVersion version,
+                                                            std::size_t maxPartSize);
+
+// Десериализация одной части BatchPathResult. В случае ошибки записывает описание в параметр error.
+bool deserializeBatchPathResult(const std::vector<uint8_t>& buffer,
+                                ProtocolVersion version,
+                                BatchPathResultPayload& payload,
+                                std::string& error);
+
+// Сериализация полезной нагрузки DistanceVector.
+std::vector<uint8_t> serializeDistanceVectorQuery(const DistanceVectorQueryPayload& payload,
+                                                  ProtocolVersion version);
+
+// Десериализация полезной нагрузки DistanceVector. Возвращает false при неверном размере буфера.
+bool deserializeDistanceVectorQuery(const std::vector<uint8_t>& buffer,
+                                    ProtocolVersion version,
+                                    DistanceVectorQueryPayload& payload);
+
+// Сериализация вектора расстояний (firstVertex = 0, все вершины графа) в части DistanceVectorResult
+// размером не более maxPartSize байт каждая.
+std::vector<std::vector<uint8_t>> serializeDistanceVector(const DistanceVectorPayload& payload,
+                                                          ProtocolVersion version,
+                                                          std::size_t maxPartSize);
+
+// Десериализация одной части DistanceVectorResult. В случае ошибки записывает описание в параметр error.
+bool deserializeDistanceVectorPart(const std::vector<uint8_t>& buffer,
+                                   ProtocolVersion version,
+                                   DistanceVectorPayload& payload,
+                                   std::string& error);
+
+// Сериализация полезной нагрузки DistanceTable.
+std::vector<uint8_t> serializeDistanceTableQuery(const DistanceTableQueryPayload& payload,
+                                                 ProtocolVersion version);
+
+// Десериализация полезной нагрузки DistanceTable. В случае ошибки записывает описание в параметр error.
+bool deserializeDistanceTableQuery(const std::vector<uint8_t>& buffer,
+                                   ProtocolVersion version,
+                                   DistanceTableQueryPayload& payload,
+                                   std::string& error);
+
+// Сериализация таблицы расстояний (firstCell = 0, все ячейки) в части DistanceTableResult размером
+// не более maxPartSize байт каждая.
+std::vector<std::vector<uint8_t>> serializeDistanceTable(const DistanceTablePayload& payload,
+                                                         std::size_t maxPartSize);
+
+// Десериализация одной части DistanceTableResult. В случае ошибки записывает описание в параметр error.
+bool deserializeDistanceTablePart(const std::vector<uint8_t>& buffer,
+                                  DistanceTablePayload& payload,
+                                  std::string& error);
 
 // Утилита для упаковки строки в полезную нагрузку (используется для ошибок и help).
 // Формат: 2 байта (длина строки) + байты строки.
@@ -96,19 +356,6 @@ std::vector<uint8_t> serializeString(const std::string& text);
 // Десериализация строки из полезной нагрузки.
 bool deserializeString(const std::vector<uint8_t>& buffer, std::string& text);
 
-// Раскодировка матрицы инцидентности: преобразует битовую последовательность в двумерную матрицу.
-// Каждый бит соответствует элементу матрицы (1 - есть связь, 0 - нет связи).
-// В случае ошибки записывает описание в параметр error.
-bool unpackIncidenceMatrix(uint16_t vertexCount,
-                           uint16_t edgeCount,
-                           const std::vector<uint8_t>& bits,
-                           std::vector<std::vector<int>>& matrix,
-                           std::string& error);
-
-// Упаковка матрицы инцидентности в битовый массив для компактной передачи.
-// Каждый элемент матрицы кодируется одним битом (1 - есть связь, 0 - нет связи).
-std::vector<uint8_t> packIncidenceMatrix(const std::vector<std::vector<int>>& matrix);
-
 }  // namespace netproto
 
 
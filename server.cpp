@@ -1,16 +1,30 @@
 // Серверная часть приложения: приём графов от клиентов и вычисление кратчайших путей.
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
 #include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <list>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <optional>
-#include <sstream>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -23,11 +37,335 @@ namespace {
 
 constexpr int kListenBacklog = 16;
 
-enum class Transport { Tcp, Udp };
+// Максимальное количество одновременно обрабатываемых запросов одного TCP-соединения (конвейер).
+// Следующие запросы не читаются из сокета, пока не завершится один из выполняемых.
+constexpr std::size_t kMaxPipelinedRequests = 64;
+
+// Размер блока, которым поток TCP-клиента читает полезную нагрузку запроса.
+constexpr std::size_t kTcpReadChunk = 65536;
+
+// Максимальный размер части ответа BatchPathResult для TCP. Для UDP часть ограничена размером
+// датаграммы без IP-фрагментации (kChunkDatagramSize).
+constexpr std::size_t kTcpResponsePartSize = 65536;
+constexpr std::size_t kUdpResponsePartSize = netproto::kChunkDatagramSize - netproto::kHeaderSize;
+
+// Параметры цикла событий epoll: количество событий за один вызов epoll_wait
+// и размер блока, которым читаются данные из сокета.
+constexpr int kMaxEpollEvents = 256;
+constexpr std::size_t kEpollReadChunk = 16384;
+
+// Размер буфера чтения соединения epoll, после которого чтение приостанавливается до извлечения
+// запросов из буфера. Вмещает любой запрос, кроме загрузки графа (наибольшие - пакетный запрос путей
+// и таблица расстояний, около 512 КБ): буфер растёт сверх предела только до размера загрузки графа,
+// объявленного в заголовке первого сообщения буфера, а после её извлечения ёмкость освобождается.
+// Запрос другой команды больше предела считается некорректным, и соединение закрывается.
+constexpr std::size_t kEpollReadBufferLimit = 1 << 20;
+
+// Объём неотправленных ответов соединения epoll, после которого новые запросы не передаются в пул,
+// пока клиент не прочитает ответы (тогда останавливается и чтение, см. kEpollReadBufferLimit).
+// Ёмкость буфера записи больше этого объёма освобождается после отправки всех ответов.
+constexpr std::size_t kEpollWriteBufferLimit = 4 << 20;
+
+// Ёмкость очереди задач UDP-сервера с пулом потоков. При переполнении запрос отклоняется
+// сразу, чтобы поток приёма не блокировался и продолжал отправлять ACK другим клиентам.
+constexpr std::size_t kUdpQueueCapacity = 4096;
+
+// Размер буфера приёма одной UDP-датаграммы и количество датаграмм, принимаемых и отправляемых
+// за один системный вызов recvmmsg/sendmmsg по умолчанию.
+constexpr std::size_t kUdpDatagramBufferSize = 65536;
+constexpr std::size_t kDefaultUdpBatchSize = 32;
+constexpr std::size_t kMaxUdpBatchSize = 256;
+constexpr std::size_t kMaxUdpShards = 256;
+
+// Номер запроса пути к одному графу, на котором строится иерархия сжатия.
+// Первые запросы обслуживаются обычным поиском, чтобы не тратить время на предобработку
+// графов, к которым обращаются лишь несколько раз.
+constexpr uint32_t kHierarchyQueryThreshold = 8;
+
+// Бюджет памяти кэша деревьев кратчайших путей одного клиента (массивы dist и parent всех деревьев).
+constexpr std::size_t kTreeCacheBudget = 8 << 20;
+
+// Количество последних промахов кэша деревьев, которые запоминаются: запрос пути строит полное дерево
+// только для начальной вершины, уже промахнувшейся недавно, а одиночные запросы идут обычным поиском.
+constexpr std::size_t kTreeCacheMissHistory = 64;
+
+// Наибольшее объявленное количество вершин графа, для которого выполняется запрос вектора расстояний:
+// ответ содержит запись для каждой вершины, поэтому для больших графов используются запросы пути
+// и таблицы расстояний.
+constexpr uint32_t kMaxDistanceVectorVertices = 1 << 24;
+
+// Ограничения на сборку фрагментированных UDP-сообщений одного клиента: количество одновременно
+// собираемых сообщений и время, после которого незавершённая сборка считается брошенной.
+constexpr std::size_t kMaxPendingAssemblies = 4;
+constexpr std::chrono::seconds kAssemblyTimeout{30};
+
+// Суммарный объём принятых данных незавершённых сборок всех клиентов одного шарда UDP-сервера:
+// вмещает две сборки наибольшего размера. Фрагмент, превышающий предел, отклоняется вместе со сборкой.
+constexpr std::size_t kMaxShardAssemblyBytes = 2 * static_cast<std::size_t>(netproto::kMaxPayloadSize);
+
+// Период, с которым поток приёма UDP удаляет брошенные сборки и неактивных клиентов шарда
+// (в том числе клиентов, которые больше не присылают датаграмм).
+constexpr std::chrono::seconds kUdpSweepInterval{5};
+
+// Время без датаграмм, после которого UDP-клиент (его граф, иерархия, кэши) удаляется из таблицы
+// клиентов шарда: UDP не сообщает о завершении сеанса, если клиент не отправил Exit.
+constexpr std::chrono::minutes kUdpClientIdleTimeout{10};
+
+// Количество последних собранных сообщений, повторные фрагменты которых подтверждаются без обработки.
+constexpr std::size_t kCompletedAssemblyHistory = 16;
+
+// Количество последних ответов UDP-клиенту, которые хранятся для повторной отправки: клиент повторяет
+// запрос с тем же requestId, если ответ потерян, и получает сохранённый ответ без повторного вычисления.
+constexpr std::size_t kResponseCacheSize = 8;
+
+// Время, в течение которого сервер с пулом потоков откладывает отдельный ACK на запрос с флагом
+// kFlagPiggybackAck: если ответ готов раньше, он заменяет ACK, иначе по истечении срока отправляется ACK.
+constexpr std::chrono::microseconds kPiggybackAckDelay{2000};
+
+enum class Transport { Tcp, TcpEpoll, Udp };
+
+// Параметры запуска сервера.
+struct ServerConfig {
+    Transport transport = Transport::Tcp;
+    uint16_t port = 0;
+    std::size_t workerCount = 0;  // Размер пула потоков (0 - не задан параметром --workers)
+    std::size_t udpBatchSize = kDefaultUdpBatchSize;  // Датаграмм за один recvmmsg/sendmmsg
+    std::size_t udpShardCount = 1;                    // Сокетов UDP с SO_REUSEPORT (потоков приёма)
+};
+
+// Сборка сообщения, переданного по UDP фрагментами (команда Chunk). Фрагменты хранятся по номеру
+// и склеиваются только после приёма всех, поэтому память занимают лишь реально принятые данные,
+// а не объявленный в первом фрагменте размер сообщения.
+struct ChunkAssembly {
+    netproto::Command command = netproto::Command::Help;  // Команда собираемого сообщения
+    uint16_t count = 0;                                   // Общее количество фрагментов
+    uint32_t totalSize = 0;                               // Размер собранной полезной нагрузки
+    std::map<uint16_t, std::vector<uint8_t>> chunks;      // Данные принятых фрагментов по номеру
+    std::size_t bytes = 0;                                // Суммарный размер данных chunks
+    std::chrono::steady_clock::time_point lastUpdate;
+};
+
+// Сохранённый ответ на запрос UDP-клиента (одна или несколько частей с общим заголовком).
+struct CachedResponse {
+    uint16_t requestId = 0;
+    netproto::Command requestCommand = netproto::Command::Help;  // Команда запроса (защита от совпадения requestId)
+    netproto::MessageHeader header{};
+    std::vector<std::vector<uint8_t>> payloads;
+};
+
+// LRU-кэш деревьев кратчайших путей графа клиента, ключ - начальная вершина. Суммарный размер деревьев
+// не превышает kTreeCacheBudget байт: при переполнении вытесняются деревья, к которым дольше всего
+// не обращались. Выданное дерево остаётся действительным после вытеснения (shared_ptr).
+// Защищён собственным мьютексом: запросы TCP-соединения выполняются параллельно.
+class ShortestPathTreeCache {
+public:
+    // Поиск дерева с корнем source с учётом попаданий и промахов. При промахе repeatedMiss
+    // сообщает, промахивалась ли source среди последних kTreeCacheMissHistory промахов.
+    std::shared_ptr<const graph::ShortestPathTree> find(graph::VertexId source, bool& repeatedMiss) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(source);
+        if (it != index_.end()) {
+            ++hits_;
+            lru_.splice(lru_.begin(), lru_, it->second);
+            repeatedMiss = false;
+            return *it->second;
+        }
+        ++misses_;
+        repeatedMiss = std::find(recentMisses_.begin(), recentMisses_.end(), source) != recentMisses_.end();
+        recentMisses_.push_back(source);
+        if (recentMisses_.size() > kTreeCacheMissHistory) {
+            recentMisses_.pop_front();
+        }
+        return nullptr;
+    }
+
+    // Добавление дерева в кэш с вытеснением давно не использованных деревьев. Дерево больше
+    // бюджета не сохраняется.
+    void insert(std::shared_ptr<const graph::ShortestPathTree> tree) {
+        const std::size_t size = tree->memoryUsage();
+        if (size > kTreeCacheBudget) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(tree->source) != 0) {
+            return;
+        }
+        while (bytes_ + size > kTreeCacheBudget) {
+            bytes_ -= lru_.back()->memoryUsage();
+            index_.erase(lru_.back()->source);
+            lru_.pop_back();
+        }
+        lru_.push_front(std::move(tree));
+        index_[lru_.front()->source] = lru_.begin();
+        bytes_ += size;
+    }
+
+    // Сброс кэша при загрузке нового графа (счётчики сохраняются).
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        recentMisses_.clear();
+        bytes_ = 0;
+    }
+
+    std::pair<uint64_t, uint64_t> stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return {hits_, misses_};
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::list<std::shared_ptr<const graph::ShortestPathTree>> lru_;  // Начало списка - последнее обращение
+    std::unordered_map<graph::VertexId, std::list<std::shared_ptr<const graph::ShortestPathTree>>::iterator> index_;
+    std::deque<graph::VertexId> recentMisses_;
+    std::size_t bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// Иерархия сжатия графа клиента. Строится в фоне задачей пула ClientContext::builder и публикуется
+// в hierarchy, когда готова; до этого запросы используют алгоритм, выбранный при загрузке.
+// Создаётся заново при каждой загрузке графа, поэтому построение для прежнего графа, завершившееся
+// после загрузки нового, не влияет на новый граф. Поля защищены mutex: запросы пути TCP-соединения
+// выполняются параллельно.
+struct HierarchyState {
+    std::mutex mutex;
+    std::shared_ptr<const graph::ContractionHierarchy> hierarchy;
+    bool attempted = false;   // Построение уже запущено для этого графа
+    uint32_t queryCount = 0;  // Количество запросов пути к графу
+};
+
+// Состояние клиента: граф хранится в виде списков смежности, построенных при загрузке,
+// чтобы запросы пути не обращались к матрице инцидентности.
+// В UDP-сервере с пулом потоков mutex удерживается на время обработки запроса, поэтому запросы
+// одного клиента не выполняются параллельно; сборка фрагментов (assemblies, completedAssemblies)
+// выполняется только потоком приёма и мьютексом не защищается. Кэш ответов заполняется потоками
+// обработки и читается потоком приёма, поэтому защищён отдельным responseCacheMutex, который
+// (в отличие от mutex) не удерживается во время вычислений.
+class WorkerPool;
 
 struct ClientContext {
-    graph::GraphDefinition graph;
-    bool hasGraph = false;
+    std::mutex mutex;
+    WorkerPool* pool = nullptr;     // Пул, с которым делятся пакетные запросы (nullptr: только текущий поток)
+    WorkerPool* builder = nullptr;  // Пул, в котором в фоне строится иерархия сжатия
+    // Подготовлен при загрузке и не изменяется до следующей загрузки (nullptr, пока граф не загружен);
+    // shared_ptr позволяет фоновому построению иерархии пользоваться графом после его замены.
+    std::shared_ptr<const graph::PreparedGraph> graph;
+    std::shared_ptr<HierarchyState> hierarchy = std::make_shared<HierarchyState>();  // Иерархия текущего графа
+    ShortestPathTreeCache treeCache;  // Деревья кратчайших путей текущего графа по начальной вершине
+    std::unordered_map<uint16_t, ChunkAssembly> assemblies;  // Сборка UDP-фрагментов по requestId
+    std::deque<uint16_t> completedAssemblies;                // requestId недавно собранных сообщений
+    std::mutex responseCacheMutex;
+    std::deque<CachedResponse> responseCache;  // Последние ответы UDP-клиенту
+    std::vector<uint16_t> pendingRequests;     // requestId запросов, ответ на которые ещё вычисляется
+    std::chrono::steady_clock::time_point lastActivity;  // Время последней датаграммы UDP-клиента
+};
+
+// Пул потоков фиксированного размера: задачи выполняются в порядке постановки в очередь.
+// Количество потоков не зависит от количества клиентов. Очередь может быть ограничена
+// (capacity > 0): тогда submit не ставит задачу в заполненную очередь и возвращает false.
+class WorkerPool {
+public:
+    explicit WorkerPool(std::size_t threadCount, std::size_t capacity = 0) : capacity_(capacity) {
+        for (std::size_t i = 0; i < threadCount; ++i) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        available_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    bool submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (capacity_ > 0 && tasks_.size() >= capacity_) {
+                return false;
+            }
+            tasks_.push_back(std::move(task));
+        }
+        available_.notify_one();
+        return true;
+    }
+
+    // Разделение работы: task(i) для всех i из [0, count) выполняют вызывающий поток и потоки пула,
+    // свободные к этому моменту. Индексы раздаются через атомарный счётчик, поэтому долгие задачи
+    // не задерживают остальные. Вызывающий поток сам берёт индексы, пока они есть, поэтому вызов
+    // завершается и из задачи пула, и при занятых потоках; помощник, запущенный после раздачи всех
+    // индексов, сразу завершается, не обращаясь к task.
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& task) {
+        struct Split {
+            std::atomic<std::size_t> next{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::size_t helpers = 0;  // Помощники, которые сейчас выполняют task
+        };
+        auto split = std::make_shared<Split>();
+        const std::function<void(std::size_t)>* shared = &task;
+        const std::size_t helperCount = count > 0 ? std::min(count - 1, threads_.size()) : 0;
+        for (std::size_t i = 0; i < helperCount; ++i) {
+            const bool queued = submit([split, shared, count] {
+                {
+                    std::lock_guard<std::mutex> lock(split->mutex);
+                    if (split->next.load() >= count) {
+                        return;
+                    }
+                    ++split->helpers;
+                }
+                for (std::size_t index = split->next++; index < count; index = split->next++) {
+                    (*shared)(index);
+                }
+                {
+                    std::lock_guard<std::mutex> lock(split->mutex);
+                    --split->helpers;
+                }
+                split->finished.notify_all();
+            });
+            if (!queued) {
+                break;
+            }
+        }
+        for (std::size_t index = split->next++; index < count; index = split->next++) {
+            task(index);
+        }
+        std::unique_lock<std::mutex> lock(split->mutex);
+        split->finished.wait(lock, [&split] { return split->helpers == 0; });
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    const std::size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable available_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
 };
 
 // Построение текста справки: возвращает строку с описанием доступных команд сервера.
@@ -35,7 +373,11 @@ std::string buildHelpText() {
     return "Команды:\n"
            "  help            - получить список команд\n"
            "  upload_graph    - загрузить граф (матрица инцидентности + веса)\n"
+           "  upload_edges    - загрузить граф (список рёбер: u, v, вес)\n"
            "  path_query      - найти кратчайший путь между вершинами\n"
+           "  batch_path_query - найти кратчайшие пути для списка пар вершин\n"
+           "  distance_vector - найти расстояния от вершины до всех вершин графа\n"
+           "  distance_table  - найти таблицу расстояний между двумя списками вершин\n"
            "  exit            - завершить соединение клиента\n"
            "Нумерация вершин начинается с 0.\n";
 }
@@ -56,37 +398,194 @@ std::vector<uint8_t> makeOkStringPayload(const std::string& message,
     return netproto::serializeString(message);
 }
 
-// Декодирование полезной нагрузки графа: десериализует граф из бинарного формата и выполняет валидацию.
+// Распаковка матрицы инцидентности из битового массива протокола (построчно: сначала все рёбра первой
+// вершины, затем второй и т.д.) в матрицу модуля graph, хранящуюся по столбцам.
+// Каждый бит соответствует элементу матрицы: 1 - есть связь вершины с ребром, 0 - нет связи.
+// Нулевые байты пропускаются целиком, поэтому время распаковки разреженной матрицы определяется
+// размером битового массива, а не количеством элементов.
+// Проверяет корректность размера битового массива. В случае ошибки записывает описание в параметр error.
+bool unpackIncidenceMatrix(const netproto::UploadGraphPayload& encoded,
+                           graph::IncidenceMatrix& matrix,
+                           std::string& error) {
+    const uint32_t vertexCount = encoded.vertexCount;
+    const uint32_t edgeCount = encoded.edgeCount;
+    const std::vector<uint8_t>& bits = encoded.incidenceBits;
+    if (vertexCount == 0 || edgeCount == 0) {
+        error = "Пустая матрица.";
+        return false;
+    }
+    const std::size_t totalBits = static_cast<std::size_t>(vertexCount) * edgeCount;
+    const std::size_t expectedBytes = (totalBits + 7) / 8;
+    if (bits.size() != expectedBytes) {
+        error = "Несоответствие размера битового массива матрице.";
+        return false;
+    }
+    matrix.reset(vertexCount, edgeCount);
+    for (std::size_t byteIndex = 0; byteIndex < bits.size(); ++byteIndex) {
+        for (unsigned byte = bits[byteIndex]; byte != 0; byte &= byte - 1) {
+            const std::size_t bitIndex = byteIndex * 8 + static_cast<std::size_t>(__builtin_ctz(byte));
+            if (bitIndex >= totalBits) {
+                break;
+            }
+            matrix.set(static_cast<uint32_t>(bitIndex / edgeCount), static_cast<uint32_t>(bitIndex % edgeCount));
+        }
+    }
+    return true;
+}
+
+// Декодирование полезной нагрузки графа: десериализует граф из бинарного формата и подготавливает его
+// к запросам (валидация и построение списков смежности за один проход по столбцам матрицы).
 // Возвращает nullopt при ошибке десериализации или валидации, записывая описание в errorMessage.
-std::optional<graph::GraphDefinition> decodeGraphPayload(
+std::optional<graph::PreparedGraph> decodeGraphPayload(
     const std::vector<uint8_t>& payload,
+    netproto::ProtocolVersion version,
     std::string& errorMessage) {
     netproto::UploadGraphPayload encoded;
-    if (!netproto::deserializeUploadGraph(payload, encoded, errorMessage)) {
+    if (!netproto::deserializeUploadGraph(payload, version, encoded, errorMessage)) {
         return std::nullopt;
     }
     graph::GraphDefinition definition;
     definition.vertexCount = encoded.vertexCount;
     definition.edgeCount = encoded.edgeCount;
     definition.weights = encoded.weights;
-    if (!netproto::unpackIncidenceMatrix(encoded.vertexCount,
-                                         encoded.edgeCount,
-                                         encoded.incidenceBits,
-                                         definition.incidence,
-                                         errorMessage)) {
+    if (!unpackIncidenceMatrix(encoded, definition.incidence, errorMessage)) {
+        return std::nullopt;
+    }
+    graph::PreparedGraph prepared;
+    if (!graph::prepareGraph(definition, prepared, errorMessage)) {
         return std::nullopt;
     }
-    graph::ValidationResult validation = graph::validateGraph(definition);
-    if (!validation.ok) {
-        errorMessage = validation.message;
+    return std::make_optional(std::move(prepared));
+}
+
+// Декодирование полезной нагрузки со списком рёбер: десериализует рёбра и подготавливает граф
+// напрямую, без промежуточной матрицы инцидентности.
+// Возвращает nullopt при ошибке десериализации или валидации, записывая описание в errorMessage.
+std::optional<graph::PreparedGraph> decodeEdgeListPayload(
+    const std::vector<uint8_t>& payload,
+    netproto::ProtocolVersion version,
+    std::string& errorMessage) {
+    netproto::UploadEdgeListPayload encoded;
+    if (!netproto::deserializeUploadEdgeList(payload, version, encoded, errorMessage)) {
+        return std::nullopt;
+    }
+    std::vector<graph::Edge> edges;
+    edges.reserve(encoded.edges.size());
+    for (const netproto::EdgeRecord& edge : encoded.edges) {
+        edges.emplace_back(edge.u, edge.v, edge.weight);
+    }
+    graph::PreparedGraph prepared;
+    if (!graph::prepareGraph(encoded.vertexCount, edges, prepared, errorMessage)) {
         return std::nullopt;
     }
-    return std::make_optional(definition);
+    return std::make_optional(std::move(prepared));
+}
+
+// Сохранение подготовленного графа в контексте клиента (алгоритм поиска уже выбран при подготовке
+// по диапазону весов). Иерархия сжатия и деревья кратчайших путей предыдущего графа сбрасываются.
+void storeGraph(ClientContext& context, graph::PreparedGraph prepared) {
+    context.graph = std::make_shared<const graph::PreparedGraph>(std::move(prepared));
+    context.hierarchy = std::make_shared<HierarchyState>();
+    context.treeCache.clear();
+}
+
+// Иерархия сжатия графа клиента для queries новых запросов пути. Когда количество запросов к одному
+// графу достигает kHierarchyQueryThreshold, построение иерархии передаётся в пул context.builder,
+// а запрос сразу получает текущее состояние: nullptr, пока иерархия не построена (или если граф
+// не поддаётся сжатию), и тогда используется алгоритм, выбранный при загрузке. Поэтому построение,
+// занимающее на больших графах секунды, не задерживает ни этот запрос, ни поток приёма UDP,
+// ни другие запросы. Если очередь пула заполнена, построение запускается одним из следующих запросов.
+std::shared_ptr<const graph::ContractionHierarchy> acquireHierarchy(ClientContext& context, uint32_t queries) {
+    const std::shared_ptr<HierarchyState> state = context.hierarchy;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->queryCount += queries;
+    if (!state->attempted && state->queryCount >= kHierarchyQueryThreshold && context.builder) {
+        state->attempted = context.builder->submit([state, graph = context.graph] {
+            graph::ContractionHierarchy built;
+            if (!graph::buildContractionHierarchy(*graph, built)) {
+                return;
+            }
+            auto hierarchy = std::make_shared<const graph::ContractionHierarchy>(std::move(built));
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->hierarchy = std::move(hierarchy);
+        });
+    }
+    return state->hierarchy;
+}
+
+// Построение дерева кратчайших путей от source и сохранение его в кэше клиента.
+std::shared_ptr<const graph::ShortestPathTree> buildCachedTree(ClientContext& context, graph::VertexId source) {
+    auto tree = std::make_shared<graph::ShortestPathTree>();
+    graph::buildShortestPathTree(*context.graph, source, *tree);
+    context.treeCache.insert(tree);
+    return tree;
+}
+
+// Дерево кратчайших путей от source из кэша клиента; при промахе дерево строится и сохраняется в кэше.
+std::shared_ptr<const graph::ShortestPathTree> acquireTree(ClientContext& context, graph::VertexId source) {
+    bool repeatedMiss = false;
+    std::shared_ptr<const graph::ShortestPathTree> tree = context.treeCache.find(source, repeatedMiss);
+    return tree ? tree : buildCachedTree(context, source);
+}
+
+// Ответ без поиска для запроса пути, в котором участвует изолированная вершина или вершины из
+// разных компонент связности: путь существует только из вершины в неё саму.
+graph::PathComputation trivialPath(graph::VertexId source, graph::VertexId target) {
+    graph::PathComputation result;
+    if (source == target) {
+        result.reachable = true;
+        result.path.push_back(source);
+        return result;
+    }
+    result.distance = graph::kUnreachable;
+    result.error = "Путь между вершинами не найден.";
+    return result;
+}
+
+// Вычисление кратчайшего пути во внутренней нумерации вершин (обе вершины входят в списки смежности).
+// Если дерево кратчайших путей от source есть в кэше, путь восстанавливается по нему за O(длины пути).
+// Если source недавно уже промахивалась, строится и кэшируется полное дерево. Иначе путь ищется
+// через иерархию сжатия, если она построена, или алгоритмом, выбранным при загрузке.
+graph::PathComputation computePath(ClientContext& context, graph::VertexId source, graph::VertexId target) {
+    bool repeatedMiss = false;
+    std::shared_ptr<const graph::ShortestPathTree> tree = context.treeCache.find(source, repeatedMiss);
+    if (!tree && repeatedMiss) {
+        tree = buildCachedTree(context, source);
+    }
+    if (tree) {
+        return graph::pathFromTree(*tree, target);
+    }
+    std::shared_ptr<const graph::ContractionHierarchy> hierarchy = acquireHierarchy(context, 1);
+    if (hierarchy) {
+        return graph::contractionHierarchyQuery(*hierarchy, source, target);
+    }
+    return graph::findShortestPath(*context.graph, source, target);
+}
+
+// Вычисление кратчайшего пути для клиента: номера вершин запроса переводятся во внутреннюю нумерацию,
+// найденный путь - обратно во внешнюю. Запросы с изолированной вершиной и вершины из разных
+// компонент связности отвечаются сразу, без поиска и без обращения к кэшу.
+graph::PathComputation answerPathQuery(ClientContext& context, const netproto::PathQueryPayload& query) {
+    if (!context.graph->contains(query.source) || !context.graph->contains(query.target)) {
+        graph::PathComputation outside;
+        outside.error = "Вершины выходят за границы графа.";
+        return outside;
+    }
+    const graph::VertexId source = context.graph->toInternal(query.source);
+    const graph::VertexId target = context.graph->toInternal(query.target);
+    if (source == graph::kIsolatedVertex || target == graph::kIsolatedVertex ||
+        !graph::sameComponent(*context.graph, source, target)) {
+        return trivialPath(query.source, query.target);
+    }
+    graph::PathComputation result = computePath(context, source, target);
+    context.graph->toExternal(result.path);
+    return result;
 }
 
 // Построение полезной нагрузки результата пути: формирует ответ с результатом поиска пути.
 // Если путь не найден, возвращает сообщение об ошибке. Иначе возвращает PathResult с длиной и маршрутом.
 std::vector<uint8_t> buildPathResultPayload(const graph::PathComputation& result,
+                                            netproto::ProtocolVersion version,
                                             netproto::MessageHeader& header) {
     if (!result.reachable) {
         header.command = netproto::Command::Error;
@@ -100,7 +599,15 @@ std::vector<uint8_t> buildPathResultPayload(const graph::PathComputation& result
     netproto::PathResultPayload payload;
     payload.distance = result.distance;
     payload.path = result.path;
-    return netproto::serializePathResult(payload);
+    return netproto::serializePathResult(payload, version);
+}
+
+// Вывод статистики кэша деревьев кратчайших путей клиента при завершении соединения.
+void logTreeCacheStats(const ClientContext& context) {
+    const auto [hits, misses] = context.treeCache.stats();
+    if (hits + misses > 0) {
+        std::cout << "Кэш деревьев кратчайших путей: попаданий " << hits << ", промахов " << misses << ".\n";
+    }
 }
 
 // Приём точного количества байтов через TCP-сокет: гарантирует получение всех запрошенных байтов.
@@ -137,24 +644,19 @@ bool sendAll(int socket, const uint8_t* data, size_t size) {
     return true;
 }
 
-// Отправка TCP-сообщения: отправляет заголовок и полезную нагрузку через TCP-сокет.
-// Устанавливает payloadSize в заголовке перед отправкой.
-bool sendTcpMessage(int socket,
-                    netproto::MessageHeader header,
-                    const std::vector<uint8_t>& payload) {
+// Сериализация сообщения целиком: заголовок (с установленным payloadSize) и полезная нагрузка.
+std::vector<uint8_t> serializeMessage(netproto::MessageHeader header, const std::vector<uint8_t>& payload) {
     header.payloadSize = static_cast<uint32_t>(payload.size());
-    std::vector<uint8_t> headerBuf = netproto::serializeHeader(header);
-    if (!sendAll(socket, headerBuf.data(), headerBuf.size())) {
-        return false;
-    }
-    if (!payload.empty()) {
-        return sendAll(socket, payload.data(), payload.size());
-    }
-    return true;
+    std::vector<uint8_t> message = netproto::serializeHeader(header);
+    message.reserve(message.size() + payload.size());
+    message.insert(message.end(), payload.begin(), payload.end());
+    return message;
 }
 
 // Чтение TCP-сообщения: получает заголовок и полезную нагрузку из TCP-сокета.
-// Сначала читает заголовок фиксированного размера, затем полезную нагрузку указанного размера.
+// Сначала читает заголовок фиксированного размера, затем полезную нагрузку указанного размера
+// блоками по kTcpReadChunk байт: буфер растёт по мере прихода данных, поэтому заголовок
+// с большим payloadSize без самих данных не заставляет сервер выделять память под всё сообщение.
 bool readTcpMessage(int socket, netproto::MessageHeader& header, std::vector<uint8_t>& payload) {
     std::vector<uint8_t> headerBuf(netproto::kHeaderSize);
     if (!recvExact(socket, headerBuf.data(), headerBuf.size())) {
@@ -163,10 +665,14 @@ bool readTcpMessage(int socket, netproto::MessageHeader& header, std::vector<uin
     if (!netproto::deserializeHeader(headerBuf, header)) {
         return false;
     }
-    payload.resize(header.payloadSize);
-    if (header.payloadSize > 0 &&
-        !recvExact(socket, payload.data(), payload.size())) {
-        return false;
+    payload.clear();
+    while (payload.size() < header.payloadSize) {
+        const std::size_t used = payload.size();
+        const std::size_t block = std::min<std::size_t>(kTcpReadChunk, header.payloadSize - used);
+        payload.resize(used + block);
+        if (!recvExact(socket, payload.data() + used, block)) {
+            return false;
+        }
     }
     return true;
 }
@@ -182,11 +688,415 @@ netproto::MessageHeader makeHeader(netproto::Command cmd, netproto::Status statu
     return header;
 }
 
+// Выполнение task(i) для всех i из [0, count) для запроса клиента: работа делится с пулом потоков
+// сервера (WorkerPool::parallelFor), а без пула выполняется в текущем потоке. Новые потоки
+// не создаются, поэтому число потоков сервера задаётся только параметром --workers.
+void parallelFor(ClientContext& context, std::size_t count, const std::function<void(std::size_t)>& task) {
+    if (context.pool) {
+        context.pool->parallelFor(count, task);
+        return;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        task(i);
+    }
+}
+
+// Ответ на пакетный запрос путей. Пары группируются по начальной вершине: для группы из нескольких
+// пар берётся одно дерево кратчайших путей (из кэша или построенное), и пути до всех целей группы
+// восстанавливаются по нему; одиночная пара обрабатывается обычным запросом пути (computePath).
+// Группировка и поиск выполняются во внутренней нумерации вершин. Пары с изолированной вершиной
+// и пары из разных компонент связности отвечаются без поиска. Группы распределяются
+// между потоками пула сервера. Результаты возвращаются в порядке пар запроса.
+std::vector<netproto::BatchPathEntry> answerBatchPathQuery(ClientContext& context,
+                                                           const std::vector<netproto::PathQueryPayload>& queries) {
+    std::vector<netproto::BatchPathEntry> entries(queries.size());
+    std::vector<netproto::PathQueryPayload> internal(queries.size());  // Пары во внутренней нумерации
+    std::vector<uint32_t> order;
+    order.reserve(queries.size());
+    auto fill = [&context](netproto::BatchPathEntry& entry, graph::PathComputation computation) {
+        context.graph->toExternal(computation.path);
+        entry.status = computation.reachable ? netproto::Status::Ok : netproto::Status::NotReady;
+        entry.result.distance = computation.reachable ? computation.distance : 0;
+        entry.result.path = std::move(computation.path);
+    };
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+        const netproto::PathQueryPayload& query = queries[i];
+        if (!context.graph->contains(query.source) || !context.graph->contains(query.target)) {
+            entries[i].status = netproto::Status::InvalidRequest;
+            entries[i].result.distance = 0;
+            continue;
+        }
+        internal[i].source = context.graph->toInternal(query.source);
+        internal[i].target = context.graph->toInternal(query.target);
+        if (internal[i].source == graph::kIsolatedVertex || internal[i].target == graph::kIsolatedVertex ||
+            !graph::sameComponent(*context.graph, internal[i].source, internal[i].target)) {
+            const graph::PathComputation trivial = trivialPath(query.source, query.target);
+            entries[i].status = trivial.reachable ? netproto::Status::Ok : netproto::Status::NotReady;
+            entries[i].result.distance = 0;
+            entries[i].result.path = trivial.path;
+            continue;
+        }
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&internal](uint32_t a, uint32_t b) {
+        return internal[a].source < internal[b].source;
+    });
+    std::vector<std::size_t> groupStarts;
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        if (i == 0 || internal[order[i]].source != internal[order[i - 1]].source) {
+            groupStarts.push_back(i);
+        }
+    }
+    groupStarts.push_back(order.size());
+
+    parallelFor(context, groupStarts.size() - 1, [&](std::size_t group) {
+        const std::size_t begin = groupStarts[group];
+        const std::size_t end = groupStarts[group + 1];
+        if (end - begin == 1) {
+            const netproto::PathQueryPayload& query = internal[order[begin]];
+            fill(entries[order[begin]], computePath(context, query.source, query.target));
+            return;
+        }
+        std::shared_ptr<const graph::ShortestPathTree> tree = acquireTree(context, internal[order[begin]].source);
+        for (std::size_t i = begin; i < end; ++i) {
+            fill(entries[order[i]], graph::pathFromTree(*tree, internal[order[i]].target));
+        }
+    });
+    return entries;
+}
+
+// Ответ на запрос вектора расстояний: одно дерево кратчайших путей от source (из кэша или построенное)
+// вместо запроса пути до каждой вершины. Дерево покрывает только компоненту связности source, поэтому
+// просматриваются только её вершины; расстояния и предшественники переводятся во внешнюю нумерацию.
+// Остальные вершины недостижимы, для изолированной source дерево не строится.
+// Вершина source должна входить в граф.
+netproto::DistanceVectorPayload answerDistanceVector(ClientContext& context,
+                                                     const netproto::DistanceVectorQueryPayload& query) {
+    netproto::DistanceVectorPayload result;
+    result.vertexCount = context.graph->vertexCount();
+    result.firstVertex = 0;
+    result.includeParents = query.includeParents;
+    result.dist.assign(result.vertexCount, netproto::kUnreachableDistance);
+    if (query.includeParents) {
+        result.parent.assign(result.vertexCount, netproto::kNoParent);
+    }
+    const graph::VertexId source = context.graph->toInternal(query.source);
+    if (source == graph::kIsolatedVertex) {
+        result.dist[query.source] = 0;
+        return result;
+    }
+    std::shared_ptr<const graph::ShortestPathTree> tree = acquireTree(context, source);
+    for (uint32_t i = 0; i < tree->dist.size(); ++i) {
+        if (tree->dist[i] == graph::kUnreachable) {
+            continue;
+        }
+        const graph::VertexId v = tree->first + i;
+        const graph::VertexId external = context.graph->toExternal(v);
+        result.dist[external] = tree->dist[i];
+        const graph::VertexId parent = tree->parentOf(v);
+        if (query.includeParents && parent != graph::kNoTreeParent) {
+            result.parent[external] = context.graph->toExternal(parent);
+        }
+    }
+    return result;
+}
+
+// Ответ на запрос таблицы расстояний. Таблица засчитывается как sources x targets запросов пути,
+// поэтому большая таблица сразу запускает фоновое построение иерархии сжатия, но не ждёт его:
+// до публикации иерархии таблица вычисляется по деревьям кратчайших путей. По иерархии таблица
+// вычисляется алгоритмом many-to-many с корзинами: восходящие поиски из целей заполняют корзины
+// вершин, затем восходящие поиски из начальных вершин (параллельно потоками пула) просматривают корзины.
+// Если граф не поддаётся сжатию, для каждой начальной вершины берётся одно дерево кратчайших путей.
+// Поиск выполняется во внутренней нумерации только для вершин с рёбрами; ячейки строк и столбцов
+// изолированных вершин заполняются без поиска. Все вершины запроса должны входить в граф.
+netproto::DistanceTablePayload answerDistanceTable(ClientContext& context,
+                                                   const netproto::DistanceTableQueryPayload& query) {
+    const std::size_t targetCount = query.targets.size();
+    netproto::DistanceTablePayload table;
+    table.sourceCount = static_cast<uint16_t>(query.sources.size());
+    table.targetCount = static_cast<uint16_t>(targetCount);
+    table.firstCell = 0;
+    table.dist.assign(query.sources.size() * targetCount, netproto::kUnreachableDistance);
+
+    std::vector<graph::VertexId> targets;   // Цели с рёбрами во внутренней нумерации
+    std::vector<std::size_t> targetColumn;  // Столбец таблицы каждой такой цели
+    for (std::size_t j = 0; j < targetCount; ++j) {
+        const graph::VertexId target = context.graph->toInternal(query.targets[j]);
+        if (target != graph::kIsolatedVertex) {
+            targets.push_back(target);
+            targetColumn.push_back(j);
+        }
+    }
+
+    std::shared_ptr<const graph::ContractionHierarchy> hierarchy =
+        acquireHierarchy(context, static_cast<uint32_t>(table.dist.size()));
+    graph::TargetBuckets buckets;
+    if (hierarchy) {
+        graph::buildTargetBuckets(*hierarchy, targets, buckets);
+    }
+    parallelFor(context, query.sources.size(), [&](std::size_t i) {
+        const graph::VertexId source = context.graph->toInternal(query.sources[i]);
+        if (source == graph::kIsolatedVertex) {
+            for (std::size_t j = 0; j < targetCount; ++j) {
+                if (query.targets[j] == query.sources[i]) {
+                    table.dist[i * targetCount + j] = 0;
+                }
+            }
+            return;
+        }
+        std::vector<uint32_t> row;
+        if (hierarchy) {
+            row = graph::distanceTableRow(*hierarchy, buckets, source);
+        } else {
+            std::shared_ptr<const graph::ShortestPathTree> tree = acquireTree(context, source);
+            row.reserve(targets.size());
+            for (graph::VertexId target : targets) {
+                row.push_back(tree->distanceTo(target));
+            }
+        }
+        for (std::size_t k = 0; k < targets.size(); ++k) {
+            table.dist[i * targetCount + targetColumn[k]] =
+                row[k] >= graph::kUnreachable ? netproto::kUnreachableDistance : row[k];
+        }
+    });
+    return table;
+}
+
+// Запросы, заменяющие граф клиента. В конвейере TCP-соединения такой запрос начинается только после
+// завершения всех предыдущих запросов, а следующие запросы ждут его завершения, поэтому запросы
+// пути всегда видят граф, загруженный последним перед ними.
+bool replacesGraph(netproto::Command command) {
+    return command == netproto::Command::UploadGraph || command == netproto::Command::UploadEdgeList;
+}
+
+// Согласование версии формата: ответ передаётся в версии запроса, а на команду Help сервер отвечает
+// наибольшей общей версией. Биты версии записываются в responseHeader, только если они есть в запросе,
+// поэтому клиенты без поддержки версий получают ответы прежнего вида. Возвращает std::nullopt, если
+// версия запроса не поддерживается.
+std::optional<netproto::ProtocolVersion> negotiateVersion(const netproto::MessageHeader& requestHeader,
+                                                          netproto::MessageHeader& responseHeader) {
+    const uint8_t requested = netproto::protocolVersionNumber(requestHeader);
+    const uint8_t latest = static_cast<uint8_t>(netproto::kLatestProtocolVersion);
+    if (requested > latest && requestHeader.command != netproto::Command::Help) {
+        return std::nullopt;
+    }
+    const auto version = static_cast<netproto::ProtocolVersion>(std::min(requested, latest));
+    if ((requestHeader.reserved & netproto::kVersionMask) != 0) {
+        netproto::setProtocolVersion(responseHeader, version);
+    }
+    return version;
+}
+
+// Проверка, что номера вершин загруженного графа представимы в ответах версии version.
+bool graphFitsVersion(const ClientContext& context, netproto::ProtocolVersion version) {
+    return context.graph->vertexCount() <= netproto::maxVertexCount(version);
+}
+
+// Обработка запроса клиента, общая для TCP и UDP: выполняет команды Help, UploadGraph,
+// UploadEdgeList и PathQuery над контекстом клиента. Заполняет команду, статус и версию формата
+// в responseHeader и возвращает полезную нагрузку ответа. Команда Exit обрабатывается транспортным уровнем.
+std::vector<uint8_t> handleRequest(ClientContext& context,
+                                   const netproto::MessageHeader& requestHeader,
+                                   const std::vector<uint8_t>& payload,
+                                   netproto::MessageHeader& responseHeader) {
+    const std::optional<netproto::ProtocolVersion> version = negotiateVersion(requestHeader, responseHeader);
+    if (!version) {
+        return makeErrorPayload("Неподдерживаемая версия протокола.", responseHeader);
+    }
+    switch (requestHeader.command) {
+        case netproto::Command::Help: {
+            return makeOkStringPayload(buildHelpText(), responseHeader);
+        }
+        case netproto::Command::UploadGraph:
+        case netproto::Command::UploadEdgeList: {
+            std::string error;
+            auto prepared = requestHeader.command == netproto::Command::UploadGraph
+                                ? decodeGraphPayload(payload, *version, error)
+                                : decodeEdgeListPayload(payload, *version, error);
+            if (!prepared) {
+                return makeErrorPayload(error, responseHeader);
+            }
+            storeGraph(context, std::move(*prepared));
+            responseHeader.command = requestHeader.command;
+            responseHeader.status = netproto::Status::Ok;
+            return netproto::serializeString("Граф принят сервером.");
+        }
+        case netproto::Command::PathQuery: {
+            netproto::PathQueryPayload query{};
+            if (!netproto::deserializePathQuery(payload, *version, query)) {
+                return makeErrorPayload("Некорректная структура PathQuery.", responseHeader);
+            }
+            if (!context.graph) {
+                return makeErrorPayload("Граф не загружен. Используйте upload_graph.", responseHeader);
+            }
+            if (!graphFitsVersion(context, *version)) {
+                return makeErrorPayload("Граф слишком велик для этой версии протокола.", responseHeader);
+            }
+            graph::PathComputation computation = answerPathQuery(context, query);
+            return buildPathResultPayload(computation, *version, responseHeader);
+        }
+        default: {
+            return makeErrorPayload("Неизвестная команда.", responseHeader);
+        }
+    }
+}
+
+// Обработка запроса, ответ на который может состоять из нескольких сообщений: ответы на
+// BatchPathQuery, DistanceVector и DistanceTable делятся на части (BatchPathResult,
+// DistanceVectorResult, DistanceTableResult) размером не более maxPartSize байт (все части
+// передаются с заголовком responseHeader), остальные команды обрабатываются handleRequest
+// и отвечают одним сообщением. Возвращает полезные нагрузки частей ответа.
+std::vector<std::vector<uint8_t>> handleRequestParts(ClientContext& context,
+                                                     const netproto::MessageHeader& requestHeader,
+                                                     const std::vector<uint8_t>& payload,
+                                                     netproto::MessageHeader& responseHeader,
+                                                     std::size_t maxPartSize) {
+    if (requestHeader.command != netproto::Command::DistanceVector &&
+        requestHeader.command != netproto::Command::DistanceTable &&
+        requestHeader.command != netproto::Command::BatchPathQuery) {
+        return {handleRequest(context, requestHeader, payload, responseHeader)};
+    }
+    const std::optional<netproto::ProtocolVersion> version = negotiateVersion(requestHeader, responseHeader);
+    if (!version) {
+        return {makeErrorPayload("Неподдерживаемая версия протокола.", responseHeader)};
+    }
+    if (requestHeader.command == netproto::Command::DistanceVector) {
+        netproto::DistanceVectorQueryPayload query{};
+        if (!netproto::deserializeDistanceVectorQuery(payload, *version, query)) {
+            return {makeErrorPayload("Некорректная структура DistanceVector.", responseHeader)};
+        }
+        if (!context.graph) {
+            return {makeErrorPayload("Граф не загружен. Используйте upload_graph.", responseHeader)};
+        }
+        if (!graphFitsVersion(context, *version)) {
+            return {makeErrorPayload("Граф слишком велик для этой версии протокола.", responseHeader)};
+        }
+        if (context.graph->vertexCount() > kMaxDistanceVectorVertices) {
+            return {makeErrorPayload("Граф слишком велик для вектора расстояний.", responseHeader)};
+        }
+        if (!context.graph->contains(query.source)) {
+            return {makeErrorPayload("Вершина выходит за границы графа.", responseHeader)};
+        }
+        responseHeader.command = netproto::Command::DistanceVectorResult;
+        responseHeader.status = netproto::Status::Ok;
+        return netproto::serializeDistanceVector(answerDistanceVector(context, query), *version, maxPartSize);
+    }
+    if (requestHeader.command == netproto::Command::DistanceTable) {
+        netproto::DistanceTableQueryPayload query;
+        std::string error;
+        if (!netproto::deserializeDistanceTableQuery(payload, *version, query, error)) {
+            return {makeErrorPayload(error, responseHeader)};
+        }
+        if (!context.graph) {
+            return {makeErrorPayload("Граф не загружен. Используйте upload_graph.", responseHeader)};
+        }
+        auto outside = [&context](graph::VertexId vertex) { return !context.graph->contains(vertex); };
+        if (std::any_of(query.sources.begin(), query.sources.end(), outside) ||
+            std::any_of(query.targets.begin(), query.targets.end(), outside)) {
+            return {makeErrorPayload("Вершины выходят за границы графа.", responseHeader)};
+        }
+        responseHeader.command = netproto::Command::DistanceTableResult;
+        responseHeader.status = netproto::Status::Ok;
+        return netproto::serializeDistanceTable(answerDistanceTable(context, query), maxPartSize);
+    }
+    netproto::BatchPathQueryPayload batch;
+    std::string error;
+    if (!netproto::deserializeBatchPathQuery(payload, *version, batch, error)) {
+        return {makeErrorPayload(error, responseHeader)};
+    }
+    if (!context.graph) {
+        return {makeErrorPayload("Граф не загружен. Используйте upload_graph.", responseHeader)};
+    }
+    if (!graphFitsVersion(context, *version)) {
+        return {makeErrorPayload("Граф слишком велик для этой версии протокола.", responseHeader)};
+    }
+    responseHeader.command = netproto::Command::BatchPathResult;
+    responseHeader.status = netproto::Status::Ok;
+    return netproto::serializeBatchPathResults(answerBatchPathQuery(context, batch.queries), *version, maxPartSize);
+}
+
+// Конвейер запросов TCP-соединения в многопоточном режиме: количество запросов, ответ на которые ещё
+// не записан в сокет, и очередь готовых ответов. Ответы записывает в сокет единственный поток записи
+// соединения, поэтому потоки пула только ставят ответ в очередь и не блокируются на сокете клиента,
+// который не читает ответы. Очередь ограничена окном kMaxPipelinedRequests: запрос остаётся в обработке,
+// пока его ответ не записан, и поток чтения не принимает новые запросы сверх окна.
+struct TcpPipeline {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t inFlight = 0;
+    std::deque<std::vector<uint8_t>> outgoing;  // Сообщения ответа каждого запроса, сериализованные подряд
+    bool closing = false;
+
+    // Ожидание, пока в обработке останется не более limit запросов.
+    void waitUntilAtMost(std::size_t limit) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this, limit] { return inFlight <= limit; });
+    }
+
+    void begin() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++inFlight;
+    }
+
+    // Постановка ответа на запрос (все его сообщения с заголовком header) в очередь потока записи.
+    void complete(const netproto::MessageHeader& header, const std::vector<std::vector<uint8_t>>& parts) {
+        std::vector<uint8_t> messages;
+        for (const std::vector<uint8_t>& part : parts) {
+            std::vector<uint8_t> message = serializeMessage(header, part);
+            messages.insert(messages.end(), message.begin(), message.end());
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            outgoing.push_back(std::move(messages));
+        }
+        changed.notify_all();
+    }
+
+    // Поток записи: отправляет ответы из очереди, пока не вызван stop. После ошибки отправки
+    // (разрыв соединения, который обнаружит поток чтения) ответы снимаются с очереди без отправки.
+    void runWriter(int socket) {
+        bool broken = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            changed.wait(lock, [this] { return !outgoing.empty() || closing; });
+            if (outgoing.empty()) {
+                return;
+            }
+            std::vector<uint8_t> messages = std::move(outgoing.front());
+            outgoing.pop_front();
+            lock.unlock();
+            if (!broken && !sendAll(socket, messages.data(), messages.size())) {
+                std::cout << "Ошибка отправки ответа клиенту.\n";
+                broken = true;
+            }
+            lock.lock();
+            --inFlight;
+            changed.notify_all();
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        changed.notify_all();
+    }
+};
+
 // Обработка TCP-клиента: функция, выполняемая в отдельном потоке для каждого подключённого клиента.
 // Читает запросы от клиента, обрабатывает команды (Help, UploadGraph, PathQuery, Exit) и отправляет ответы.
 // Хранит состояние графа для данного клиента в локальной переменной context.
-void handleTcpClient(int clientSocket, sockaddr_in clientAddr) {
+// Клиент может отправлять запросы, не дожидаясь ответов: запросы пути и справки передаются в общий
+// пул потоков и выполняются параллельно (до kMaxPipelinedRequests одновременно), а ответы с requestId
+// запроса отправляются потоком записи соединения в порядке завершения. Загрузка графа и Exit
+// выполняются этим потоком после завершения всех предыдущих запросов.
+void handleTcpClient(int clientSocket, sockaddr_in clientAddr, WorkerPool& pool) {
     ClientContext context;
+    context.pool = &pool;
+    context.builder = &pool;
+    TcpPipeline pipeline;
+    std::thread writer([&pipeline, clientSocket] { pipeline.runWriter(clientSocket); });
     char addrBuf[INET_ADDRSTRLEN] = {};
     inet_ntop(AF_INET, &clientAddr.sin_addr, addrBuf, sizeof(addrBuf));
     std::cout << "TCP клиент подключен: " << addrBuf << ":" << ntohs(clientAddr.sin_port) << "\n";
@@ -196,70 +1106,46 @@ void handleTcpClient(int clientSocket, sockaddr_in clientAddr) {
         std::vector<uint8_t> payload;
         if (!readTcpMessage(clientSocket, requestHeader, payload)) {
             std::cout << "Соединение с клиентом завершено.\n";
+            logTreeCacheStats(context);
             break;
         }
 
         netproto::MessageHeader responseHeader = makeHeader(netproto::Command::Error,
                                                             netproto::Status::InvalidRequest,
                                                             requestHeader.requestId);
-        std::vector<uint8_t> responsePayload;
-
-        switch (requestHeader.command) {
-            case netproto::Command::Help: {
-                responsePayload = makeOkStringPayload(buildHelpText(), responseHeader);
-                break;
-            }
-            case netproto::Command::UploadGraph: {
-                std::string error;
-                auto graphDefinition = decodeGraphPayload(payload, error);
-                if (!graphDefinition) {
-                    responsePayload = makeErrorPayload(error, responseHeader);
-                } else {
-                    context.graph = *graphDefinition;
-                    context.hasGraph = true;
-                    responseHeader.command = netproto::Command::UploadGraph;
-                    responseHeader.status = netproto::Status::Ok;
-                    responsePayload = netproto::serializeString("Граф принят сервером.");
-                }
-                break;
-            }
-            case netproto::Command::PathQuery: {
-                netproto::PathQueryPayload query{};
-                if (!netproto::deserializePathQuery(payload, query)) {
-                    responsePayload = makeErrorPayload("Некорректная структура PathQuery.", responseHeader);
-                    break;
-                }
-                if (!context.hasGraph) {
-                    responsePayload = makeErrorPayload("Граф не загружен. Используйте upload_graph.", responseHeader);
-                    break;
-                }
-                graph::PathComputation computation = graph::bellmanFord(context.graph,
-                                                                        query.source,
-                                                                        query.target);
-                responsePayload = buildPathResultPayload(computation, responseHeader);
-                break;
-            }
-            case netproto::Command::Exit: {
-                responseHeader.command = netproto::Command::Exit;
-                responseHeader.status = netproto::Status::Ok;
-                responsePayload = netproto::serializeString("До свидания.");
-                sendTcpMessage(clientSocket, responseHeader, responsePayload);
-                std::cout << "Клиент инициировал завершение соединения.\n";
-                close(clientSocket);
-                return;
-            }
-            default: {
-                responsePayload = makeErrorPayload("Неизвестная команда.", responseHeader);
-                break;
-            }
-        }
 
-        if (!sendTcpMessage(clientSocket, responseHeader, responsePayload)) {
-            std::cout << "Ошибка отправки ответа клиенту.\n";
+        if (requestHeader.command == netproto::Command::Exit) {
+            pipeline.waitUntilAtMost(0);
+            responseHeader.command = netproto::Command::Exit;
+            responseHeader.status = netproto::Status::Ok;
+            pipeline.begin();
+            pipeline.complete(responseHeader, {netproto::serializeString("До свидания.")});
+            std::cout << "Клиент инициировал завершение соединения.\n";
+            logTreeCacheStats(context);
             break;
         }
+        if (replacesGraph(requestHeader.command)) {
+            pipeline.waitUntilAtMost(0);
+            std::vector<uint8_t> responsePayload = handleRequest(context, requestHeader, payload, responseHeader);
+            pipeline.begin();
+            pipeline.complete(responseHeader, {responsePayload});
+            continue;
+        }
+
+        pipeline.waitUntilAtMost(kMaxPipelinedRequests - 1);
+        pipeline.begin();
+        pool.submit([&context, &pipeline, requestHeader, payload = std::move(payload), responseHeader]() mutable {
+            std::vector<std::vector<uint8_t>> responseParts =
+                handleRequestParts(context, requestHeader, payload, responseHeader, kTcpResponsePartSize);
+            pipeline.complete(responseHeader, responseParts);
+        });
     }
 
+    // Контекст и очередь используются задачами пула и потоком записи, поэтому дожидаемся
+    // записи всех ответов (в том числе ответа на Exit) перед закрытием сокета.
+    pipeline.waitUntilAtMost(0);
+    pipeline.stop();
+    writer.join();
     close(clientSocket);
 }
 
@@ -269,13 +1155,7 @@ bool sendUdpMessage(int socket,
                     const sockaddr_in& clientAddr,
                     netproto::MessageHeader header,
                     const std::vector<uint8_t>& payload) {
-    header.payloadSize = static_cast<uint32_t>(payload.size());
-    std::vector<uint8_t> headerBuf = netproto::serializeHeader(header);
-    std::vector<uint8_t> packet;
-    packet.reserve(headerBuf.size() + payload.size());
-    packet.insert(packet.end(), headerBuf.begin(), headerBuf.end());
-    packet.insert(packet.end(), payload.begin(), payload.end());
-
+    std::vector<uint8_t> packet = serializeMessage(header, payload);
     ssize_t sent = sendto(socket,
                           packet.data(),
                           static_cast<int>(packet.size()),
@@ -285,28 +1165,287 @@ bool sendUdpMessage(int socket,
     return sent == static_cast<ssize_t>(packet.size());
 }
 
-// Отправка UDP-подтверждения: отправляет ACK клиенту с указанным requestId для подтверждения получения сообщения.
-void sendUdpAck(int socket, const sockaddr_in& clientAddr, uint16_t requestId) {
-    netproto::MessageHeader ack = makeHeader(netproto::Command::Ack,
-                                             netproto::Status::Ok,
-                                             requestId);
-    sendUdpMessage(socket, clientAddr, ack, {});
-}
+// Очередь исходящих UDP-сообщений потока приёма: ACK и ответы накапливаются в заранее выделенных
+// буферах и отправляются одним вызовом sendmmsg при заполнении очереди или по вызову flush
+// (после обработки пакета принятых датаграмм). Буферы сообщений переиспользуются между пакетами.
+class UdpOutbox {
+public:
+    UdpOutbox(int socket, std::size_t capacity)
+        : socket_(socket), packets_(capacity), addresses_(capacity), iovecs_(capacity), messages_(capacity) {}
 
-// Преобразование адреса в строковый ключ: создаёт уникальный ключ для идентификации UDP-клиента.
-// Формат: "IP:порт". Используется для хранения состояния графа каждого клиента.
-std::string addrToKey(const sockaddr_in& addr) {
-    char host[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
-    std::ostringstream key;
-    key << host << ":" << ntohs(addr.sin_port);
-    return key.str();
-}
+    void push(const sockaddr_in& clientAddr,
+              netproto::MessageHeader header,
+              const std::vector<uint8_t>& payload) {
+        std::vector<uint8_t>& packet = packets_[count_];
+        header.payloadSize = static_cast<uint32_t>(payload.size());
+        packet.clear();
+        netproto::appendHeader(packet, header);
+        packet.insert(packet.end(), payload.begin(), payload.end());
+        addresses_[count_] = clientAddr;
+        if (++count_ == packets_.size()) {
+            flush();
+        }
+    }
+
+    void flush() {
+        for (std::size_t i = 0; i < count_; ++i) {
+            iovecs_[i].iov_base = packets_[i].data();
+            iovecs_[i].iov_len = packets_[i].size();
+            messages_[i] = {};
+            messages_[i].msg_hdr.msg_name = &addresses_[i];
+            messages_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            messages_[i].msg_hdr.msg_iov = &iovecs_[i];
+            messages_[i].msg_hdr.msg_iovlen = 1;
+        }
+        std::size_t sent = 0;
+        while (sent < count_) {
+            int result = sendmmsg(socket_, messages_.data() + sent, static_cast<unsigned int>(count_ - sent), 0);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cout << "Не удалось отправить ответ UDP-клиенту.\n";
+                // Пропускаем сообщение, на котором произошла ошибка, и отправляем остальные.
+                ++sent;
+                continue;
+            }
+            sent += static_cast<std::size_t>(result);
+        }
+        count_ = 0;
+    }
+
+private:
+    int socket_;
+    std::vector<std::vector<uint8_t>> packets_;
+    std::vector<sockaddr_in> addresses_;
+    std::vector<iovec> iovecs_;
+    std::vector<mmsghdr> messages_;
+    std::size_t count_ = 0;
+};
+
+// Отправка UDP-подтверждения: ставит в очередь ACK клиенту с указанным requestId для подтверждения получения сообщения.
+void sendUdpAck(UdpOutbox& outbox, const sockaddr_in& clientAddr, uint16_t requestId) {
+    netproto::MessageHeader ack = makeHeader(netproto::Command::Ack,
+                                             netproto::Status::Ok,
+                                             requestId);
+    outbox.push(clientAddr, ack, {});
+}
+
+// Отправка UDP-подтверждения фрагмента: ChunkAck с номером фрагмента и количеством уже принятых.
+void sendUdpChunkAck(UdpOutbox& outbox,
+                     const sockaddr_in& clientAddr,
+                     uint16_t requestId,
+                     uint16_t index,
+                     uint16_t receivedCount) {
+    netproto::MessageHeader ack = makeHeader(netproto::Command::ChunkAck,
+                                             netproto::Status::Ok,
+                                             requestId);
+    outbox.push(clientAddr, ack, netproto::serializeChunkAck({index, receivedCount}));
+}
+
+// Постановка в outbox сохранённого ответа на запрос requestId с командой command. Вызывается под
+// context.responseCacheMutex. Возвращает false, если ответа нет в кэше.
+bool pushCachedResponse(UdpOutbox& outbox,
+                        const sockaddr_in& clientAddr,
+                        const ClientContext& context,
+                        uint16_t requestId,
+                        netproto::Command command) {
+    for (const CachedResponse& cached : context.responseCache) {
+        if (cached.requestId == requestId && cached.requestCommand == command) {
+            for (const std::vector<uint8_t>& payload : cached.payloads) {
+                outbox.push(clientAddr, cached.header, payload);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Повторная отправка сохранённого ответа на уже собранное фрагментированное сообщение. В отличие
+// от replayDuplicateRequest, запрос не отмечается как обрабатываемый: если ответ уже вытеснен из кэша,
+// ничего не отправляется.
+void replayCachedResponse(UdpOutbox& outbox,
+                          const sockaddr_in& clientAddr,
+                          ClientContext& context,
+                          uint16_t requestId,
+                          netproto::Command command) {
+    std::lock_guard<std::mutex> lock(context.responseCacheMutex);
+    pushCachedResponse(outbox, clientAddr, context, requestId, command);
+}
+
+// Проверка повторного запроса UDP-клиента (того же requestId и команды, что у недавнего запроса).
+// Если ответ на него уже сохранён, ставит сохранённый ответ в outbox; если запрос ещё обрабатывается,
+// ничего не отправляет (ответ будет отправлен по завершении обработки). В обоих случаях возвращает
+// true, и запрос не обрабатывается повторно. Для нового запроса отмечает его как обрабатываемый
+// и возвращает false.
+// Если acknowledgePending равен true, повтор обрабатываемого запроса подтверждается ACK (клиент в режиме
+// без отдельного ACK иначе не узнает, что запрос принят).
+bool replayDuplicateRequest(UdpOutbox& outbox,
+                            const sockaddr_in& clientAddr,
+                            ClientContext& context,
+                            uint16_t requestId,
+                            netproto::Command command,
+                            bool acknowledgePending) {
+    std::lock_guard<std::mutex> lock(context.responseCacheMutex);
+    if (pushCachedResponse(outbox, clientAddr, context, requestId, command)) {
+        return true;
+    }
+    if (std::find(context.pendingRequests.begin(), context.pendingRequests.end(), requestId) !=
+        context.pendingRequests.end()) {
+        if (acknowledgePending) {
+            sendUdpAck(outbox, clientAddr, requestId);
+        }
+        return true;
+    }
+    context.pendingRequests.push_back(requestId);
+    return false;
+}
+
+// Завершение обработки запроса UDP-клиента: снимает отметку об обработке и, если cache равен true,
+// сохраняет ответ для повторной отправки, вытесняя самый старый из kResponseCacheSize ответов.
+void finishUdpRequest(ClientContext& context,
+                      const netproto::MessageHeader& requestHeader,
+                      const netproto::MessageHeader& responseHeader,
+                      const std::vector<std::vector<uint8_t>>& responseParts,
+                      bool cache) {
+    std::lock_guard<std::mutex> lock(context.responseCacheMutex);
+    auto pending = std::find(context.pendingRequests.begin(),
+                             context.pendingRequests.end(),
+                             requestHeader.requestId);
+    if (pending != context.pendingRequests.end()) {
+        context.pendingRequests.erase(pending);
+    }
+    if (!cache) {
+        return;
+    }
+    context.responseCache.push_back({requestHeader.requestId, requestHeader.command, responseHeader, responseParts});
+    if (context.responseCache.size() > kResponseCacheSize) {
+        context.responseCache.pop_front();
+    }
+}
+
+// Удаление сборки фрагментов из контекста клиента с вычитанием её данных из объёма сборок шарда.
+void dropAssembly(ClientContext& context,
+                  std::unordered_map<uint16_t, ChunkAssembly>::iterator it,
+                  std::size_t& assemblyBytes) {
+    assemblyBytes -= it->second.bytes;
+    context.assemblies.erase(it);
+}
+
+// Удаление сборок клиента, не получавших фрагментов дольше kAssemblyTimeout к моменту now.
+void expireAssemblies(ClientContext& context,
+                      std::chrono::steady_clock::time_point now,
+                      std::size_t& assemblyBytes) {
+    for (auto it = context.assemblies.begin(); it != context.assemblies.end();) {
+        if (now - it->second.lastUpdate > kAssemblyTimeout) {
+            assemblyBytes -= it->second.bytes;
+            it = context.assemblies.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Приём фрагмента UDP-сообщения: сохраняет данные фрагмента в сборке, найденной по requestId
+// в контексте клиента, и подтверждает фрагмент (в том числе повторный). Когда приняты все фрагменты,
+// возвращает true и заполняет assembledHeader и assembledPayload собранным сообщением.
+// Если фрагмент повреждён, противоречит уже начатой сборке или превышает объём сборок шарда
+// (assemblyBytes, не более kMaxShardAssemblyBytes), сборка отменяется, а в errorMessage
+// записывается описание ошибки, которое отправляется клиенту вместо подтверждения (NACK).
+bool acceptUdpChunk(UdpOutbox& outbox,
+                    const sockaddr_in& clientAddr,
+                    ClientContext& context,
+                    const netproto::MessageHeader& header,
+                    const std::vector<uint8_t>& payload,
+                    std::size_t& assemblyBytes,
+                    netproto::MessageHeader& assembledHeader,
+                    std::vector<uint8_t>& assembledPayload,
+                    std::string& errorMessage) {
+    netproto::ChunkPayload chunk;
+    if (!netproto::deserializeChunk(payload, chunk, errorMessage)) {
+        auto broken = context.assemblies.find(header.requestId);
+        if (broken != context.assemblies.end()) {
+            dropAssembly(context, broken, assemblyBytes);
+        }
+        return false;
+    }
+    for (uint16_t completed : context.completedAssemblies) {
+        if (completed == header.requestId) {
+            // Повторный фрагмент уже собранного сообщения: клиент не получил подтверждение или ответ.
+            sendUdpChunkAck(outbox, clientAddr, header.requestId, chunk.index, chunk.count);
+            replayCachedResponse(outbox, clientAddr, context, header.requestId, chunk.command);
+            return false;
+        }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    expireAssemblies(context, now, assemblyBytes);
+
+    auto it = context.assemblies.find(header.requestId);
+    if (it == context.assemblies.end()) {
+        if (context.assemblies.size() >= kMaxPendingAssemblies) {
+            errorMessage = "Слишком много незавершённых фрагментированных сообщений.";
+            return false;
+        }
+        ChunkAssembly assembly;
+        assembly.command = chunk.command;
+        assembly.count = chunk.count;
+        assembly.totalSize = chunk.totalSize;
+        it = context.assemblies.emplace(header.requestId, std::move(assembly)).first;
+    }
+    ChunkAssembly& assembly = it->second;
+    if (assembly.command != chunk.command ||
+        assembly.count != chunk.count ||
+        assembly.totalSize != chunk.totalSize) {
+        dropAssembly(context, it, assemblyBytes);
+        errorMessage = "Фрагмент не соответствует ранее полученным фрагментам сообщения.";
+        return false;
+    }
+    assembly.lastUpdate = now;
+    if (assembly.chunks.count(chunk.index) == 0) {
+        if (assemblyBytes + chunk.data.size() > kMaxShardAssemblyBytes) {
+            dropAssembly(context, it, assemblyBytes);
+            errorMessage = "Сервер перегружен фрагментированными сообщениями, повторите запрос позже.";
+            return false;
+        }
+        assembly.bytes += chunk.data.size();
+        assemblyBytes += chunk.data.size();
+        assembly.chunks.emplace(chunk.index, std::move(chunk.data));
+    }
+    const auto receivedCount = static_cast<uint16_t>(assembly.chunks.size());
+    sendUdpChunkAck(outbox, clientAddr, header.requestId, chunk.index, receivedCount);
+    if (receivedCount < assembly.count) {
+        return false;
+    }
+
+    assembledHeader = makeHeader(assembly.command, netproto::Status::Ok, header.requestId);
+    assembledHeader.payloadSize = assembly.totalSize;
+    assembledHeader.reserved = header.reserved & netproto::kVersionMask;
+    assembledPayload.clear();
+    assembledPayload.reserve(assembly.totalSize);
+    for (const auto& received : assembly.chunks) {
+        assembledPayload.insert(assembledPayload.end(), received.second.begin(), received.second.end());
+    }
+    dropAssembly(context, it, assemblyBytes);
+    context.completedAssemblies.push_back(header.requestId);
+    if (context.completedAssemblies.size() > kCompletedAssemblyHistory) {
+        context.completedAssemblies.pop_front();
+    }
+    return true;
+}
+
+// Преобразование адреса в числовой ключ: создаёт уникальный ключ для идентификации UDP-клиента
+// (IP-адрес в старших 32 битах, порт в младших 16). Используется для хранения состояния графа
+// каждого клиента; в отличие от строки "IP:порт" не требует выделения памяти на каждую датаграмму.
+uint64_t addrToKey(const sockaddr_in& addr) {
+    return (static_cast<uint64_t>(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+}
 
 // Запуск TCP-сервера: создаёт TCP-сокет, привязывает его к порту и начинает прослушивание.
-// Для каждого подключённого клиента создаёт отдельный поток, который обрабатывает запросы клиента.
+// Для каждого подключённого клиента создаёт отдельный поток, который читает запросы клиента;
+// запросы всех клиентов выполняются общим пулом из workerCount потоков.
 // Сервер работает до завершения процесса (по сигналу от пользователя).
-void runTcpServer(uint16_t port) {
+void runTcpServer(uint16_t port, std::size_t workerCount) {
     int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
         perror("socket");
@@ -332,6 +1471,8 @@ void runTcpServer(uint16_t port) {
     }
     std::cout << "TCP сервер слушает порт " << port << "\n";
 
+    WorkerPool pool(workerCount);
+
     while (true) {
         sockaddr_in clientAddr{};
         socklen_t addrLen = sizeof(clientAddr);
@@ -342,176 +1483,905 @@ void runTcpServer(uint16_t port) {
             perror("accept");
             continue;
         }
-        std::thread worker(handleTcpClient, clientSocket, clientAddr);
+        std::thread worker(handleTcpClient, clientSocket, clientAddr, std::ref(pool));
         worker.detach();
     }
 }
 
-// Запуск UDP-сервера: создаёт UDP-сокет, привязывает его к порту и начинает обработку датаграмм.
-// Хранит состояние графа для каждого клиента в хеш-таблице (ключ - адрес клиента).
-// Для каждого входящего пакета отправляет ACK, обрабатывает команду и отправляет ответ.
-// Сервер работает в одном потоке, обрабатывая запросы последовательно.
-void runUdpServer(uint16_t port) {
-    int serverSocket = socket(AF_INET, SOCK_DGRAM, 0);
+// Соединение TCP-сервера в режиме epoll: неблокирующий сокет с буферами чтения и записи,
+// которые заполняются и опустошаются по мере готовности сокета.
+struct EpollConnection {
+    int socket = -1;
+    ClientContext context;
+    std::vector<uint8_t> readBuffer;   // Принятые, но ещё не обработанные байты
+    std::vector<uint8_t> writeBuffer;  // Байты ответов, ещё не отправленные клиенту
+    std::size_t writeOffset = 0;       // Количество уже отправленных байтов writeBuffer
+    std::size_t inFlight = 0;          // Запросы, переданные в пул потоков и ещё не обработанные
+    bool exclusive = false;            // Выполняется загрузка графа: следующие запросы ждут её завершения
+    bool closeAfterWrite = false;      // Закрыть соединение после отправки writeBuffer (Exit)
+    bool readPaused = false;           // Чтение остановлено на пределе буфера (readBufferLimit) до EAGAIN
+    bool peerClosed = false;           // Клиент закрыл свою сторону соединения (получен конец потока)
+    bool closed = false;
+};
+
+// Результат обработки запроса потоком пула: сериализованный ответ для соединения.
+struct EpollCompletion {
+    std::shared_ptr<EpollConnection> connection;
+    std::vector<uint8_t> response;
+};
+
+// Очередь готовых ответов от потоков пула к циклу событий. Поток пула добавляет ответ
+// и будит цикл событий записью в eventfd.
+struct EpollCompletionQueue {
+    std::mutex mutex;
+    std::vector<EpollCompletion> items;
+    int wakeFd = -1;
+
+    void push(EpollCompletion completion) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            items.push_back(std::move(completion));
+        }
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    std::vector<EpollCompletion> take() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<EpollCompletion> taken;
+        taken.swap(items);
+        return taken;
+    }
+};
+
+// Перевод сокета в неблокирующий режим.
+bool setNonBlocking(int socket) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Предел буфера чтения соединения: kEpollReadBufferLimit, а если буфер начинается с заголовка загрузки
+// графа - размер этого сообщения, когда он больше.
+std::size_t readBufferLimit(const EpollConnection& connection) {
+    netproto::MessageHeader header;
+    if (connection.readBuffer.size() >= netproto::kHeaderSize &&
+        netproto::deserializeHeader(connection.readBuffer.data(), netproto::kHeaderSize, header) &&
+        replacesGraph(header.command)) {
+        return std::max(kEpollReadBufferLimit, netproto::kHeaderSize + header.payloadSize);
+    }
+    return kEpollReadBufferLimit;
+}
+
+// Чтение доступных данных из неблокирующего сокета в readBuffer до EAGAIN, как требует edge-triggered
+// режим, или до предела буфера (readBufferLimit). Во втором случае чтение приостанавливается (readPaused)
+// и продолжается advanceEpollConnection, когда запросы будут извлечены из буфера: новое событие
+// EPOLLIN для уже пришедших данных не поступит. Ёмкость буфера не превышает предел, поэтому загрузка
+// графа занимает не больше памяти, чем её объявленный размер. Конец потока отмечается в peerClosed:
+// соединение закрывается только после отправки ответов на уже принятые запросы. Возвращает false при ошибке.
+bool readAvailable(EpollConnection& connection) {
+    connection.readPaused = false;
+    while (!connection.peerClosed) {
+        const std::size_t limit = readBufferLimit(connection);
+        if (connection.readBuffer.size() >= limit) {
+            connection.readPaused = true;
+            return true;
+        }
+        const std::size_t used = connection.readBuffer.size();
+        const std::size_t block = std::min(kEpollReadChunk, limit - used);
+        if (used + block > connection.readBuffer.capacity()) {
+            const std::size_t grown = std::max(used + block, 2 * connection.readBuffer.capacity());
+            connection.readBuffer.reserve(std::min(grown, limit));
+        }
+        connection.readBuffer.resize(used + block);
+        ssize_t bytes = recv(connection.socket, connection.readBuffer.data() + used, block, 0);
+        connection.readBuffer.resize(used + (bytes > 0 ? static_cast<std::size_t>(bytes) : 0));
+        if (bytes > 0) {
+            continue;
+        }
+        if (bytes == 0) {
+            connection.peerClosed = true;
+            return true;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return true;
+}
+
+// Отправка накопленных ответов до опустошения writeBuffer или до EAGAIN; остаток будет отправлен
+// по событию EPOLLOUT. Возвращает false при ошибке отправки.
+bool flushWriteBuffer(EpollConnection& connection) {
+    while (connection.writeOffset < connection.writeBuffer.size()) {
+        ssize_t sent = send(connection.socket,
+                            connection.writeBuffer.data() + connection.writeOffset,
+                            connection.writeBuffer.size() - connection.writeOffset,
+                            MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.writeOffset += static_cast<std::size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    connection.writeBuffer.clear();
+    if (connection.writeBuffer.capacity() > kEpollWriteBufferLimit) {
+        std::vector<uint8_t>().swap(connection.writeBuffer);
+    }
+    connection.writeOffset = 0;
+    return true;
+}
+
+// Извлечение полных запросов из readBuffer и передача их в пул потоков. Запросы одного соединения
+// выполняются параллельно (до kMaxPipelinedRequests одновременно), а ответы отправляются в порядке
+// завершения с requestId запроса. Пока клиент не прочитал kEpollWriteBufferLimit байт ответов,
+// новые запросы не извлекаются. Загрузка графа начинается только после завершения предыдущих
+// запросов и выполняется одна (exclusive). Exit обрабатывается в цикле событий после завершения
+// всех предыдущих запросов. После извлечения запросов ёмкость буфера чтения сверх предела
+// освобождается. Возвращает false, если заголовок запроса некорректен или запрос, кроме загрузки
+// графа, больше kEpollReadBufferLimit, и соединение нужно закрыть.
+bool dispatchRequests(const std::shared_ptr<EpollConnection>& connection,
+                      WorkerPool& pool,
+                      EpollCompletionQueue& completions) {
+    std::size_t offset = 0;
+    bool valid = true;
+    while (!connection->exclusive && !connection->closeAfterWrite &&
+           connection->inFlight < kMaxPipelinedRequests &&
+           connection->writeBuffer.size() - connection->writeOffset < kEpollWriteBufferLimit &&
+           connection->readBuffer.size() - offset >= netproto::kHeaderSize) {
+        netproto::MessageHeader requestHeader;
+        if (!netproto::deserializeHeader(connection->readBuffer.data() + offset, netproto::kHeaderSize,
+                                         requestHeader)) {
+            valid = false;
+            break;
+        }
+        const std::size_t messageSize = netproto::kHeaderSize + requestHeader.payloadSize;
+        if (messageSize > kEpollReadBufferLimit && !replacesGraph(requestHeader.command)) {
+            valid = false;
+            break;
+        }
+        if (connection->readBuffer.size() - offset < messageSize) {
+            break;
+        }
+        const bool barrier = requestHeader.command == netproto::Command::Exit ||
+                             replacesGraph(requestHeader.command);
+        if (barrier && connection->inFlight > 0) {
+            break;
+        }
+        const auto payloadBegin = connection->readBuffer.begin() + offset + netproto::kHeaderSize;
+        std::vector<uint8_t> payload(payloadBegin, payloadBegin + requestHeader.payloadSize);
+        offset += messageSize;
+
+        if (requestHeader.command == netproto::Command::Exit) {
+            netproto::MessageHeader responseHeader = makeHeader(netproto::Command::Exit,
+                                                                netproto::Status::Ok,
+                                                                requestHeader.requestId);
+            std::vector<uint8_t> response = serializeMessage(responseHeader,
+                                                             netproto::serializeString("До свидания."));
+            connection->writeBuffer.insert(connection->writeBuffer.end(), response.begin(), response.end());
+            connection->closeAfterWrite = true;
+            std::cout << "Клиент инициировал завершение соединения.\n";
+            break;
+        }
+
+        ++connection->inFlight;
+        connection->exclusive = barrier;
+        pool.submit([connection, requestHeader, payload = std::move(payload), &completions] {
+            netproto::MessageHeader responseHeader = makeHeader(netproto::Command::Error,
+                                                                netproto::Status::InvalidRequest,
+                                                                requestHeader.requestId);
+            std::vector<uint8_t> response;
+            for (const std::vector<uint8_t>& part : handleRequestParts(connection->context, requestHeader, payload,
+                                                                       responseHeader, kTcpResponsePartSize)) {
+                std::vector<uint8_t> message = serializeMessage(responseHeader, part);
+                response.insert(response.end(), message.begin(), message.end());
+            }
+            completions.push({connection, std::move(response)});
+        });
+    }
+    connection->readBuffer.erase(connection->readBuffer.begin(), connection->readBuffer.begin() + offset);
+    if (connection->readBuffer.capacity() > readBufferLimit(*connection)) {
+        std::vector<uint8_t>(connection->readBuffer.begin(), connection->readBuffer.end())
+            .swap(connection->readBuffer);
+    }
+    return valid;
+}
+
+// Закрытие соединения в режиме epoll. Если запросы соединения ещё обрабатываются пулом,
+// их результаты будут отброшены (соединение помечается закрытым).
+void closeEpollConnection(int epollFd,
+                          std::unordered_map<int, std::shared_ptr<EpollConnection>>& connections,
+                          const std::shared_ptr<EpollConnection>& connection) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->socket, nullptr);
+    close(connection->socket);
+    connection->closed = true;
+    connections.erase(connection->socket);
+    std::cout << "Соединение с клиентом завершено.\n";
+    logTreeCacheStats(connection->context);
+}
+
+// Продвижение соединения после чтения или отправки: передаёт в пул следующие запросы, продолжает
+// приостановленное чтение, когда в буфере освободилось место, и отправляет накопленные ответы.
+// Закрывает соединение при ошибке, после ответа на Exit или, если клиент закрыл свою сторону,
+// после отправки ответов на все принятые запросы.
+void advanceEpollConnection(int epollFd,
+                            std::unordered_map<int, std::shared_ptr<EpollConnection>>& connections,
+                            const std::shared_ptr<EpollConnection>& connection,
+                            WorkerPool& pool,
+                            EpollCompletionQueue& completions) {
+    while (true) {
+        if (!dispatchRequests(connection, pool, completions)) {
+            closeEpollConnection(epollFd, connections, connection);
+            return;
+        }
+        if (!connection->readPaused || connection->readBuffer.size() >= readBufferLimit(*connection)) {
+            break;
+        }
+        if (!readAvailable(*connection)) {
+            closeEpollConnection(epollFd, connections, connection);
+            return;
+        }
+    }
+    if (!flushWriteBuffer(*connection)) {
+        closeEpollConnection(epollFd, connections, connection);
+        return;
+    }
+    const bool drained = connection->inFlight == 0 && connection->writeBuffer.empty();
+    if (drained && (connection->closeAfterWrite || connection->peerClosed)) {
+        closeEpollConnection(epollFd, connections, connection);
+    }
+}
+
+// Запуск TCP-сервера в режиме epoll: один поток обслуживает все соединения через edge-triggered
+// epoll с неблокирующими сокетами, а декодирование графов и поиск путей выполняются пулом
+// из workerCount потоков. Количество потоков не зависит от количества подключённых клиентов.
+void runTcpEpollServer(uint16_t port, std::size_t workerCount) {
+    int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSocket < 0) {
         perror("socket");
         return;
     }
+    int opt = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
     sockaddr_in serverAddr{};
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
     serverAddr.sin_port = htons(port);
-    if (bind(serverSocket,
-             reinterpret_cast<sockaddr*>(&serverAddr),
-             sizeof(serverAddr)) < 0) {
+
+    if (bind(serverSocket, reinterpret_cast<sockaddr*>(&serverAddr), sizeof(serverAddr)) < 0) {
         perror("bind");
         close(serverSocket);
         return;
     }
-    std::cout << "UDP сервер слушает порт " << port << "\n";
+    if (listen(serverSocket, SOMAXCONN) < 0 || !setNonBlocking(serverSocket)) {
+        perror("listen");
+        close(serverSocket);
+        return;
+    }
+
+    int epollFd = epoll_create1(0);
+    int wakeFd = eventfd(0, EFD_NONBLOCK);
+    if (epollFd < 0 || wakeFd < 0) {
+        perror("epoll");
+        close(serverSocket);
+        return;
+    }
+    epoll_event listenEvent{};
+    listenEvent.events = EPOLLIN | EPOLLET;
+    listenEvent.data.fd = serverSocket;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &listenEvent);
+    epoll_event wakeEvent{};
+    wakeEvent.events = EPOLLIN | EPOLLET;
+    wakeEvent.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent);
 
-    std::unordered_map<std::string, ClientContext> clients;
-    std::mutex clientsMutex;
+    std::cout << "TCP сервер (epoll, потоков обработки: " << workerCount << ") слушает порт " << port << "\n";
+
+    std::unordered_map<int, std::shared_ptr<EpollConnection>> connections;
+    EpollCompletionQueue completions;
+    completions.wakeFd = wakeFd;
+    WorkerPool pool(workerCount);
+    std::vector<epoll_event> events(kMaxEpollEvents);
 
     while (true) {
-        std::vector<uint8_t> buffer(65536);
-        sockaddr_in clientAddr{};
-        socklen_t clientLen = sizeof(clientAddr);
-        ssize_t bytes = recvfrom(serverSocket,
-                                 buffer.data(),
-                                 static_cast<int>(buffer.size()),
-                                 0,
-                                 reinterpret_cast<sockaddr*>(&clientAddr),
-                                 &clientLen);
-        if (bytes < 0) {
-            perror("recvfrom");
+        int ready = epoll_wait(epollFd, events.data(), kMaxEpollEvents, -1);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                perror("epoll_wait");
+            }
             continue;
         }
-        if (bytes < static_cast<ssize_t>(netproto::kHeaderSize)) {
-            std::cout << "От клиента получен слишком короткий пакет.\n";
-            continue;
+        for (int i = 0; i < ready; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == serverSocket) {
+                while (true) {
+                    sockaddr_in clientAddr{};
+                    socklen_t addrLen = sizeof(clientAddr);
+                    int clientSocket = accept(serverSocket,
+                                              reinterpret_cast<sockaddr*>(&clientAddr),
+                                              &addrLen);
+                    if (clientSocket < 0) {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                            perror("accept");
+                        }
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    if (!setNonBlocking(clientSocket)) {
+                        close(clientSocket);
+                        continue;
+                    }
+                    auto connection = std::make_shared<EpollConnection>();
+                    connection->socket = clientSocket;
+                    connection->context.pool = &pool;
+                    connection->context.builder = &pool;
+                    epoll_event clientEvent{};
+                    clientEvent.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    clientEvent.data.fd = clientSocket;
+                    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &clientEvent) < 0) {
+                        perror("epoll_ctl");
+                        close(clientSocket);
+                        continue;
+                    }
+                    connections[clientSocket] = std::move(connection);
+                    char addrBuf[INET_ADDRSTRLEN] = {};
+                    inet_ntop(AF_INET, &clientAddr.sin_addr, addrBuf, sizeof(addrBuf));
+                    std::cout << "TCP клиент подключен: " << addrBuf << ":" << ntohs(clientAddr.sin_port) << "\n";
+                }
+                continue;
+            }
+            if (fd == wakeFd) {
+                uint64_t counter = 0;
+                while (read(wakeFd, &counter, sizeof(counter)) > 0) {
+                }
+                for (EpollCompletion& completion : completions.take()) {
+                    const std::shared_ptr<EpollConnection>& connection = completion.connection;
+                    if (connection->closed) {
+                        continue;
+                    }
+                    if (--connection->inFlight == 0) {
+                        connection->exclusive = false;
+                    }
+                    connection->writeBuffer.insert(connection->writeBuffer.end(),
+                                                   completion.response.begin(),
+                                                   completion.response.end());
+                    advanceEpollConnection(epollFd, connections, connection, pool, completions);
+                }
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) {
+                continue;
+            }
+            std::shared_ptr<EpollConnection> connection = it->second;
+            if ((events[i].events & EPOLLERR) ||
+                ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && !readAvailable(*connection))) {
+                closeEpollConnection(epollFd, connections, connection);
+                continue;
+            }
+            advanceEpollConnection(epollFd, connections, connection, pool, completions);
         }
-        buffer.resize(static_cast<size_t>(bytes));
-        std::vector<uint8_t> headerBuf(buffer.begin(),
-                                       buffer.begin() + netproto::kHeaderSize);
-        netproto::MessageHeader requestHeader;
-        if (!netproto::deserializeHeader(headerBuf, requestHeader)) {
-            std::cout << "Не удалось разобрать заголовок UDP-пакета.\n";
+    }
+}
+
+// Обработка запроса UDP-клиента: вычисляет ответ, блокируя контекст клиента на время обработки,
+// и сохраняет его в кэше ответов. Выполняется потоком приёма или потоком пула; заполняет
+// responseHeader и возвращает полезные нагрузки частей ответа, каждая из которых помещается
+// в одну датаграмму (кроме результата с очень длинным путём).
+std::vector<std::vector<uint8_t>> handleUdpRequest(ClientContext& context,
+                                                   const netproto::MessageHeader& requestHeader,
+                                                   const std::vector<uint8_t>& payload,
+                                                   netproto::MessageHeader& responseHeader) {
+    std::vector<std::vector<uint8_t>> responseParts;
+    {
+        std::lock_guard<std::mutex> lock(context.mutex);
+        responseHeader = makeHeader(netproto::Command::Error,
+                                    netproto::Status::InvalidRequest,
+                                    requestHeader.requestId);
+        responseParts = handleRequestParts(context, requestHeader, payload, responseHeader, kUdpResponsePartSize);
+    }
+    responseHeader.reserved |= requestHeader.reserved & netproto::kFlagPiggybackAck;
+    finishUdpRequest(context, requestHeader, responseHeader, responseParts, true);
+    return responseParts;
+}
+
+// Отложенный ACK на запрос с флагом kFlagPiggybackAck, переданный в пул потоков. Поток пула
+// отправляет ответ, удерживая mutex и отметив answered; поток приёма по истечении deadline
+// отправляет ACK под тем же mutex, только если ответ ещё не отправлен. Поэтому ACK никогда
+// не приходит клиенту после ответа.
+struct DeferredAck {
+    sockaddr_in clientAddr{};
+    uint16_t requestId = 0;
+    std::chrono::steady_clock::time_point deadline;
+    std::mutex mutex;
+    bool answered = false;
+};
+
+// Запрос UDP-клиента, ожидающий обработки: передачи в пул потоков или вычисления в потоке приёма
+// после отправки подтверждений пакета датаграмм.
+struct UdpJob {
+    sockaddr_in clientAddr;
+    std::shared_ptr<ClientContext> context;
+    netproto::MessageHeader header;
+    std::vector<uint8_t> payload;
+    std::shared_ptr<DeferredAck> deferredAck;  // nullptr, если ACK уже отправлен
+};
+
+// Состояние потока приёма UDP-сервера (шарда): контексты клиентов шарда по адресу и суммарный
+// объём данных незавершённых сборок фрагментов всех этих клиентов. Используется только потоком приёма.
+struct UdpShard {
+    std::unordered_map<uint64_t, std::shared_ptr<ClientContext>> clients;
+    std::size_t assemblyBytes = 0;
+};
+
+// Очистка шарда, вызываемая потоком приёма раз в kUdpSweepInterval: удаляет брошенные сборки
+// фрагментов всех клиентов и клиентов без датаграмм дольше kUdpClientIdleTimeout. Клиент с ещё
+// вычисляемыми запросами не удаляется; задачи пула всё равно держат контекст через shared_ptr.
+void sweepUdpShard(UdpShard& shard, std::chrono::steady_clock::time_point now) {
+    for (auto it = shard.clients.begin(); it != shard.clients.end();) {
+        ClientContext& context = *it->second;
+        expireAssemblies(context, now, shard.assemblyBytes);
+        bool idle = now - context.lastActivity >= kUdpClientIdleTimeout;
+        if (idle) {
+            std::lock_guard<std::mutex> lock(context.responseCacheMutex);
+            idle = context.pendingRequests.empty();
+        }
+        if (!idle) {
+            ++it;
             continue;
         }
-        std::vector<uint8_t> payload(buffer.begin() + netproto::kHeaderSize,
-                                     buffer.end());
+        logTreeCacheStats(context);
+        for (const auto& assembly : context.assemblies) {
+            shard.assemblyBytes -= assembly.second.bytes;
+        }
+        it = shard.clients.erase(it);
+    }
+}
 
-        sendUdpAck(serverSocket, clientAddr, requestHeader.requestId);
+// Обработка одной датаграммы в потоке приёма UDP-сервера: разбирает заголовок, ставит в очередь
+// outbox подтверждение (ACK или ChunkAck), собирает фрагменты и откладывает запрос в jobs. Запросы
+// вычисляются только после отправки подтверждений всего пакета датаграмм: пулом потоков (pool)
+// или в потоке приёма. Иерархии сжатия графов новых клиентов строятся в пуле builder.
+void handleUdpDatagram(UdpOutbox& outbox,
+                       UdpShard& shard,
+                       std::vector<UdpJob>& jobs,
+                       WorkerPool* pool,
+                       WorkerPool* builder,
+                       const sockaddr_in& clientAddr,
+                       const uint8_t* data,
+                       std::size_t size) {
+    if (size < netproto::kHeaderSize) {
+        std::cout << "От клиента получен слишком короткий пакет.\n";
+        return;
+    }
+    netproto::MessageHeader requestHeader;
+    if (!netproto::deserializeHeader(data, size, requestHeader)) {
+        std::cout << "Не удалось разобрать заголовок UDP-пакета.\n";
+        return;
+    }
+    std::vector<uint8_t> payload(data + netproto::kHeaderSize, data + size);
 
-        ClientContext* context = nullptr;
-        std::string key = addrToKey(clientAddr);
-        {
-            std::lock_guard<std::mutex> lock(clientsMutex);
-            context = &clients[key];
+    // ACK откладывается только при обработке пулом: поток приёма без пула не может отправить ACK,
+    // пока вычисляет запрос, поэтому подтверждает его сразу.
+    const bool piggyback = pool != nullptr && (requestHeader.reserved & netproto::kFlagPiggybackAck) != 0;
+    if (requestHeader.command != netproto::Command::Chunk && !piggyback) {
+        sendUdpAck(outbox, clientAddr, requestHeader.requestId);
+    }
+
+    const uint64_t key = addrToKey(clientAddr);
+    std::shared_ptr<ClientContext>& slot = shard.clients[key];
+    if (!slot) {
+        slot = std::make_shared<ClientContext>();
+        slot->pool = pool;
+        slot->builder = builder;
+    }
+    slot->lastActivity = std::chrono::steady_clock::now();
+    std::shared_ptr<ClientContext> context = slot;
+
+    if (requestHeader.command == netproto::Command::Chunk) {
+        netproto::MessageHeader assembledHeader;
+        std::vector<uint8_t> assembledPayload;
+        std::string error;
+        if (!acceptUdpChunk(outbox, clientAddr, *context, requestHeader, payload, shard.assemblyBytes,
+                            assembledHeader, assembledPayload, error)) {
+            if (!error.empty()) {
+                netproto::MessageHeader nackHeader = makeHeader(netproto::Command::Error,
+                                                                netproto::Status::InvalidRequest,
+                                                                requestHeader.requestId);
+                std::vector<uint8_t> nackPayload = makeErrorPayload(error, nackHeader);
+                outbox.push(clientAddr, nackHeader, nackPayload);
+            }
+            return;
         }
+        requestHeader = assembledHeader;
+        payload = std::move(assembledPayload);
+    }
 
-        netproto::MessageHeader responseHeader = makeHeader(netproto::Command::Error,
-                                                            netproto::Status::InvalidRequest,
+    if (requestHeader.command != netproto::Command::Exit &&
+        replayDuplicateRequest(outbox, clientAddr, *context, requestHeader.requestId, requestHeader.command,
+                               piggyback)) {
+        return;
+    }
+
+    if (requestHeader.command == netproto::Command::Exit) {
+        logTreeCacheStats(*context);
+        for (const auto& assembly : context->assemblies) {
+            shard.assemblyBytes -= assembly.second.bytes;
+        }
+        shard.clients.erase(key);
+        netproto::MessageHeader responseHeader = makeHeader(netproto::Command::Exit,
+                                                            netproto::Status::Ok,
                                                             requestHeader.requestId);
-        std::vector<uint8_t> responsePayload;
+        outbox.push(clientAddr, responseHeader, netproto::serializeString("До свидания."));
+        return;
+    }
 
-        switch (requestHeader.command) {
-            case netproto::Command::Help: {
-                responsePayload = makeOkStringPayload(buildHelpText(), responseHeader);
-                break;
-            }
-            case netproto::Command::UploadGraph: {
-                std::string error;
-                auto graphDefinition = decodeGraphPayload(payload, error);
-                if (!graphDefinition) {
-                    responsePayload = makeErrorPayload(error, responseHeader);
-                } else {
-                    context->graph = *graphDefinition;
-                    context->hasGraph = true;
-                    responseHeader.command = netproto::Command::UploadGraph;
-                    responseHeader.status = netproto::Status::Ok;
-                    responsePayload = netproto::serializeString("Граф принят сервером.");
-                }
-                break;
+    std::shared_ptr<DeferredAck> deferredAck;
+    if (piggyback) {
+        deferredAck = std::make_shared<DeferredAck>();
+        deferredAck->clientAddr = clientAddr;
+        deferredAck->requestId = requestHeader.requestId;
+    }
+    jobs.push_back({clientAddr, std::move(context), requestHeader, std::move(payload), std::move(deferredAck)});
+}
+
+// Вычисление отложенных запросов в потоке приёма (сервер без пула потоков). Вызывается после отправки
+// ACK пакета датаграмм, поэтому долгий запрос не задерживает подтверждения. Ответ каждого запроса
+// отправляется сразу после его вычисления, не дожидаясь следующих запросов пакета.
+void runUdpJobs(UdpOutbox& outbox, std::vector<UdpJob>& jobs) {
+    for (UdpJob& job : jobs) {
+        netproto::MessageHeader responseHeader;
+        std::vector<std::vector<uint8_t>> responseParts =
+            handleUdpRequest(*job.context, job.header, job.payload, responseHeader);
+        for (const std::vector<uint8_t>& part : responseParts) {
+            outbox.push(job.clientAddr, responseHeader, part);
+        }
+        outbox.flush();
+    }
+    jobs.clear();
+}
+
+// Передача отложенных запросов пулу потоков. Вызывается после отправки ACK пакета датаграмм,
+// чтобы ответ потока пула не опередил подтверждение. Потоки пула отправляют ответы сами;
+// если очередь пула заполнена, клиенту через outbox отправляется ошибка. Отложенные ACK запросов
+// с флагом kFlagPiggybackAck добавляются в deferredAcks со сроком kPiggybackAckDelay.
+void submitUdpJobs(int socket,
+                   WorkerPool& pool,
+                   std::vector<UdpJob>& jobs,
+                   UdpOutbox& outbox,
+                   std::deque<std::shared_ptr<DeferredAck>>& deferredAcks) {
+    for (UdpJob& job : jobs) {
+        const sockaddr_in clientAddr = job.clientAddr;
+        const std::shared_ptr<ClientContext> context = job.context;
+        const netproto::MessageHeader requestHeader = job.header;
+        const std::shared_ptr<DeferredAck> deferredAck = job.deferredAck;
+        if (deferredAck) {
+            deferredAck->deadline = std::chrono::steady_clock::now() + kPiggybackAckDelay;
+        }
+        const bool queued = pool.submit([socket, job = std::move(job)] {
+            netproto::MessageHeader responseHeader;
+            std::vector<std::vector<uint8_t>> responseParts =
+                handleUdpRequest(*job.context, job.header, job.payload, responseHeader);
+            std::unique_lock<std::mutex> lock;
+            if (job.deferredAck) {
+                lock = std::unique_lock<std::mutex>(job.deferredAck->mutex);
+                job.deferredAck->answered = true;
             }
-            case netproto::Command::PathQuery: {
-                netproto::PathQueryPayload query{};
-                if (!netproto::deserializePathQuery(payload, query)) {
-                    responsePayload = makeErrorPayload("Некорректная структура PathQuery.", responseHeader);
-                    break;
-                }
-                if (!context->hasGraph) {
-                    responsePayload = makeErrorPayload("Граф не загружен. Используйте load_graph.", responseHeader);
+            for (const std::vector<uint8_t>& part : responseParts) {
+                if (!sendUdpMessage(socket, job.clientAddr, responseHeader, part)) {
+                    std::cout << "Не удалось отправить ответ UDP-клиенту.\n";
                     break;
                 }
-                graph::PathComputation computation = graph::bellmanFord(context->graph,
-                                                                        query.source,
-                                                                        query.target);
-                responsePayload = buildPathResultPayload(computation, responseHeader);
-                break;
             }
-            case netproto::Command::Exit: {
-                responseHeader.command = netproto::Command::Exit;
-                responseHeader.status = netproto::Status::Ok;
-                responsePayload = netproto::serializeString("До свидания.");
-                {
-                    std::lock_guard<std::mutex> lock(clientsMutex);
-                    clients.erase(key);
-                }
-                break;
+        });
+        if (queued && deferredAck) {
+            deferredAcks.push_back(deferredAck);
+        }
+        if (!queued) {
+            netproto::MessageHeader busyHeader = makeHeader(netproto::Command::Error,
+                                                            netproto::Status::NotReady,
+                                                            requestHeader.requestId);
+            // Отказ не кэшируется: повторный запрос должен быть обработан, когда очередь освободится.
+            finishUdpRequest(*context, requestHeader, busyHeader, {}, false);
+            outbox.push(clientAddr, busyHeader, netproto::serializeString("Сервер перегружен, повторите запрос позже."));
+        }
+    }
+    jobs.clear();
+}
+
+// Создание UDP-сокета, привязанного к порту. С reusePort устанавливается SO_REUSEPORT, чтобы несколько
+// сокетов могли быть привязаны к одному порту (ядро распределяет датаграммы между ними по хешу адресов).
+// Возвращает -1 при ошибке.
+int openUdpSocket(uint16_t port, bool reusePort) {
+    int serverSocket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (serverSocket < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (reusePort) {
+        int opt = 1;
+        if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            perror("setsockopt(SO_REUSEPORT)");
+            close(serverSocket);
+            return -1;
+        }
+    }
+    sockaddr_in serverAddr{};
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
+    if (bind(serverSocket,
+             reinterpret_cast<sockaddr*>(&serverAddr),
+             sizeof(serverAddr)) < 0) {
+        perror("bind");
+        close(serverSocket);
+        return -1;
+    }
+    return serverSocket;
+}
+
+// Отправка отложенных ACK, срок которых истёк к моменту now, для запросов, ответ на которые ещё
+// не отправлен. Сроки растут в порядке постановки, поэтому проверяется только начало очереди.
+void sendExpiredAcks(int socket,
+                     std::deque<std::shared_ptr<DeferredAck>>& deferredAcks,
+                     std::chrono::steady_clock::time_point now) {
+    while (!deferredAcks.empty() && deferredAcks.front()->deadline <= now) {
+        DeferredAck& deferred = *deferredAcks.front();
+        {
+            std::lock_guard<std::mutex> lock(deferred.mutex);
+            if (!deferred.answered) {
+                netproto::MessageHeader ack = makeHeader(netproto::Command::Ack,
+                                                         netproto::Status::Ok,
+                                                         deferred.requestId);
+                sendUdpMessage(socket, deferred.clientAddr, ack, {});
             }
-            default: {
-                responsePayload = makeErrorPayload("Неизвестная команда.", responseHeader);
-                break;
+        }
+        deferredAcks.pop_front();
+    }
+}
+
+// Цикл приёма одного UDP-сокета (шарда): хранит состояние графа для каждого клиента шарда
+// в собственной хеш-таблице (ключ - адрес клиента), поэтому шарды не разделяют состояние.
+// Датаграммы принимаются вызовом recvmmsg пакетами до batchSize штук в заранее выделенные буферы,
+// а ACK и ответы потока приёма отправляются через sendmmsg после обработки каждого пакета.
+// Если pool равен nullptr, запросы вычисляются последовательно в потоке приёма после отправки ACK
+// всего пакета. Иначе поток приёма
+// только разбирает заголовок, отправляет ACK и ставит запрос в ограниченную очередь пула, потоки
+// которого вычисляют и отправляют ответы; при переполнении очереди клиенту сразу отправляется ошибка.
+// Таблица клиентов используется только потоком приёма (Exit также обрабатывается в нём), а задачи
+// пула держат контекст клиента через shared_ptr, поэтому блокировка таблицы не нужна.
+// На запросы с флагом kFlagPiggybackAck при обработке пулом ACK откладывается на kPiggybackAckDelay
+// и отправляется, только если ответ к этому времени не готов (ожидание датаграмм ограничивается
+// ближайшим сроком через ppoll). Без пула такие запросы подтверждаются сразу, как и остальные:
+// долгое вычисление в потоке приёма не должно оставлять клиента без ACK и без ответа.
+// Раз в kUdpSweepInterval поток приёма удаляет брошенные сборки фрагментов и неактивных клиентов
+// шарда; пока таблица клиентов не пуста, ожидание датаграмм ограничивается и сроком следующей очистки.
+void runUdpReceiveLoop(int serverSocket, WorkerPool* pool, WorkerPool* builder, std::size_t batchSize) {
+    UdpShard shard;
+    auto nextSweep = std::chrono::steady_clock::now() + kUdpSweepInterval;
+    auto sweepIfDue = [&shard, &nextSweep](std::chrono::steady_clock::time_point now) {
+        if (now >= nextSweep) {
+            sweepUdpShard(shard, now);
+            nextSweep = now + kUdpSweepInterval;
+        }
+    };
+    UdpOutbox outbox(serverSocket, batchSize);
+    std::vector<UdpJob> jobs;
+    std::deque<std::shared_ptr<DeferredAck>> deferredAcks;
+
+    std::vector<std::vector<uint8_t>> buffers(batchSize, std::vector<uint8_t>(kUdpDatagramBufferSize));
+    std::vector<sockaddr_in> addresses(batchSize);
+    std::vector<iovec> iovecs(batchSize);
+    std::vector<mmsghdr> messages(batchSize);
+
+    while (true) {
+        for (std::size_t i = 0; i < batchSize; ++i) {
+            iovecs[i].iov_base = buffers[i].data();
+            iovecs[i].iov_len = buffers[i].size();
+            messages[i] = {};
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        std::optional<std::chrono::steady_clock::time_point> wakeAt;
+        if (!deferredAcks.empty()) {
+            wakeAt = deferredAcks.front()->deadline;
+        }
+        if (!shard.clients.empty()) {
+            wakeAt = wakeAt ? std::min(*wakeAt, nextSweep) : nextSweep;
+        }
+        if (wakeAt) {
+            const auto wait = *wakeAt - std::chrono::steady_clock::now();
+            const auto waitNs = std::max<int64_t>(
+                0, std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count());
+            timespec timeout{};
+            timeout.tv_sec = static_cast<time_t>(waitNs / 1000000000);
+            timeout.tv_nsec = static_cast<long>(waitNs % 1000000000);
+            pollfd readable{serverSocket, POLLIN, 0};
+            if (ppoll(&readable, 1, &timeout, nullptr) <= 0) {
+                const auto now = std::chrono::steady_clock::now();
+                sendExpiredAcks(serverSocket, deferredAcks, now);
+                sweepIfDue(now);
+                continue;
             }
         }
+        // MSG_WAITFORONE: ждём первую датаграмму, затем забираем только уже пришедшие.
+        int received = recvmmsg(serverSocket,
+                                messages.data(),
+                                static_cast<unsigned int>(batchSize),
+                                MSG_WAITFORONE,
+                                nullptr);
+        if (received < 0) {
+            if (errno != EINTR) {
+                perror("recvmmsg");
+            }
+            continue;
+        }
+        for (int i = 0; i < received; ++i) {
+            handleUdpDatagram(outbox, shard, jobs, pool, builder,
+                              addresses[i], buffers[i].data(), messages[i].msg_len);
+        }
+        outbox.flush();
+        if (pool) {
+            submitUdpJobs(serverSocket, *pool, jobs, outbox, deferredAcks);
+            outbox.flush();
+        } else {
+            runUdpJobs(outbox, jobs);
+        }
+        const auto now = std::chrono::steady_clock::now();
+        sendExpiredAcks(serverSocket, deferredAcks, now);
+        sweepIfDue(now);
+    }
+}
 
-        if (!sendUdpMessage(serverSocket, clientAddr, responseHeader, responsePayload)) {
-            std::cout << "Не удалось отправить ответ UDP-клиенту.\n";
+// Запуск UDP-сервера: открывает shardCount сокетов на одном порту (при shardCount > 1 - с SO_REUSEPORT)
+// и запускает для каждого свой поток приёма runUdpReceiveLoop с собственной таблицей клиентов.
+// Ядро направляет все датаграммы одного клиента в один и тот же сокет, поэтому состояние клиента
+// не разделяется между шардами. Фрагменты (Chunk) подтверждаются по одному и собираются в контексте
+// клиента; ответ отправляется после сборки всего сообщения. Пул из workerCount потоков (если задан)
+// общий для всех шардов; он же строит иерархии сжатия. Без пула иерархии строит отдельный поток,
+// общий для всех шардов, чтобы построение не останавливало приём датаграмм.
+void runUdpServer(uint16_t port, std::size_t workerCount, std::size_t batchSize, std::size_t shardCount) {
+    std::vector<int> sockets;
+    for (std::size_t shard = 0; shard < shardCount; ++shard) {
+        int serverSocket = openUdpSocket(port, shardCount > 1);
+        if (serverSocket < 0) {
+            for (int opened : sockets) {
+                close(opened);
+            }
+            return;
         }
+        sockets.push_back(serverSocket);
+    }
+    std::cout << "UDP сервер слушает порт " << port;
+    if (shardCount > 1) {
+        std::cout << " (шардов: " << shardCount << ")";
+    }
+    std::cout << "\n";
+
+    std::optional<WorkerPool> pool;
+    if (workerCount > 0) {
+        pool.emplace(workerCount, kUdpQueueCapacity);
+    }
+    WorkerPool* poolPtr = pool ? &*pool : nullptr;
+    std::optional<WorkerPool> hierarchyBuilder;
+    if (!pool) {
+        hierarchyBuilder.emplace(1);
+    }
+    WorkerPool* builder = pool ? poolPtr : &*hierarchyBuilder;
+
+    std::vector<std::thread> shards;
+    for (std::size_t shard = 1; shard < shardCount; ++shard) {
+        shards.emplace_back(runUdpReceiveLoop, sockets[shard], poolPtr, builder, batchSize);
+    }
+    runUdpReceiveLoop(sockets[0], poolPtr, builder, batchSize);
+    for (std::thread& thread : shards) {
+        thread.join();
     }
 }
 
-// Парсинг протокола: преобразует строку "tcp" или "udp" в значение enum Transport.
+// Парсинг протокола: преобразует строку "tcp", "tcp-epoll" или "udp" в значение enum Transport.
 // Возвращает nullopt для неизвестного протокола.
 std::optional<Transport> parseTransport(const std::string& protocol) {
     if (protocol == "tcp") {
         return Transport::Tcp;
     }
+    if (protocol == "tcp-epoll") {
+        return Transport::TcpEpoll;
+    }
     if (protocol == "udp") {
         return Transport::Udp;
     }
     return std::nullopt;
 }
 
-}  // namespace
-
-int main(int argc, char* argv[]) {
-    // Игнорируем сигнал SIGPIPE, чтобы сервер не падал при разрыве соединения
-    signal(SIGPIPE, SIG_IGN);
-    
-    if (argc != 3) {
-        std::cerr << "Использование: " << argv[0] << " <protocol> <port>\n";
-        return 1;
+// Разбор аргументов командной строки: <protocol> <port> [--workers N] [--batch N] [--shards N].
+// Без --workers режимы tcp и tcp-epoll используют пул по количеству ядер процессора,
+// а UDP-сервер обрабатывает запросы в потоке приёма.
+std::optional<ServerConfig> parseArguments(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Использование: " << argv[0] << " <protocol> <port> [--workers N] [--batch N] [--shards N]\n"
+                  << "  protocol: tcp, tcp-epoll или udp\n";
+        return std::nullopt;
     }
-    std::string protocol = argv[1];
-    auto transportOpt = parseTransport(protocol);
+    ServerConfig config;
+    auto transportOpt = parseTransport(argv[1]);
     if (!transportOpt) {
-        std::cerr << "Неизвестный протокол. Используйте tcp или udp.\n";
-        return 1;
+        std::cerr << "Неизвестный протокол. Используйте tcp, tcp-epoll или udp.\n";
+        return std::nullopt;
     }
+    config.transport = *transportOpt;
     int port = std::stoi(argv[2]);
     if (port <= 0 || port > std::numeric_limits<uint16_t>::max()) {
         std::cerr << "Некорректный номер порта.\n";
+        return std::nullopt;
+    }
+    config.port = static_cast<uint16_t>(port);
+
+    for (int i = 3; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--workers" && i + 1 < argc) {
+            int workers = std::stoi(argv[++i]);
+            if (workers <= 0 || workers > 1024) {
+                std::cerr << "Количество потоков обработки должно быть от 1 до 1024.\n";
+                return std::nullopt;
+            }
+            config.workerCount = static_cast<std::size_t>(workers);
+        } else if (option == "--batch" && i + 1 < argc) {
+            int batch = std::stoi(argv[++i]);
+            if (batch <= 0 || batch > static_cast<int>(kMaxUdpBatchSize)) {
+                std::cerr << "Размер пакета датаграмм должен быть от 1 до " << kMaxUdpBatchSize << ".\n";
+                return std::nullopt;
+            }
+            config.udpBatchSize = static_cast<std::size_t>(batch);
+        } else if (option == "--shards" && i + 1 < argc) {
+            int shards = std::stoi(argv[++i]);
+            if (shards <= 0 || shards > static_cast<int>(kMaxUdpShards)) {
+                std::cerr << "Количество шардов должно быть от 1 до " << kMaxUdpShards << ".\n";
+                return std::nullopt;
+            }
+            config.udpShardCount = static_cast<std::size_t>(shards);
+        } else {
+            std::cerr << "Неизвестный параметр: " << option << "\n";
+            return std::nullopt;
+        }
+    }
+    return config;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    // Игнорируем сигнал SIGPIPE, чтобы сервер не падал при разрыве соединения
+    signal(SIGPIPE, SIG_IGN);
+    
+    auto configOpt = parseArguments(argc, argv);
+    if (!configOpt) {
         return 1;
     }
-    uint16_t portValue = static_cast<uint16_t>(port);
+    const ServerConfig& config = *configOpt;
+    const std::size_t tcpWorkerCount =
+        config.workerCount > 0 ? config.workerCount : std::max(1u, std::thread::hardware_concurrency());
 
-    if (*transportOpt == Transport::Tcp) {
-        runTcpServer(portValue);
-    } else {
-        runUdpServer(portValue);
+    switch (config.transport) {
+        case Transport::Tcp:
+            runTcpServer(config.port, tcpWorkerCount);
+            break;
+        case Transport::TcpEpoll:
+            runTcpEpollServer(config.port, tcpWorkerCount);
+            break;
+        case Transport::Udp:
+            runUdpServer(config.port, config.workerCount, config.udpBatchSize, config.udpShardCount);
+            break;
     }
 
     return 0;
@@ -123,7 +123,7 @@ set timeout 5
 set port [lindex $argv 0]
 set filename [lindex $argv 1]
 set cmd_input "load $filename"
-set expected_msg "Неверное количество вершин: <полученное кол-во вершин>. Требуется от 6 до 65535."
+set expected_msg "Неверное количество вершин: <полученное кол-во вершин>. Требуется от 6 до 16777216."
 
 log_user 0
 
@@ -30,6 +30,9 @@ if [ $? -ne 0 ]; then echo -e "${RED}[FAIL] Ошибка компиляции с
 g++ -std=c++17 -pthread client.cpp graph.cpp protocol.cpp -o "$TEST_DIR/client"
 if [ $? -ne 0 ]; then echo -e "${RED}[FAIL] Ошибка компиляции клиента${NC}"; exit 1; fi
 
+g++ -std=c++17 -O2 graph_check.cpp graph.cpp -o "$TEST_DIR/graph_check"
+if [ $? -ne 0 ]; then echo -e "${RED}[FAIL] Ошибка компиляции сверки алгоритмов${NC}"; exit 1; fi
+
 cd "$TEST_DIR" || exit 1
 
 # Генератор графов
@@ -92,34 +95,39 @@ if __name__ == "__main__":
     generate_graph(sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), is_disc)
 EOF
 
-# Решатель
+# Решатель: "solve_graph.py FILE U V" печатает ожидаемый ответ на query U V, а
+# "solve_graph.py FILE batch|dist|table ..." - ожидаемые строки вывода клиента на эту команду
+# (длины путей пакетного запроса, расстояния вектора и строки таблицы, без самих путей).
 cat << 'EOF' > solve_graph.py
 import sys
 import networkx as nx
 
+def load_graph(filename):
+    with open(filename, 'r') as f:
+        lines = [l.strip() for l in f if l.strip()]
+
+    header = lines[0].split()
+    v_count = int(header[0])
+    e_count = int(header[1])
+
+    matrix_lines = lines[1:1+v_count]
+    weight_line = lines[1+v_count]
+
+    matrix = [list(map(int, l.split())) for l in matrix_lines]
+    weights = list(map(int, weight_line.split()))
+
+    G = nx.Graph()
+    G.add_nodes_from(range(v_count))
+
+    for e in range(e_count):
+        nodes = [v for v in range(v_count) if matrix[v][e] == 1]
+        if len(nodes) == 2:
+            G.add_edge(nodes[0], nodes[1], weight=weights[e])
+    return G
+
 def solve(filename, start_node, end_node):
     try:
-        with open(filename, 'r') as f:
-            lines = [l.strip() for l in f if l.strip()]
-        
-        header = lines[0].split()
-        v_count = int(header[0])
-        e_count = int(header[1])
-        
-        matrix_lines = lines[1:1+v_count]
-        weight_line = lines[1+v_count]
-        
-        matrix = [list(map(int, l.split())) for l in matrix_lines]
-        weights = list(map(int, weight_line.split()))
-        
-        G = nx.Graph()
-        G.add_nodes_from(range(v_count))
-        
-        for e in range(e_count):
-            nodes = [v for v in range(v_count) if matrix[v][e] == 1]
-            if len(nodes) == 2:
-                G.add_edge(nodes[0], nodes[1], weight=weights[e])
-            
+        G = load_graph(filename)
         try:
             length = nx.shortest_path_length(G, source=start_node, target=end_node, weight='weight')
             print(f"Длина пути: {length}")
@@ -130,8 +138,36 @@ def solve(filename, start_node, end_node):
         print(f"ERROR: {e}", file=sys.stderr)
         sys.exit(1)
 
+def solve_command(filename, command, args):
+    G = load_graph(filename)
+    if command == "batch":
+        # Для каждой пары: длина пути или сообщение об отсутствии пути
+        values = list(map(int, args))
+        for u, v in zip(values[0::2], values[1::2]):
+            try:
+                print(f"Длина пути: {nx.shortest_path_length(G, source=u, target=v, weight='weight')}")
+            except nx.NetworkXNoPath:
+                print("Путь не найден.")
+    elif command == "dist":
+        # Расстояние до каждой вершины графа; вершины другой компоненты недостижимы
+        lengths = nx.single_source_dijkstra_path_length(G, int(args[0]), weight='weight')
+        for v in range(G.number_of_nodes()):
+            print(f"{v}: {lengths[v]}" if v in lengths else f"{v}: недостижима")
+    elif command == "table":
+        # Строка заголовка с конечными вершинами и строка расстояний для каждой начальной вершины
+        split = args.index("to")
+        sources = list(map(int, args[:split]))
+        targets = list(map(int, args[split + 1:]))
+        print("\t".join(["от\\до"] + [str(t) for t in targets]))
+        for s in sources:
+            lengths = nx.single_source_dijkstra_path_length(G, s, weight='weight')
+            print("\t".join([str(s)] + [str(lengths[t]) if t in lengths else "-" for t in targets]))
+
 if __name__ == "__main__":
-    solve(sys.argv[1], int(sys.argv[2]), int(sys.argv[3]))
+    if sys.argv[2] in ("batch", "dist", "table"):
+        solve_command(sys.argv[1], sys.argv[2], sys.argv[3:])
+    else:
+        solve(sys.argv[1], int(sys.argv[2]), int(sys.argv[3]))
 EOF
 
 echo -e "${YELLOW}[DATA] Генерация тестовых наборов...${NC}"
@@ -141,6 +177,7 @@ python3 gen_graph.py valid_small.txt 10 15
 python3 gen_graph.py valid_medium.txt 100 200
 python3 gen_graph.py valid_max_limit.txt 705 705
 python3 gen_graph.py disconnected.txt 20 10 disconnected
+python3 gen_graph.py disconnected_medium.txt 100 150 disconnected
 
 # Невалидные файлы
 # 1. Слишком мало вершин (<6)
@@ -154,10 +191,12 @@ cat << EOF > invalid_low_5.txt
 1 1 1 1 1
 EOF
 
-python3 gen_graph.py invalid_limit_exceeded.txt 706 706
+python3 gen_graph.py valid_above_old_limit.txt 706 706
 
 python3 gen_graph.py valid_huge_sparse.txt 65535 7
 
+python3 gen_graph.py valid_above_v1_limit.txt 70000 7
+
 cat << EOF > invalid_overflow.txt
 65536 7
 $(for i in {1..65536}; do echo "0 0 0 0 0 0 0"; done)
@@ -353,6 +392,140 @@ expect {
 }
 EOF
 
+# Скрипт для серии запросов пути на одном графе: аргументы после имени файла - пары (запрос, ожидаемый ответ)
+cat << 'EOF' > run_test_series.exp
+set timeout 10
+set protocol [lindex $argv 0]
+set port [lindex $argv 1]
+set filename [lindex $argv 2]
+set queries [lrange $argv 3 end]
+
+log_user 0
+
+proc print_res {input expected actual status} {
+    puts "   INPUT    : $input"
+    puts "   EXPECTED : $expected"
+    puts "   ACTUAL   : $actual"
+    if {$status == "PASS"} {
+        puts "   RESULT   : \033\[1;32m\[PASS\]\033\[0m"
+    } else {
+        puts "   RESULT   : \033\[1;31m\[FAIL\]\033\[0m"
+    }
+}
+
+spawn ./client 127.0.0.1 $protocol $port
+expect "> "
+send "load $filename\r"
+expect {
+    "Граф успешно загружен" { }
+    timeout {
+        print_res "load $filename" "Граф успешно загружен" "TIMEOUT" "FAIL"
+        exit 1
+    }
+}
+expect "> "
+
+set status 0
+foreach {cmd_query expected_out} $queries {
+    send "$cmd_query\r"
+    expect {
+        -re "Длина пути: \[0-9\]+|Ошибка сервера: \[^\r\n\]*" {
+            set actual $expect_out(0,string)
+            if {$actual == $expected_out} {
+                print_res "$cmd_query" "$expected_out" "$actual" "PASS"
+            } else {
+                print_res "$cmd_query" "$expected_out" "$actual" "FAIL"
+                set status 1
+            }
+        }
+        timeout {
+            print_res "$cmd_query" "$expected_out" "TIMEOUT" "FAIL"
+            exit 1
+        }
+    }
+    expect "> "
+}
+exit $status
+EOF
+
+# Скрипт для команд batch, dist и table: аргументы после имени файла - пары (команда, файл с
+# ожидаемыми строками). Из вывода клиента отбираются длины путей, строки "v: расстояние" и строки
+# таблицы (с табуляцией); эхо команды, заголовки, сами пути и сообщения о повторах пропускаются.
+cat << 'EOF' > run_test_output.exp
+set timeout 30
+match_max 1000000
+set protocol [lindex $argv 0]
+set port [lindex $argv 1]
+set filename [lindex $argv 2]
+set commands [lrange $argv 3 end]
+set filter {^(Длина пути: [0-9]+|Путь не найден\.|[0-9]+: ([0-9]+|недостижима)|[^\t]*\t.*)$}
+
+log_user 0
+
+proc print_res {input expected actual status} {
+    puts "   INPUT    : $input"
+    puts "   EXPECTED : $expected"
+    puts "   ACTUAL   : $actual"
+    if {$status == "PASS"} {
+        puts "   RESULT   : \033\[1;32m\[PASS\]\033\[0m"
+    } else {
+        puts "   RESULT   : \033\[1;31m\[FAIL\]\033\[0m"
+    }
+}
+
+spawn ./client 127.0.0.1 $protocol $port
+expect "> "
+send "load $filename\r"
+expect {
+    "Граф успешно загружен" { }
+    timeout {
+        print_res "load $filename" "Граф успешно загружен" "TIMEOUT" "FAIL"
+        exit 1
+    }
+}
+expect "> "
+
+set status 0
+foreach {cmd_query expected_file} $commands {
+    set input [string range $cmd_query 0 59]
+    if {[string length $cmd_query] > 60} { append input " ..." }
+    set f [open $expected_file r]
+    set expected_lines [split [string trimright [read $f] "\n"] "\n"]
+    close $f
+
+    send "$cmd_query\r"
+    expect {
+        -re "\r\n> $" { set output $expect_out(buffer) }
+        timeout {
+            print_res "$input" "[llength $expected_lines] строк ($expected_file)" "TIMEOUT" "FAIL"
+            exit 1
+        }
+    }
+    set actual_lines {}
+    foreach line [split [string map {"\r" ""} $output] "\n"] {
+        if {[regexp -- $filter $line]} { lappend actual_lines $line }
+    }
+
+    # Первое расхождение со строками эталона (или разница в числе строк)
+    set actual "[llength $actual_lines] строк совпадают"
+    set result "PASS"
+    for {set i 0} {$i < [llength $expected_lines]} {incr i} {
+        if {[lindex $actual_lines $i] != [lindex $expected_lines $i]} {
+            set actual "строка [expr {$i + 1}]: \"[lindex $actual_lines $i]\", ожидалось \"[lindex $expected_lines $i]\""
+            set result "FAIL"
+            break
+        }
+    }
+    if {$result == "PASS" && [llength $actual_lines] != [llength $expected_lines]} {
+        set actual "[llength $actual_lines] строк вместо [llength $expected_lines]"
+        set result "FAIL"
+    }
+    print_res "$input" "[llength $expected_lines] строк ($expected_file)" "$actual" $result
+    if {$result == "FAIL"} { set status 1 }
+}
+exit $status
+EOF
+
 # Скрипт для проверки таймаута UDP
 cat << 'EOF' > run_test_udp_timeout.exp
 set timeout 12
@@ -414,6 +587,76 @@ run_logic_test() {
     if [ $RET -eq 0 ]; then return 0; else return 1; fi
 }
 
+# Серия из COUNT запросов случайных пар на одном графе: начиная с 8-го запроса пути сервер
+# отвечает по иерархии сжатия, поэтому ответы до и после её построения сверяются с эталоном.
+run_series_test() {
+    TEST_NAME="$1"
+    PORT="$2"
+    PROTO="$3"
+    FILE="$4"
+    COUNT="$5"
+
+    echo -e "${CYAN}TEST: $TEST_NAME${NC}"
+    V_COUNT=$(head -n 1 "$FILE" | cut -d' ' -f1)
+    ARGS=()
+    for ((i = 0; i < COUNT; i++)); do
+        U=$((RANDOM % V_COUNT))
+        V=$((RANDOM % V_COUNT))
+        ARGS+=("query $U $V" "$(python3 solve_graph.py "$FILE" "$U" "$V")")
+    done
+
+    ./server $PROTO $PORT > /dev/null 2>&1 &
+    PID=$!
+    sleep 0.5
+
+    expect -f run_test_series.exp "$PROTO" "$PORT" "$FILE" "${ARGS[@]}"
+    RET=$?
+
+    kill $PID 2>/dev/null; wait $PID 2>/dev/null
+    return $RET
+}
+
+# Случайные вершины графа FILE: COUNT штук через пробел (для пар batch и списков table).
+random_vertices() {
+    FILE="$1"
+    COUNT="$2"
+    V_COUNT=$(head -n 1 "$FILE" | cut -d' ' -f1)
+    VERTICES=()
+    for ((i = 0; i < COUNT; i++)); do
+        VERTICES+=($((RANDOM % V_COUNT)))
+    done
+    echo "${VERTICES[*]}"
+}
+
+# Команды batch, dist и table на одном графе: ожидаемые строки вывода каждой команды
+# solve_graph.py пишет в expected_<порт>_<номер>.txt, скрипт сверяет с ними вывод клиента.
+run_output_test() {
+    TEST_NAME="$1"
+    PORT="$2"
+    PROTO="$3"
+    FILE="$4"
+    shift 4
+
+    echo -e "${CYAN}TEST: $TEST_NAME${NC}"
+    ARGS=()
+    N=0
+    for CMD in "$@"; do
+        N=$((N + 1))
+        python3 solve_graph.py "$FILE" $CMD > "expected_${PORT}_${N}.txt"
+        ARGS+=("$CMD" "expected_${PORT}_${N}.txt")
+    done
+
+    ./server $PROTO $PORT > /dev/null 2>&1 &
+    PID=$!
+    sleep 0.5
+
+    expect -f run_test_output.exp "$PROTO" "$PORT" "$FILE" "${ARGS[@]}"
+    RET=$?
+
+    kill $PID 2>/dev/null; wait $PID 2>/dev/null
+    return $RET
+}
+
 run_validation_test() {
     TEST_NAME="$1"
     PORT="$2"
@@ -437,8 +680,8 @@ run_logic_test "2. UDP: Малый граф (10 вершин)" 6002 "udp" "valid
 run_logic_test "3. TCP: Средний граф (100 вершин)" 6003 "tcp" "valid_medium.txt" 0 50
 run_logic_test "4. TCP: Макс. граф (705 вершин, 705 ребер)" 6004 "tcp" "valid_max_limit.txt" 0 704
 run_logic_test "5. TCP: Несвязный граф (пути нет)" 6005 "tcp" "disconnected.txt" 0 15
-run_validation_test "6. Ошибка: 5 вершин (< min 6)" 6006 "invalid_low_5.txt" "Ошибка чтения файла: Неверное количество вершин: 5. Требуется от 6 до 65535."
-run_validation_test "7. Ошибка: 706 вершин и 706 рёбер (> max 705)" 6007 "invalid_limit_exceeded.txt" "Ошибка чтения файла: Неверный размер матрицы инцидентности: 498436. Требуется от 36 до 497025."
+run_validation_test "6. Ошибка: 5 вершин (< min 6)" 6006 "invalid_low_5.txt" "Ошибка чтения файла: Неверное количество вершин: 5. Требуется от 6 до 16777216."
+run_logic_test "7. TCP: граф больше прежнего предела 705x705 (706 вершин, 706 рёбер)" 6007 "tcp" "valid_above_old_limit.txt" 0 705
 echo -e "${CYAN}TEST: 8. UDP Reliability (Нет сервера - таймаут)${NC}"
 expect -f run_test_udp_timeout.exp 6008
 echo -e "${CYAN}TEST: 9. Concurrency (3 клиента одновременно)${NC}"
@@ -506,7 +749,9 @@ fi
 
 run_logic_test "10. TCP: граница вершин (65535 вершин, 7 рёбер)" 6004 "tcp" "valid_huge_sparse.txt" 0 1
 
-run_validation_test "11. Ошибка: 65536 вершин" 8000 "invalid_overflow.txt" "Ошибка чтения файла: Неверное количество вершин: 65536. Требуется от 6 до 65535."
+run_logic_test "10.1. TCP: граф больше 65535 вершин, версия 2 протокола (70000 вершин, 7 рёбер)" 6004 "tcp" "valid_above_v1_limit.txt" 0 1
+
+run_validation_test "11. Ошибка: 65536 вершин, рёбра без концов" 8000 "invalid_overflow.txt" "Ошибка валидации графа: Каждое ребро должно быть инцидентно двум вершинам."
 
 # Тест 1.4.2.1 - Ручной ввод
 echo -e "${CYAN}TEST: 12. Manual Input (Ручной ввод)${NC}"
@@ -519,3 +764,31 @@ kill $PID 2>/dev/null; wait $PID 2>/dev/null
 
 run_validation_test "13. Ошибка формата (буквы в файле)" 8002 "invalid_format.txt" "Ошибка чтения файла: В строке 1 матрицы инцидентности неверное количество чисел: ожидается 10, получено 5."
 run_validation_test "14. Ошибка: Отрицательные веса" 8003 "invalid_negative.txt" "Ошибка сервера: Вес ребра либо < 0, либо слишком велик."
+
+run_series_test "15. TCP: 12 запросов до и после построения иерархии сжатия (несвязный граф, 100 вершин)" 8004 "tcp" "disconnected_medium.txt" 12
+
+echo -e "${CYAN}TEST: 16. Сверка алгоритмов поиска с алгоритмом Беллмана-Форда (случайные графы)${NC}"
+if ./graph_check > graph_check.log 2>&1; then
+    echo -e "   RESULT   : ${GREEN}[PASS] $(tail -n 1 graph_check.log)${NC}"
+else
+    grep "FAIL" graph_check.log | head -n 20
+    echo -e "   RESULT   : ${RED}[FAIL] Расхождения с алгоритмом Беллмана-Форда (см. graph_check.log)${NC}"
+fi
+
+# Пакетный запрос, таблица и вектор расстояний с ответами из нескольких частей: таблица 130x130
+# больше части TCP (64 КБ), пакет из 60 пар и вектор на 705 вершин больше части UDP.
+run_output_test "17. TCP: batch, table и dist (705 вершин, ответы из нескольких частей)" 8005 "tcp" "valid_max_limit.txt" \
+    "batch $(random_vertices valid_max_limit.txt 120)" \
+    "table $(random_vertices valid_max_limit.txt 130) to $(random_vertices valid_max_limit.txt 130)" \
+    "dist $(random_vertices valid_max_limit.txt 1)"
+run_output_test "18. UDP: batch, table и dist (705 вершин, ответы из нескольких частей)" 8006 "udp" "valid_max_limit.txt" \
+    "batch $(random_vertices valid_max_limit.txt 120)" \
+    "table $(random_vertices valid_max_limit.txt 30) to $(random_vertices valid_max_limit.txt 30)" \
+    "dist $(random_vertices valid_max_limit.txt 1)"
+
+# Вектор расстояний на несвязном графе: из вершин 0 и 99 (разные половины) вершины другой половины
+# должны прийти недостижимыми (бит достижимости сброшен), расстояния остальных - совпасть с эталоном.
+run_output_test "19. TCP: вектор расстояний на несвязном графе (100 вершин)" 8007 "tcp" "disconnected_medium.txt" \
+    "dist 0" "dist 99" "dist $(random_vertices disconnected_medium.txt 1)"
+run_output_test "20. UDP: вектор расстояний на несвязном графе (100 вершин)" 8008 "udp" "disconnected_medium.txt" \
+    "dist 0" "dist 99" "dist $(random_vertices disconnected_medium.txt 1)"